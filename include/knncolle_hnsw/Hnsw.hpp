@@ -5,11 +5,16 @@
 #include <type_traits>
 #include <queue>
 #include <algorithm>
+#include <numeric>
+#include <limits>
 #include <memory>
 #include <cstddef>
 #include <cstring>
 #include <cmath>
 #include <filesystem>
+#include <chrono>
+#include <functional>
+#include <atomic>
 
 #include "knncolle/knncolle.hpp"
 #include "sanisizer/sanisizer.hpp"
@@ -17,6 +22,20 @@
 
 #include "distances.hpp"
 #include "utils.hpp"
+#include "index_io.hpp"
+#include "wave_build.hpp"
+#include "bulk_build.hpp"
+#include "nn_descent.hpp"
+#include "diagnostics.hpp"
+#include "compaction.hpp"
+#include "interleaved_search.hpp"
+#include "result_cache.hpp"
+#include "entry_points.hpp"
+#include "visited_set.hpp"
+#include "insertion_order.hpp"
+#include "SparseMatrix.hpp"
+#include "build_progress.hpp"
+#include "instrumentation.hpp"
 
 /**
  * @file knncolle_hnsw.hpp
@@ -58,14 +77,297 @@ struct HnswOptions {
      * see [here](https://github.com/nmslib/hnswlib/blob/master/ALGO_PARAMS.md#search-parameters) for details.
      */
     int ef_search = 10;
+
+    /**
+     * Type of set used by each searcher to track the visited nodes.
+     * This can be changed after construction with `HnswPrebuilt::set_visited_set()`.
+     */
+    VisitedSetType visited_set = VisitedSetType::AUTO;
+
+    /**
+     * Seed for the random generation of each node's level in the hierarchy.
+     * For a given seed, the levels are always the same, and so is the index if it is built with a single thread or in waves (see `HnswOptions::wave_size`).
+     */
+    std::size_t seed = 100;
+
+    /**
+     * Size of each wave when building the index in parallel.
+     * If positive, observations are inserted in consecutive waves of this size.
+     * Within each wave, the candidate neighbors of each observation are found in parallel by searching the graph as it was at the start of the wave;
+     * the links are then committed serially in order of the observation indices.
+     * This yields the same index regardless of `HnswOptions::num_threads`, at the cost of some accuracy for larger waves.
+     * If zero, observations are inserted one at a time with **hnswlib**'s usual `addPoint()` method.
+     * Ignored if `HnswOptions::nn_descent_iterations` is positive.
+     */
+    int wave_size = 0;
+
+    /**
+     * Order in which observations are inserted into the index.
+     * Inserting nearby observations consecutively improves cache locality during construction, which can increase build throughput for large datasets.
+     * Orders other than `InsertionOrder::INPUT` require a temporary copy of all observations to compute the order.
+     * Only used when building by insertion, i.e., ignored if `HnswOptions::nn_descent_iterations` is positive or if the index is built from existing neighbors.
+     */
+    InsertionOrder insertion_order = InsertionOrder::INPUT;
+
+    /**
+     * Maximum number of iterations of NN-descent for building the base layer of the index.
+     * If positive, an approximate nearest neighbor graph is first constructed with NN-descent,
+     * where each observation's neighbors (and the observations that report it as a neighbor) are compared to each other to find better neighbors.
+     * This graph is then pruned into the base layer with HNSW's usual heuristic, and only the sparse upper layers are built by insertion.
+     * The number of neighbors for each observation in the NN-descent graph is set to twice `HnswOptions::num_links`, i.e., the maximum number of links in the base layer.
+     * The resulting index does not depend on `HnswOptions::num_threads`.
+     * If zero, the index is built by insertion as described in `HnswOptions::wave_size`.
+     */
+    int nn_descent_iterations = 0;
+
+    /**
+     * Early termination threshold for NN-descent.
+     * Iterations stop once the proportion of neighbors that changed in an iteration falls below this value.
+     * Only used if `HnswOptions::nn_descent_iterations` is positive.
+     */
+    double nn_descent_delta = 0.001;
+
+    /**
+     * Sampling rate for NN-descent, as described by Dong et al. (2011).
+     * In each iteration, the local join for each observation uses at most `nn_descent_rho` times the number of neighbors from each of its new neighbors, its reverse new neighbors and its reverse old neighbors.
+     * Smaller values reduce the cost of each iteration, particularly for hubs that are reported as neighbors by many observations, at the cost of slower convergence.
+     * This should be positive.
+     * Only used if `HnswOptions::nn_descent_iterations` is positive.
+     */
+    double nn_descent_rho = 1;
+
+    /**
+     * Relaxation factor for pruning the links in the base layer, as described for the Vamana algorithm by Subramanya et al. (2019).
+     * A candidate is discarded if it is more than `alpha` times closer to an already-selected neighbor than to the observation itself,
+     * where closeness is defined by the distances computed in the HNSW index (e.g., squared Euclidean distances for `configure_euclidean_distance()`).
+     * Values greater than 1 retain more long-range links, yielding a denser and flatter graph that needs fewer hops per search, especially for data with high intrinsic dimensionality.
+     * A value of 1 is equivalent to **hnswlib**'s usual heuristic.
+     *
+     * This is only used when the base layer is constructed directly, i.e., if `HnswOptions::nn_descent_iterations` or `HnswOptions::refine` is set,
+     * or if the index is built from existing neighbors with `HnswBuilder::build_known_raw()`.
+     * Insertion with **hnswlib**'s `addPoint()` or in waves always uses the usual heuristic.
+     * The value is stored in the saved or serialized index for provenance.
+     */
+    double alpha = 1;
+
+    /**
+     * Whether to perform a second refinement pass over the base layer after the index is built.
+     * For each observation, the candidate links are its current links and the results of searching the index for that observation,
+     * which are then pruned according to `HnswOptions::alpha` before adding reverse links.
+     * This improves the quality of graphs built by sequential insertion, where the links of early observations were chosen from a small subset of the data.
+     * The refinement is parallelized across observations and does not depend on `HnswOptions::num_threads`.
+     */
+    bool refine = false;
+
+    /**
+     * Number of entry points into the base layer for searching.
+     * If positive, the observations are clustered by k-means and the observation closest to each centroid is used as an entry point.
+     * Each search then starts the traversal of the base layer from the entry point that is closest to the query, skipping the descent through the upper layers.
+     * This is most useful for strongly clustered data where the upper layers do a poor job of routing the query to the right cluster.
+     * Clustering uses the distance function of the index to assign observations to centroids, while the centroids themselves are the means of their assigned observations.
+     * If zero, searches start from **hnswlib**'s usual global entry point.
+     */
+    std::size_t num_entry_points = 0;
+
+    /**
+     * Number of k-means iterations for choosing the entry points.
+     * Only used if `HnswOptions::num_entry_points` is positive.
+     */
+    int entry_point_iterations = 10;
+
+    /**
+     * Number of threads to use for building the index.
+     * Only used if `HnswOptions::wave_size`, `HnswOptions::nn_descent_iterations` or `HnswOptions::num_entry_points` is positive, if `HnswOptions::refine = true`,
+     * if `HnswOptions::insertion_order` is not `InsertionOrder::INPUT`, or if the index is built from existing neighbors with `HnswBuilder::build_known_raw()`.
+     */
+    int num_threads = 1;
+
+    /**
+     * Whether to back the level 0 block of the index (containing the base-layer links and the observation data) with huge pages.
+     * This reduces TLB misses for large indices.
+     * On Linux, explicitly reserved huge pages are used if available, otherwise we request transparent huge pages via `madvise()`.
+     * On other platforms, or if the memory mapping fails, this option is silently ignored.
+     */
+    bool huge_pages = false;
+
+    /**
+     * Whether to interleave the pages of the level 0 block across all NUMA nodes.
+     * This avoids a situation where all pages are located on a single node, such that searches from threads on other nodes are consistently slower.
+     * Only supported on Linux, otherwise this option is silently ignored.
+     */
+    bool numa_interleave = false;
+
+    /**
+     * Function to report the progress of index construction.
+     * This is called at the start and end of each phase (see `BuildPhase`), after every `HnswOptions::progress_interval` observations during conversion and insertion,
+     * and after each wave (see `HnswOptions::wave_size`) or NN-descent iteration.
+     * It is always called from the thread that constructs the index.
+     * If empty, progress is not reported, but the time spent in each phase is still available from `HnswPrebuilt::build_timings()`.
+     */
+    std::function<void(const HnswBuildProgress&)> progress;
+
+    /**
+     * Number of observations between successive calls to `HnswOptions::progress` during conversion and insertion.
+     * This is also the interval at which `HnswOptions::cancel` is checked.
+     * Conversion directly into the index in parallel (e.g., for a `SparseMatrix`) is only reported at the start and end of the phase.
+     */
+    std::size_t progress_interval = 1000;
+
+    /**
+     * Pointer to a flag for cancelling index construction, e.g., when a job is pre-empted.
+     * This is checked whenever `HnswOptions::progress` would be called.
+     * If the flag is set to true, construction stops and a `HnswBuildCancelled` exception is thrown.
+     * If NULL, construction cannot be cancelled.
+     */
+    const std::atomic<bool>* cancel = NULL;
+};
+
+/**
+ * @brief Options for loading a prebuilt HNSW index from disk.
+ */
+struct HnswLoadOptions {
+    /**
+     * Number of threads to use for reading the index file.
+     * Larger values can improve throughput on storage devices that benefit from multiple outstanding requests, e.g., NVMe drives.
+     */
+    int num_threads = 1;
+
+    /**
+     * Size of each chunk of the index file, in bytes, when reading with multiple threads.
+     * Each thread reads a contiguous run of chunks with its own file handle.
+     * Only used if `HnswLoadOptions::num_threads > 1`.
+     */
+    std::size_t chunk_size = 16 * 1024 * 1024;
+
+    /**
+     * Whether to back the level 0 block of the index with huge pages, see `HnswOptions::huge_pages` for details.
+     */
+    bool huge_pages = false;
+
+    /**
+     * Whether to interleave the pages of the level 0 block across NUMA nodes, see `HnswOptions::numa_interleave` for details.
+     */
+    bool numa_interleave = false;
+};
+
+/**
+ * @brief Statistics from loading a prebuilt HNSW index from disk.
+ */
+struct HnswLoadStatistics {
+    /**
+     * Number of bytes read from the index file.
+     */
+    std::size_t bytes = 0;
+
+    /**
+     * Time spent reading and assembling the index, in seconds.
+     * The throughput is simply `HnswLoadStatistics::bytes / HnswLoadStatistics::seconds`.
+     */
+    double seconds = 0;
 };
 
 /**
  * @cond
  */
+inline knncolle::NumericType read_serialized_preamble(SerializedReader& reader) {
+    std::size_t len;
+    reader.read(&len, sizeof(len));
+    const auto expected_len = std::strlen(hnsw_prebuilt_save_name);
+    if (len != expected_len || std::strncmp(reader.borrow(len), hnsw_prebuilt_save_name, expected_len) != 0) {
+        throw std::runtime_error("buffer does not contain a serialized HNSW index");
+    }
+
+    knncolle::NumericType type;
+    reader.read(&type, sizeof(type));
+    return type;
+}
+
+// Converts the output of hnswlib::HierarchicalNSW::searchKnn() into results
+// sorted by increasing distance. The queue may contain fewer than 'k' results
+// if observations were deleted.
+template<typename Index_, typename Distance_, typename HnswData_>
+void report_queue(std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> >& queue, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+    const auto num = queue.size();
+    if (output_indices) {
+        output_indices->resize(num);
+    }
+    if (output_distances) {
+        output_distances->resize(num);
+    }
+
+    auto position = num;
+    while (!queue.empty()) {
+        const auto& top = queue.top();
+        --position;
+        if (output_indices) {
+            (*output_indices)[position] = top.second;
+        }
+        if (output_distances) {
+            (*output_distances)[position] = top.first;
+        }
+        queue.pop();
+    }
+}
+
+// Same as report_queue(), but for a search of the 'self' observation with
+// 'k + 1' neighbors, where 'self' is discarded from the results.
+template<typename Index_, typename Distance_, typename HnswData_>
+void report_queue_without_self(std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> >& queue, hnswlib::labeltype self, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+    const auto num = queue.size();
+    if (output_indices) {
+        output_indices->clear();
+        output_indices->reserve(num);
+    }
+    if (output_distances) {
+        output_distances->clear();
+        output_distances->reserve(num);
+    }
+
+    bool self_found = false;
+    while (!queue.empty()) {
+        const auto& top = queue.top();
+        if (!self_found && top.second == self) {
+            self_found = true;
+        } else {
+            if (output_indices) {
+                output_indices->push_back(top.second);
+            }
+            if (output_distances) {
+                output_distances->push_back(top.first);
+            }
+        }
+        queue.pop();
+    }
+
+    if (output_indices) {
+        std::reverse(output_indices->begin(), output_indices->end());
+    }
+    if (output_distances) {
+        std::reverse(output_distances->begin(), output_distances->end());
+    }
+
+    // Just in case we're full of ties at duplicate points, such that 'self'
+    // is not in the set.  Note that, if self_found=false, we must have at
+    // least 'K+2' points for 'self' to not be detected as its own neighbor.
+    // Thus there is no need to worry whether we are popping off a non-'self'
+    // element and then returning fewer elements than expected. The results
+    // may still be empty if all other observations were deleted.
+    if (!self_found) {
+        if (output_indices && !output_indices->empty()) {
+            output_indices->pop_back();
+        }
+        if (output_distances && !output_distances->empty()) {
+            output_distances->pop_back();
+        }
+    }
+}
+
 template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
 class HnswPrebuilt;
 
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class MultiMetricHnswPrebuilt;
+
 template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
 class HnswSearcher final : public knncolle::Searcher<Index_, Data_, Distance_> {
 private:
@@ -76,128 +378,128 @@ private:
     static constexpr bool same_internal_data = std::is_same<Data_, HnswData_>::value;
     std::vector<HnswData_> my_buffer;
 
+    // Each searcher owns its visited set, to avoid contention for the index's shared pool.
+    EpochVisitedSet my_epoch_visited;
+    HashVisitedSet my_hash_visited;
+    CandidateQueue<HnswData_> my_top_candidates, my_candidate_set;
+
 public:
     HnswSearcher(const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& parent) : my_parent(parent) {
         if constexpr(!same_internal_data) {
             sanisizer::resize(my_buffer, my_parent.my_dim);
         }
+
+        const auto& index = my_parent.my_index;
+        const auto visits = expected_visits(index.maxM0_, index.ef_);
+        if (use_hash_visited_set(my_parent.my_visited_set, visits, index.cur_element_count)) {
+            my_hash_visited.reset(visits);
+        } else {
+            my_epoch_visited.reset(index.cur_element_count);
+        }
     }
 
 private:
-    void normalize_distances(std::vector<Distance_>& output_distances) const {
-        switch(my_parent.my_normalize_method) {
-            case DistanceNormalizeMethod::SQRT:
-                for (auto& d : output_distances) {
-                    d = std::sqrt(d);
-                }
-                break;
-            case DistanceNormalizeMethod::CUSTOM:
-                for (auto& d : output_distances) {
-                    d = my_parent.my_custom_normalize(d);
-                }
-                break;
-            case DistanceNormalizeMethod::NONE:
-                break;
+    void search_knn(const HnswData_* query, std::size_t k) {
+        const auto& index = my_parent.my_index;
+        const auto visits = expected_visits(index.maxM0_, std::max(index.ef_, k));
+        if (use_hash_visited_set(my_parent.my_visited_set, visits, index.cur_element_count)) {
+            my_hash_visited.reset(visits);
+            search_knn_with_visited(HnswlibGraphView<HnswData_>(index), my_parent.my_entry_points, query, k, my_hash_visited, my_top_candidates, my_candidate_set, my_queue);
+        } else {
+            my_epoch_visited.reset(index.cur_element_count);
+            search_knn_with_visited(HnswlibGraphView<HnswData_>(index), my_parent.my_entry_points, query, k, my_epoch_visited, my_top_candidates, my_candidate_set, my_queue);
         }
     }
 
-public:
-    void search(Index_ i, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
-        my_buffer = my_parent.my_index.template getDataByLabel<HnswData_>(i);
-        Index_ kp1 = k + 1;
-        my_queue = my_parent.my_index.searchKnn(my_buffer.data(), kp1); // +1, as it forgets to discard 'self'.
+    // Only used to fill the result cache, when the caller doesn't want all outputs.
+    std::vector<Index_> my_cached_indices;
+    std::vector<Distance_> my_cached_distances;
 
-        if (output_indices) {
-            output_indices->clear();
-            output_indices->reserve(kp1);
-        }
-        if (output_distances) {
-            output_distances->clear();
-            output_distances->reserve(kp1);
-        }
+#ifdef KNNCOLLE_HNSW_INSTRUMENTATION
+    HnswSearchLatencies my_latencies;
 
-        bool self_found = false;
-        hnswlib::labeltype icopy = i;
-        while (!my_queue.empty()) {
-            const auto& top = my_queue.top();
-            if (!self_found && top.second == icopy) {
-                self_found = true;
-            } else {
-                if (output_indices) {
-                    output_indices->push_back(top.second);
-                }
-                if (output_distances) {
-                    output_distances->push_back(top.first);
-                }
-            }
-            my_queue.pop();
-        }
+public:
+    ~HnswSearcher() {
+        my_parent.my_latency_collector->merge(my_latencies);
+    }
 
-        if (output_indices) {
-            std::reverse(output_indices->begin(), output_indices->end());
+    const HnswSearchLatencies& latencies() const {
+        return my_latencies;
+    }
+#endif
+
+public:
+    void search(Index_ i, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+#ifdef KNNCOLLE_HNSW_INSTRUMENTATION
+        SearchProbe probe(my_latencies, k, my_parent.my_index.ef_);
+#endif
+        auto cache = my_parent.my_result_cache.get();
+        if (cache == NULL) {
+            search_uncached(i, k, output_indices, output_distances);
+            return;
         }
-        if (output_distances) {
-            std::reverse(output_distances->begin(), output_distances->end());
+        if (cache->lookup(i, k, output_indices, output_distances)) {
+            return;
         }
 
-        // Just in case we're full of ties at duplicate points, such that 'c'
-        // is not in the set.  Note that, if self_found=false, we must have at
-        // least 'K+2' points for 'c' to not be detected as its own neighbor.
-        // Thus there is no need to worry whether we are popping off a non-'c'
-        // element and then returning fewer elements than expected.
-        if (!self_found) {
-            if (output_indices) {
-                output_indices->pop_back();
-            }
-            if (output_distances) {
-                output_distances->pop_back();
-            }
-        }
+        auto cur_indices = (output_indices ? output_indices : &my_cached_indices);
+        auto cur_distances = (output_distances ? output_distances : &my_cached_distances);
+        search_uncached(i, k, cur_indices, cur_distances);
+        cache->store(i, k, *cur_indices, *cur_distances);
+    }
 
+public:
+    // Bypasses the result cache and the latency instrumentation, for internal
+    // searches (e.g., diagnostics) that should not affect either of them.
+    void search_uncached(Index_ i, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        my_buffer = my_parent.my_index.template getDataByLabel<HnswData_>(i);
+        search_knn(my_buffer.data(), static_cast<std::size_t>(k) + 1); // +1, as it forgets to discard 'self'.
+        report_queue_without_self(my_queue, i, output_indices, output_distances);
         if (output_distances) {
-            normalize_distances(*output_distances);
+            my_parent.normalize_distances(*output_distances);
         }
     }
 
-private:
-    void search_raw(const HnswData_* query, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+public:
+    // Searches with a query that has already been converted to HnswData_,
+    // e.g., as part of a batch of queries. If 'normalize = false', the
+    // distances are reported as computed by the index, so that the caller
+    // can normalize a batch of results at once with normalize_distances().
+    void search_converted(const HnswData_* query, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances, bool normalize = true) {
+#ifdef KNNCOLLE_HNSW_INSTRUMENTATION
+        SearchProbe probe(my_latencies, k, my_parent.my_index.ef_);
+#endif
         k = std::min(k, my_parent.my_obs);
-        my_queue = my_parent.my_index.searchKnn(query, k); 
-
-        if (output_indices) {
-            output_indices->resize(k);
-        }
-        if (output_distances) {
-            output_distances->resize(k);
-        }
+        search_knn(query, k);
+        my_parent.report_results(my_queue, output_indices, output_distances, normalize);
+    }
 
-        auto position = k;
-        while (!my_queue.empty()) {
-            const auto& top = my_queue.top();
-            --position;
-            if (output_indices) {
-                (*output_indices)[position] = top.second;
-            }
-            if (output_distances) {
-                (*output_distances)[position] = top.first;
+public:
+    template<typename DimIndex_, typename Value_>
+    void search_sparse(std::size_t num_nonzero, const DimIndex_* indices, const Value_* values, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        sanisizer::resize(my_buffer, my_parent.my_dim);
+        std::fill(my_buffer.begin(), my_buffer.end(), 0);
+        for (std::size_t n = 0; n < num_nonzero; ++n) {
+            // Same check as in the SparseMatrix constructor.
+            if (static_cast<std::size_t>(indices[n]) >= my_parent.my_dim) {
+                throw std::runtime_error("dimension indices should be less than the number of dimensions");
             }
-            my_queue.pop();
-        }
-
-        if (output_distances) {
-            normalize_distances(*output_distances);
+            my_buffer[indices[n]] = values[n];
         }
+        search_converted(my_buffer.data(), k, output_indices, output_distances);
     }
 
 public:
     void search(const Data_* query, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        // Only converting here, so that the index is searched exactly once for either type.
+        const HnswData_* converted;
         if constexpr(same_internal_data) {
-            my_queue = my_parent.my_index.searchKnn(query, k);
-            search_raw(query, k, output_indices, output_distances);
+            converted = query;
         } else {
-            std::copy_n(query, my_parent.my_dim, my_buffer.begin());
-            search_raw(my_buffer.data(), k, output_indices, output_distances);
+            convert_block(query, my_parent.my_dim, my_buffer.data());
+            converted = my_buffer.data();
         }
+        search_converted(converted, k, output_indices, output_distances);
     }
 };
 
@@ -205,30 +507,181 @@ template<typename Index_, typename Data_, typename Distance_, typename HnswData_
 class HnswPrebuilt final : public knncolle::Prebuilt<Index_, Data_, Distance_> {
 public:
     template<class Matrix_>
-    HnswPrebuilt(const Matrix_& data, const DistanceConfig<Distance_, HnswData_>& distance_config, const HnswOptions& options) :
+    HnswPrebuilt(
+        const Matrix_& data,
+        const DistanceConfig<Distance_, HnswData_>& distance_config,
+        const HnswOptions& options,
+        const knncolle::NeighborList<Index_, Distance_>* neighbors = NULL
+    ) :
         my_dim(data.num_dimensions()),
         my_obs(data.num_observations()),
         my_space(distance_config.create(my_dim)),
         my_normalize_method(distance_config.normalize_method),
-        my_custom_normalize(distance_config.custom_normalize),
-        my_index(my_space.get(), my_obs, options.num_links, options.ef_construction)
+        my_custom_normalize([&]() -> std::function<Distance_(Distance_)> {
+            if (distance_config.custom_normalize || !distance_config.custom_normalize_block) {
+                return distance_config.custom_normalize;
+            }
+            // Synthesizing a scalar function for use in save() and friends.
+            return [block = distance_config.custom_normalize_block](Distance_ x) -> Distance_ {
+                block(1, &x);
+                return x;
+            };
+        }()),
+        my_custom_normalize_block(distance_config.custom_normalize_block),
+        my_alpha(options.alpha),
+        my_index(my_space.get(), my_obs, options.num_links, options.ef_construction, options.seed),
+        my_storage(my_index)
     {
+        Level0Placement placement;
+        placement.huge_pages = options.huge_pages;
+        placement.numa_interleave = options.numa_interleave;
+        place_level0(my_storage, placement);
+
+        BuildMonitor monitor(options.progress, options.progress_interval, options.cancel, my_build_timings);
         auto work = data.new_known_extractor();
-        if constexpr(std::is_same<Data_, HnswData_>::value) {
-            for (Index_ i = 0; i < my_obs; ++i) {
-                auto ptr = work->next();
-                my_index.addPoint(ptr, i);
+
+        // Matrices with random access (e.g., SparseMatrix) are densified in parallel directly into the index.
+        constexpr bool random_access = has_densify<Matrix_, HnswData_>::value;
+        auto allocate = [&]() -> std::vector<int> {
+            monitor.begin(BuildPhase::CONVERSION, my_obs);
+            if constexpr(random_access) {
+                return allocate_nodes_in_place(
+                    my_storage,
+                    my_obs,
+                    [&](Index_ i, HnswData_* ptr) -> void {
+                        data.densify(i, ptr);
+                    },
+                    options.num_threads
+                );
+            } else {
+                return allocate_nodes(
+                    my_storage,
+                    my_obs,
+                    my_dim,
+                    [&, converted = static_cast<std::size_t>(0)](HnswData_* buffer) mutable -> void {
+                        convert_block(work->next(), my_dim, buffer);
+                        monitor.update(++converted);
+                    }
+                );
             }
+        };
+
+        if (neighbors) {
+            insert_from_neighbors(
+                my_index,
+                my_obs,
+                [&]() -> std::vector<int> {
+                    auto levels = allocate();
+                    monitor.begin(BuildPhase::LINKING, 1);
+                    return levels;
+                },
+                *neighbors,
+                options.alpha,
+                options.num_threads
+            );
+        } else if (options.nn_descent_iterations > 0) {
+            auto levels = allocate();
+            monitor.begin(BuildPhase::NN_DESCENT, options.nn_descent_iterations);
+            const auto descended = nn_descent(
+                my_index,
+                my_obs,
+                sanisizer::product<int>(options.num_links, 2),
+                options.nn_descent_iterations,
+                options.nn_descent_delta,
+                options.nn_descent_rho,
+                options.seed,
+                options.num_threads,
+                [&](int iterations) -> void {
+                    monitor.update(iterations);
+                }
+            );
+            monitor.begin(BuildPhase::LINKING, 1);
+            connect_from_neighbors(my_index, levels, descended, options.alpha, options.num_threads);
         } else {
-            auto incoming = sanisizer::create<std::vector<HnswData_> >(my_dim);
-            for (Index_ i = 0; i < my_obs; ++i) {
-                auto ptr = work->next(); 
-                std::copy_n(ptr, my_dim, incoming.begin());
-                my_index.addPoint(incoming.data(), i);
+            // Computing the insertion order requires all observations to be in memory.
+            std::vector<HnswData_> all_data;
+            std::vector<Index_> order;
+            if (options.insertion_order != InsertionOrder::INPUT) {
+                monitor.begin(BuildPhase::CONVERSION, my_obs);
+                all_data.resize(sanisizer::product<typename std::vector<HnswData_>::size_type>(my_dim, my_obs));
+                if constexpr(random_access) {
+                    knncolle::parallelize(options.num_threads, my_obs, [&](int, Index_ start, Index_ length) -> void {
+                        for (Index_ i = start, end = start + length; i < end; ++i) {
+                            data.densify(i, all_data.data() + sanisizer::product_unsafe<std::size_t>(i, my_dim));
+                        }
+                    });
+                } else {
+                    for (Index_ i = 0; i < my_obs; ++i) {
+                        convert_block(work->next(), my_dim, all_data.data() + sanisizer::product_unsafe<std::size_t>(i, my_dim));
+                        monitor.update(static_cast<std::size_t>(i) + 1);
+                    }
+                }
+                order = order_by_projected_curve(all_data.data(), my_obs, my_dim, options.seed, options.num_threads);
             }
+
+            Index_ position = 0;
+            auto next = [&](HnswData_* buffer) -> hnswlib::labeltype {
+                Index_ label = position;
+                if (order.empty()) {
+                    convert_block(work->next(), my_dim, buffer);
+                } else {
+                    label = order[position];
+                    std::copy_n(all_data.begin() + sanisizer::product_unsafe<std::size_t>(label, my_dim), my_dim, buffer);
+                }
+                ++position;
+                return label;
+            };
+
+            monitor.begin(BuildPhase::INSERTION, my_obs);
+            if (options.wave_size > 0) {
+                insert_in_waves(
+                    my_storage,
+                    my_obs,
+                    my_dim,
+                    next,
+                    options.wave_size,
+                    options.num_threads,
+                    [&](Index_ inserted) -> void {
+                        monitor.update(inserted);
+                    }
+                );
+            } else if (!order.empty()) {
+                for (Index_ i = 0; i < my_obs; ++i) {
+                    const auto label = order[i];
+                    my_index.addPoint(all_data.data() + sanisizer::product_unsafe<std::size_t>(label, my_dim), label);
+                    monitor.update(static_cast<std::size_t>(i) + 1);
+                }
+            } else if constexpr(std::is_same<Data_, HnswData_>::value) {
+                for (Index_ i = 0; i < my_obs; ++i) {
+                    auto ptr = work->next();
+                    my_index.addPoint(ptr, i);
+                    monitor.update(static_cast<std::size_t>(i) + 1);
+                }
+            } else {
+                auto incoming = sanisizer::create<std::vector<HnswData_> >(my_dim);
+                for (Index_ i = 0; i < my_obs; ++i) {
+                    next(incoming.data());
+                    my_index.addPoint(incoming.data(), i);
+                    monitor.update(static_cast<std::size_t>(i) + 1);
+                }
+            }
+        }
+
+        if (options.refine) {
+            monitor.begin(BuildPhase::REFINEMENT, 1);
+            refine_base_layer(my_index, my_obs, options.alpha, options.num_threads);
+        }
+
+        if (options.num_entry_points) {
+            monitor.begin(BuildPhase::ENTRY_POINTS, 1);
+            my_entry_points = choose_entry_points(my_index, my_dim, options.num_entry_points, options.entry_point_iterations, options.num_threads);
         }
 
+        monitor.begin(BuildPhase::FINALIZATION, 1);
+        compact_link_lists(my_storage);
         my_index.setEf(options.ef_search);
+        my_visited_set = options.visited_set;
+        monitor.finish();
         return;
     }
 
@@ -242,10 +695,41 @@ private:
 
     DistanceNormalizeMethod my_normalize_method;
     std::function<Distance_(Distance_)> my_custom_normalize;
+    std::function<void(std::size_t, Distance_*)> my_custom_normalize_block;
+    double my_alpha;
 
     hnswlib::HierarchicalNSW<HnswData_> my_index;
+    IndexStorage<HnswData_> my_storage;
+
+    std::unique_ptr<ResultCache<Index_, Distance_> > my_result_cache;
+    std::vector<hnswlib::tableint> my_entry_points;
+    VisitedSetType my_visited_set = VisitedSetType::AUTO;
+    HnswBuildTimings my_build_timings;
+#ifdef KNNCOLLE_HNSW_INSTRUMENTATION
+    std::shared_ptr<LatencyCollector> my_latency_collector = std::make_shared<LatencyCollector>();
+#endif
 
     friend class HnswSearcher<Index_, Data_, Distance_, HnswData_>;
+    friend class MultiMetricHnswPrebuilt<Index_, Data_, Distance_, HnswData_>;
+
+    // Same as report_queue(), followed by normalization of the distances.
+    void report_results(std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> >& queue, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances, bool normalize = true) const {
+        report_queue(queue, output_indices, output_distances);
+        if (output_distances && normalize) {
+            normalize_distances(*output_distances);
+        }
+    }
+
+public:
+    // Normalizes a block of distances in place, e.g., the concatenated
+    // results of a batch of queries that were searched without normalization.
+    void normalize_distances(std::size_t num, Distance_* distances) const {
+        normalize_distance_block(my_normalize_method, my_custom_normalize, my_custom_normalize_block, num, distances);
+    }
+
+    void normalize_distances(std::vector<Distance_>& output_distances) const {
+        normalize_distances(output_distances.size(), output_distances.data());
+    }
 
 public:
     std::size_t num_dimensions() const {
@@ -256,6 +740,275 @@ public:
         return my_obs;
     }
 
+    double alpha() const {
+        return my_alpha;
+    }
+
+    void fetch_observation(Index_ i, Data_* buffer) const {
+        auto raw = my_index.template getDataByLabel<HnswData_>(i);
+        std::copy(raw.begin(), raw.end(), buffer);
+    }
+
+    // Same as fetch_observation(), but without converting back to Data_.
+    void fetch_converted_observation(Index_ i, HnswData_* buffer) const {
+        // Same behavior as hnswlib::HierarchicalNSW::getDataByLabel() for deleted observations.
+        auto found = my_index.label_lookup_.find(i);
+        if (found == my_index.label_lookup_.end() || my_index.isMarkedDeleted(found->second)) {
+            throw std::runtime_error("Label not found");
+        }
+        auto ptr = reinterpret_cast<const HnswData_*>(my_index.getDataByInternalId(found->second));
+        std::copy_n(ptr, my_dim, buffer);
+    }
+
+    // Greedy descent through the upper layers, returning the internal ID of
+    // the node at which the search of the base layer would start.
+    hnswlib::tableint descend_upper_layers(const HnswData_* query) const {
+        auto current = my_index.enterpoint_node_;
+        if (my_index.cur_element_count == 0) {
+            return current;
+        }
+        if (!my_entry_points.empty()) {
+            return closest_entry_point(my_index, my_entry_points, query).first;
+        }
+
+        auto curdist = my_index.fstdistfunc_(query, my_index.getDataByInternalId(current), my_index.dist_func_param_);
+        for (int level = my_index.maxlevel_; level > 0; --level) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                auto links = my_index.get_linklist(current, level);
+                auto size = my_index.getListCount(links);
+                auto candidates = reinterpret_cast<const hnswlib::tableint*>(links + 1);
+                for (I<decltype(size)> c = 0; c < size; ++c) {
+                    auto dist = my_index.fstdistfunc_(query, my_index.getDataByInternalId(candidates[c]), my_index.dist_func_param_);
+                    if (dist < curdist) {
+                        curdist = dist;
+                        current = candidates[c];
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        return current;
+    }
+
+public:
+    // Searches for the nearest neighbors of multiple queries on a single
+    // thread, keeping up to 'group_size' queries in flight to hide memory
+    // latency. 'get_query(q)' should return a pointer to the 'q'-th query,
+    // and 'report(q, indices, distances)' is called with its results, which
+    // are the same as those from HnswSearcher::search().
+    template<class GetQuery_, class Report_>
+    void search_interleaved(std::size_t num_queries, GetQuery_ get_query, Index_ k, std::size_t group_size, Report_ report) const {
+        search_interleaved_internal(
+            num_queries,
+            [&](std::size_t q, HnswData_* buffer) -> void {
+                convert_block(get_query(q), my_dim, buffer);
+            },
+            k,
+            group_size,
+            report,
+            true
+        );
+    }
+
+    // Same as search_interleaved(), but 'get_query(q)' should return a
+    // pointer to a query that has already been converted to HnswData_.
+    // If 'normalize = false', the reported distances are not normalized,
+    // see HnswSearcher::search_converted().
+    template<class GetQuery_, class Report_>
+    void search_interleaved_converted(std::size_t num_queries, GetQuery_ get_query, Index_ k, std::size_t group_size, Report_ report, bool normalize) const {
+        search_interleaved_internal(
+            num_queries,
+            [&](std::size_t q, HnswData_* buffer) -> void {
+                std::copy_n(get_query(q), my_dim, buffer);
+            },
+            k,
+            group_size,
+            report,
+            normalize
+        );
+    }
+
+private:
+    template<class Fill_, class Report_>
+    void search_interleaved_internal(std::size_t num_queries, Fill_ fill, Index_ k, std::size_t group_size, Report_& report, bool normalize) const {
+        k = std::min(k, my_obs);
+        std::vector<Index_> indices;
+        std::vector<Distance_> distances;
+        knncolle_hnsw::search_interleaved(
+            my_index,
+            my_entry_points,
+            my_dim,
+            num_queries,
+            fill,
+            k,
+            group_size,
+            [&](std::size_t q, std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> >& queue) -> void {
+                report_results(queue, &indices, &distances, normalize);
+                report(q, indices, distances);
+            }
+        );
+    }
+
+public:
+    // Not thread-safe, so there should be no concurrent searches.
+    void mark_deleted(Index_ i) {
+        own_level0(my_storage); // as the deletion flag lives in the level 0 block.
+        my_index.markDelete(i);
+        clear_result_cache();
+    }
+
+    Index_ num_deleted() const {
+        return my_index.num_deleted_;
+    }
+
+    bool is_deleted(Index_ i) const {
+        auto found = my_index.label_lookup_.find(i);
+        return found == my_index.label_lookup_.end() || my_index.isMarkedDeleted(found->second);
+    }
+
+    std::size_t num_entry_points() const {
+        return my_entry_points.size();
+    }
+
+    // Only affects searchers that are created after this call.
+    void set_visited_set(VisitedSetType type) {
+        my_visited_set = type;
+    }
+
+    VisitedSetType visited_set() const {
+        return my_visited_set;
+    }
+
+    const HnswBuildTimings& build_timings() const {
+        return my_build_timings;
+    }
+
+#ifdef KNNCOLLE_HNSW_INSTRUMENTATION
+    // Only includes searchers that have already been destroyed.
+    HnswSearchLatencies search_latencies() const {
+        return my_latency_collector->get();
+    }
+
+    void clear_search_latencies() {
+        my_latency_collector->clear();
+    }
+#endif
+
+    std::vector<Index_> compact(int num_threads) {
+        std::vector<hnswlib::labeltype> entry_labels;
+        entry_labels.reserve(my_entry_points.size());
+        for (auto e : my_entry_points) {
+            entry_labels.push_back(my_index.getExternalLabel(e));
+        }
+
+        auto old_labels = compact_deleted(my_storage, my_alpha, num_threads);
+        my_obs = old_labels.size();
+
+        // Entry points are relabelled in the same manner as the observations, and deleted entry points are dropped.
+        // We then look up the internal IDs for the new labels, as these may differ if the nodes were not renumbered,
+        // e.g., for indices built with InsertionOrder::PROJECTED_CURVE and no deletions.
+        my_entry_points.clear();
+        for (auto l : entry_labels) {
+            auto found = std::lower_bound(old_labels.begin(), old_labels.end(), l);
+            if (found != old_labels.end() && *found == l) {
+                const hnswlib::labeltype new_label = found - old_labels.begin();
+                my_entry_points.push_back(my_index.label_lookup_.find(new_label)->second);
+            }
+        }
+        clear_result_cache(); // as the observations were renumbered.
+        return std::vector<Index_>(old_labels.begin(), old_labels.end());
+    }
+
+public:
+    // Not thread-safe, so there should be no concurrent searches.
+    void set_result_cache(std::size_t max_bytes) {
+        if (max_bytes) {
+            my_result_cache.reset(new ResultCache<Index_, Distance_>(max_bytes));
+        } else {
+            my_result_cache.reset();
+        }
+    }
+
+    void clear_result_cache() {
+        if (my_result_cache) {
+            my_result_cache->clear();
+        }
+    }
+
+    HnswResultCacheStatistics result_cache_statistics() const {
+        if (my_result_cache) {
+            return my_result_cache->statistics();
+        }
+        return HnswResultCacheStatistics();
+    }
+
+public:
+    HnswDiagnostics diagnose(const HnswDiagnosticsOptions& options) const {
+        HnswDiagnostics output;
+        diagnose_graph(my_index, output);
+        const auto visits = expected_visits(my_index.maxM0_, my_index.ef_);
+        if (use_hash_visited_set(my_visited_set, visits, my_index.cur_element_count)) {
+            output.memory.visited_per_searcher = HashVisitedSet::expected_capacity(visits) * (sizeof(hnswlib::tableint) + sizeof(hnswlib::vl_type));
+        } else {
+            output.memory.visited_per_searcher = output.memory.visited_list;
+        }
+        if (options.num_recall_samples == 0) {
+            return output;
+        }
+        if (options.num_neighbors <= 0) {
+            throw std::runtime_error("'num_neighbors' should be positive when computing the recall");
+        }
+        // Deleted observations are never reported by a search, so we only
+        // sample live observations and compare against other live ones.
+        std::vector<std::pair<Index_, hnswlib::tableint> > live;
+        live.reserve(my_obs);
+        for (Index_ l = 0; l < my_obs; ++l) {
+            auto lIt = my_index.label_lookup_.find(l);
+            if (lIt != my_index.label_lookup_.end() && !my_index.isMarkedDeleted(lIt->second)) {
+                live.emplace_back(l, lIt->second);
+            }
+        }
+        const std::size_t num_live = live.size();
+        if (num_live < 2) {
+            return output;
+        }
+
+        const std::size_t num_samples = std::min(options.num_recall_samples, num_live);
+        const int k = static_cast<int>(std::min(static_cast<std::size_t>(options.num_neighbors), num_live - 1)); // fits as num_neighbors is an int.
+        auto found = sanisizer::create<std::vector<std::size_t> >(num_samples);
+
+        knncolle::parallelize(options.num_threads, num_samples, [&](int, std::size_t start, std::size_t length) -> void {
+            auto searcher = initialize_known();
+            std::vector<Index_> indices;
+            std::vector<HnswData_> truth(num_live);
+            for (std::size_t s = start, end = start + length; s < end; ++s) {
+                const std::size_t sampled = sanisizer::product_unsafe<std::size_t>(s, num_live) / num_samples;
+                const Index_ i = live[sampled].first;
+                const auto query = my_index.getDataByInternalId(live[sampled].second);
+                auto raw_distance = [&](hnswlib::tableint j) -> HnswData_ {
+                    return my_index.fstdistfunc_(query, my_index.getDataByInternalId(j), my_index.dist_func_param_);
+                };
+
+                for (std::size_t j = 0; j < num_live; ++j) {
+                    truth[j] = (j == sampled ? std::numeric_limits<HnswData_>::infinity() : raw_distance(live[j].second));
+                }
+                std::nth_element(truth.begin(), truth.begin() + (k - 1), truth.end());
+                const auto threshold = truth[k - 1];
+
+                searcher->search_uncached(i, k, &indices, NULL);
+                for (auto j : indices) {
+                    found[s] += (raw_distance(my_index.label_lookup_.find(j)->second) <= threshold);
+                }
+            }
+        });
+
+        output.recall = static_cast<double>(std::accumulate(found.begin(), found.end(), static_cast<std::size_t>(0))) / (static_cast<double>(num_samples) * k);
+        return output;
+    }
+
 public:
     std::unique_ptr<knncolle::Searcher<Index_, Data_, Distance_> > initialize() const {
         return initialize_known();
@@ -277,6 +1030,10 @@ public:
         const char* distname = get_distance_name(my_space.get());;
         knncolle::quick_save(dir / "DISTANCE", distname, std::strlen(distname));
         knncolle::quick_save(dir / "NORMALIZE", &my_normalize_method, 1);
+        knncolle::quick_save(dir / "ALPHA", &my_alpha, 1);
+        if (!my_entry_points.empty()) {
+            knncolle::quick_save(dir / "ENTRY_POINTS", my_entry_points.data(), my_entry_points.size());
+        }
 
         // Custom normalization functions.
         auto& datafunc = custom_save_for_hnsw_data<HnswData_>();
@@ -299,7 +1056,8 @@ public:
         index_ptr->saveIndex((dir / "INDEX").string());
     }
 
-    HnswPrebuilt(const std::filesystem::path& dir) : 
+public:
+    HnswPrebuilt(const std::filesystem::path& dir, const HnswLoadOptions& options = {}, HnswLoadStatistics* statistics = NULL) : 
         my_dim([&]() {
             std::size_t dim;
             knncolle::quick_load(dir / "NUM_DIM", &dim, 1);
@@ -314,16 +1072,9 @@ public:
 
         my_space([&]() {
             std::string method = knncolle::quick_load_as_string(dir / "DISTANCE");
-
-            if constexpr(std::is_same<HnswData_, float>::value) {
-                if (method == "l2") {
-                    return static_cast<hnswlib::SpaceInterface<HnswData_>*>(new hnswlib::L2Space(my_dim));
-                }
-            }
-            if (method == "squared_euclidean") {
-                return static_cast<hnswlib::SpaceInterface<HnswData_>*>(new SquaredEuclideanDistance<HnswData_>(my_dim));
-            } else if (method == "manhattan") {
-                return static_cast<hnswlib::SpaceInterface<HnswData_>*>(new ManhattanDistance<HnswData_>(my_dim));
+            auto known = create_known_distance<HnswData_>(method, my_dim);
+            if (known) {
+                return known;
             }
 
             auto& loadfun = custom_load_for_hnsw_distance<HnswData_>();
@@ -339,9 +1090,32 @@ public:
             return norm;
         }()),
 
-        my_index(my_space.get(), (dir / "INDEX").string())
+        my_alpha([&]() {
+            // Indices saved before alpha was introduced were pruned with hnswlib's usual heuristic.
+            double alpha = 1;
+            if (std::filesystem::exists(dir / "ALPHA")) {
+                knncolle::quick_load(dir / "ALPHA", &alpha, 1);
+            }
+            return alpha;
+        }()),
 
+        my_index(my_space.get()),
+        my_storage(my_index)
     {
+        auto start = std::chrono::steady_clock::now();
+        FileReader reader(dir / "INDEX", options.num_threads, options.chunk_size);
+        const auto total = reader.remaining();
+        Level0Placement placement;
+        placement.huge_pages = options.huge_pages;
+        placement.numa_interleave = options.numa_interleave;
+        read_index(my_space.get(), reader, false, my_storage, placement);
+        load_entry_points(dir / "ENTRY_POINTS", my_entry_points);
+        check_entry_points(my_entry_points, my_index.cur_element_count);
+        if (statistics) {
+            statistics->bytes = total;
+            statistics->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
         if (my_normalize_method == DistanceNormalizeMethod::CUSTOM) {
             auto& normfun = custom_load_for_hnsw_normalize<Distance_>();
             if (!normfun) {
@@ -350,6 +1124,123 @@ public:
             my_custom_normalize = normfun(dir);
         }
     }
+
+public:
+    template<class Write_>
+    void serialize(Write_ write) const {
+        const char* distname = get_distance_name(my_space.get());
+        if (std::strcmp(distname, "unknown") == 0) {
+            throw std::runtime_error("cannot serialize an HNSW index with an unknown distance");
+        }
+        if (my_normalize_method == DistanceNormalizeMethod::CUSTOM) {
+            throw std::runtime_error("cannot serialize an HNSW index with a custom normalization");
+        }
+
+        std::size_t position = 0;
+        auto tracked_write = [&](const char* ptr, std::size_t n) -> void {
+            write(ptr, n);
+            position += n;
+        };
+        auto write_pod = [&](const auto& x) -> void {
+            tracked_write(reinterpret_cast<const char*>(&x), sizeof(x));
+        };
+        auto write_string = [&](const char* str) -> void {
+            std::size_t len = std::strlen(str);
+            write_pod(len);
+            tracked_write(str, len);
+        };
+
+        // Same metadata as save(), in the same order.
+        write_string(hnsw_prebuilt_save_name);
+        auto type = knncolle::get_numeric_type<HnswData_>();
+        write_pod(type);
+        write_pod(my_dim);
+        write_pod(my_obs);
+        write_string(distname);
+        write_pod(my_normalize_method);
+        write_pod(my_alpha);
+        const std::size_t num_entries = my_entry_points.size();
+        write_pod(num_entries);
+        tracked_write(reinterpret_cast<const char*>(my_entry_points.data()), sizeof(hnswlib::tableint) * num_entries);
+
+        // Padding so that the level 0 block is aligned relative to the start
+        // of the buffer, allowing it to be adopted in zero-copy mode.
+        constexpr std::size_t align = serialized_level0_alignment;
+        unsigned char padding = (align - (position + 1 + index_header_size) % align) % align;
+        write_pod(padding);
+        constexpr char zeros[align] = {};
+        tracked_write(zeros, padding);
+
+        write_index(my_index, tracked_write);
+    }
+
+    std::size_t serialized_size() const {
+        std::size_t total = 0;
+        serialize([&](const char*, std::size_t n) -> void { total += n; });
+        return total;
+    }
+
+    void serialize(char* buffer) const {
+        serialize([&](const char* ptr, std::size_t n) -> void {
+            std::copy_n(ptr, n, buffer);
+            buffer += n;
+        });
+    }
+
+    HnswPrebuilt(const char* buffer, std::size_t size, bool zero_copy) : HnswPrebuilt(SerializedReader(buffer, size), zero_copy) {}
+
+private:
+    HnswPrebuilt(SerializedReader reader, bool zero_copy) :
+        my_dim([&]() {
+            read_serialized_preamble(reader);
+            std::size_t dim;
+            reader.read(&dim, sizeof(dim));
+            return dim;
+        }()),
+
+        my_obs([&]() {
+            Index_ obs;
+            reader.read(&obs, sizeof(obs));
+            return obs;
+        }()),
+
+        my_space([&]() {
+            std::size_t len;
+            reader.read(&len, sizeof(len));
+            std::string method(reader.borrow(len), len);
+            auto known = create_known_distance<HnswData_>(method, my_dim);
+            if (!known) {
+                throw std::runtime_error("cannot deserialize an HNSW index with an unknown distance");
+            }
+            return known;
+        }()),
+
+        my_normalize_method([&]() {
+            DistanceNormalizeMethod norm;
+            reader.read(&norm, sizeof(norm));
+            return norm;
+        }()),
+
+        my_alpha([&]() {
+            double alpha;
+            reader.read(&alpha, sizeof(alpha));
+            return alpha;
+        }()),
+
+        my_index(my_space.get()),
+        my_storage(my_index)
+    {
+        std::size_t num_entries;
+        reader.read(&num_entries, sizeof(num_entries));
+        sanisizer::resize(my_entry_points, num_entries);
+        reader.read(my_entry_points.data(), sanisizer::product<std::size_t>(sizeof(hnswlib::tableint), num_entries));
+
+        unsigned char padding;
+        reader.read(&padding, sizeof(padding));
+        reader.borrow(padding);
+        read_index(my_space.get(), reader, zero_copy, my_storage);
+        check_entry_points(my_entry_points, my_index.cur_element_count);
+    }
 };
 /**
  * @endcond
@@ -403,8 +1294,8 @@ public:
         if (!my_distance_config.create) {
             throw std::runtime_error("'distance_config.create' was not provided");
         }
-        if (my_distance_config.normalize_method == DistanceNormalizeMethod::CUSTOM && !my_distance_config.custom_normalize) {
-            throw std::runtime_error("'distance_config.custom_normalize' was not provided");
+        if (my_distance_config.normalize_method == DistanceNormalizeMethod::CUSTOM && !my_distance_config.custom_normalize && !my_distance_config.custom_normalize_block) {
+            throw std::runtime_error("neither 'distance_config.custom_normalize' nor 'distance_config.custom_normalize_block' was provided");
         }
     }
 
@@ -453,6 +1344,43 @@ public:
     auto build_known_shared(const Matrix_& data) const {
         return std::shared_ptr<I<decltype(*build_known_raw(data))> >(build_known_raw(data));
     }
+
+public:
+    /**
+     * Build an HNSW index from a precomputed nearest neighbor graph, e.g., from `knncolle::find_nearest_neighbors()` with another algorithm.
+     * The base layer of the index is constructed directly from `neighbors`, after pruning each observation's neighbors with the usual HNSW heuristic and adding reverse links.
+     * Only the upper layers are constructed by insertion, which avoids most of the distance calculations required by `build_known_raw()`.
+     * The quality of the index depends on the accuracy of `neighbors`, and the number of neighbors for each observation should be comparable to `HnswOptions::num_links`.
+     *
+     * @param data Matrix containing the observations to be indexed.
+     * @param neighbors Nearest neighbors for each observation in `data`.
+     * Each inner vector may be in any order and may contain the observation itself, which is ignored.
+     * Distances are ignored and recomputed from `data`.
+     * @return Pointer to the HNSW index.
+     */
+    auto build_known_raw(const Matrix_& data, const knncolle::NeighborList<Index_, Distance_>& neighbors) const {
+        return new HnswPrebuilt<Index_, Data_, Distance_, HnswData_>(data, my_distance_config, my_options, &neighbors);
+    }
+
+    /**
+     * Overload of `build_known_raw()` that returns a `std::unique_ptr`.
+     * @param data Matrix containing the observations to be indexed.
+     * @param neighbors Nearest neighbors for each observation in `data`.
+     * @return Pointer to the HNSW index.
+     */
+    auto build_known_unique(const Matrix_& data, const knncolle::NeighborList<Index_, Distance_>& neighbors) const {
+        return std::unique_ptr<I<decltype(*build_known_raw(data, neighbors))> >(build_known_raw(data, neighbors));
+    }
+
+    /**
+     * Overload of `build_known_raw()` that returns a `std::shared_ptr`.
+     * @param data Matrix containing the observations to be indexed.
+     * @param neighbors Nearest neighbors for each observation in `data`.
+     * @return Pointer to the HNSW index.
+     */
+    auto build_known_shared(const Matrix_& data, const knncolle::NeighborList<Index_, Distance_>& neighbors) const {
+        return std::shared_ptr<I<decltype(*build_known_raw(data, neighbors))> >(build_known_raw(data, neighbors));
+    }
 };
 
 }
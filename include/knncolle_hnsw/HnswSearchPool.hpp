@@ -0,0 +1,373 @@
+#ifndef KNNCOLLE_HNSW_SEARCH_POOL_HPP
+#define KNNCOLLE_HNSW_SEARCH_POOL_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <exception>
+#include <optional>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstddef>
+
+#include "Hnsw.hpp"
+
+/**
+ * @file HnswSearchPool.hpp
+ * @brief Asynchronous searches of an HNSW index with a pool of worker threads.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @brief Options for `HnswSearchPool`.
+ */
+struct HnswSearchPoolOptions {
+    /**
+     * Number of worker threads.
+     * Each worker owns its own `knncolle::Searcher` for the duration of the pool's lifetime.
+     */
+    int num_workers = 1;
+
+    /**
+     * Maximum number of pending requests.
+     * Once this is reached, `HnswSearchPool::submit()` blocks until a request is taken by a worker,
+     * while `HnswSearchPool::try_submit()` refuses the request.
+     * This provides backpressure when requests arrive faster than they can be processed.
+     */
+    std::size_t queue_capacity = 1024;
+
+    /**
+     * Maximum number of requests that a worker takes from the queue at once.
+     * Requests in the same batch are processed consecutively by the same searcher, improving cache reuse.
+     */
+    std::size_t max_batch_size = 32;
+
+    /**
+     * Time that a worker waits for more requests after taking the first request of a batch.
+     * Larger values yield larger batches at the cost of some latency for the first request.
+     * If zero, a worker only takes the requests that are already in the queue.
+     */
+    std::chrono::microseconds batch_window = std::chrono::microseconds(0);
+
+    /**
+     * Number of requests in a batch that a worker keeps in flight at once, see `HnswJoinOptions::num_interleaved`.
+     * Only consecutive requests in the same batch with the same number of neighbors are interleaved.
+     * The results are the same regardless of this setting.
+     */
+    std::size_t num_interleaved = 1;
+};
+
+/**
+ * @brief Result of an asynchronous search.
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Distance_ Floating-point type for the distances.
+ */
+template<typename Index_, typename Distance_>
+struct HnswSearchResult {
+    /**
+     * Indices of the nearest neighbors, sorted by increasing distance.
+     */
+    std::vector<Index_> indices;
+
+    /**
+     * Distances to the nearest neighbors.
+     */
+    std::vector<Distance_> distances;
+};
+
+/**
+ * @brief Pool of worker threads for asynchronous searches of an HNSW index.
+ *
+ * Requests are submitted from any thread and processed by a fixed number of workers, each of which owns a searcher for the index.
+ * This avoids the need to create a thread (or a searcher) per request in an event-driven application.
+ * Requests that arrive within a short window are processed in micro-batches, see `HnswSearchPoolOptions::batch_window`.
+ * On destruction, all pending requests are processed before the workers are joined.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class HnswSearchPool {
+public:
+    /**
+     * Type of the completion callback, see `submit()`.
+     * This is called with the search results, or with a non-null exception pointer if the search failed.
+     */
+    typedef std::function<void(HnswSearchResult<Index_, Distance_>, std::exception_ptr)> Callback;
+
+    /**
+     * @param prebuilt HNSW index, typically created by `HnswBuilder::build_known_unique()`.
+     * This should outlive the pool and should not be modified while the pool exists.
+     * @param options Further options.
+     */
+    HnswSearchPool(const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& prebuilt, const HnswSearchPoolOptions& options) :
+        my_prebuilt(prebuilt),
+        my_options(options)
+    {
+        if (my_options.num_workers < 1) {
+            throw std::runtime_error("number of workers should be positive");
+        }
+        if (my_options.queue_capacity < 1) {
+            throw std::runtime_error("queue capacity should be positive");
+        }
+        my_options.max_batch_size = std::max(my_options.max_batch_size, static_cast<std::size_t>(1));
+
+        my_workers.reserve(my_options.num_workers);
+        try {
+            for (int w = 0; w < my_options.num_workers; ++w) {
+                my_workers.emplace_back([this]() -> void { work(); });
+            }
+        } catch (...) {
+            shutdown();
+            throw;
+        }
+    }
+
+    /**
+     * Overload that uses the default options.
+     * @param prebuilt HNSW index, typically created by `HnswBuilder::build_known_unique()`.
+     */
+    HnswSearchPool(const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& prebuilt) : HnswSearchPool(prebuilt, {}) {}
+
+    /**
+     * Processes all pending requests and joins the workers.
+     */
+    ~HnswSearchPool() {
+        shutdown();
+    }
+
+    /**
+     * @cond
+     */
+    HnswSearchPool(const HnswSearchPool&) = delete;
+    HnswSearchPool& operator=(const HnswSearchPool&) = delete;
+    /**
+     * @endcond
+     */
+
+private:
+    struct Request {
+        std::vector<Data_> query;
+        Index_ k;
+        Callback callback;
+    };
+
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& my_prebuilt;
+    HnswSearchPoolOptions my_options;
+
+    std::mutex my_lock;
+    std::condition_variable my_not_empty, my_not_full;
+    std::deque<Request> my_queue;
+    bool my_stopping = false;
+    std::vector<std::thread> my_workers;
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lck(my_lock);
+            my_stopping = true;
+        }
+        my_not_empty.notify_all();
+        for (auto& w : my_workers) {
+            w.join();
+        }
+        my_workers.clear();
+    }
+
+    void work() {
+        auto searcher = my_prebuilt.initialize_known();
+        std::vector<Request> batch;
+        batch.reserve(my_options.max_batch_size);
+
+        while (true) {
+            batch.clear();
+            {
+                std::unique_lock<std::mutex> lck(my_lock);
+                my_not_empty.wait(lck, [&]() -> bool { return !my_queue.empty() || my_stopping; });
+                if (my_queue.empty()) {
+                    return; // only possible if we're stopping.
+                }
+
+                if (my_options.batch_window.count() > 0 && my_queue.size() < my_options.max_batch_size && !my_stopping) {
+                    my_not_empty.wait_for(lck, my_options.batch_window, [&]() -> bool {
+                        return my_queue.size() >= my_options.max_batch_size || my_stopping;
+                    });
+                }
+
+                const auto num = std::min(my_queue.size(), my_options.max_batch_size);
+                for (std::size_t b = 0; b < num; ++b) {
+                    batch.push_back(std::move(my_queue.front()));
+                    my_queue.pop_front();
+                }
+            }
+            my_not_full.notify_all();
+
+            if (my_options.num_interleaved > 1) {
+                process_interleaved(batch);
+                continue;
+            }
+
+            for (auto& req : batch) {
+                HnswSearchResult<Index_, Distance_> result;
+                std::exception_ptr error;
+                try {
+                    searcher->search(req.query.data(), req.k, &(result.indices), &(result.distances));
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                req.callback(std::move(result), error);
+            }
+        }
+    }
+
+    void process_interleaved(std::vector<Request>& batch) {
+        const auto num = batch.size();
+        std::size_t run_start = 0;
+        while (run_start < num) {
+            const auto k = batch[run_start].k;
+            auto run_end = run_start + 1;
+            while (run_end < num && batch[run_end].k == k) {
+                ++run_end;
+            }
+
+            // If the search fails, we can't tell which request caused it, so
+            // the error is reported for every request without a result.
+            std::vector<char> reported(run_end - run_start);
+            try {
+                my_prebuilt.search_interleaved(
+                    run_end - run_start,
+                    [&](std::size_t r) -> const Data_* {
+                        return batch[run_start + r].query.data();
+                    },
+                    k,
+                    my_options.num_interleaved,
+                    [&](std::size_t r, const std::vector<Index_>& indices, const std::vector<Distance_>& distances) -> void {
+                        reported[r] = 1;
+                        batch[run_start + r].callback(HnswSearchResult<Index_, Distance_>{ indices, distances }, nullptr);
+                    }
+                );
+            } catch (...) {
+                auto error = std::current_exception();
+                for (auto r = run_start; r < run_end; ++r) {
+                    if (!reported[r - run_start]) {
+                        batch[r].callback(HnswSearchResult<Index_, Distance_>(), error);
+                    }
+                }
+            }
+
+            run_start = run_end;
+        }
+    }
+
+    Request make_request(std::vector<Data_> query, Index_ k, Callback callback) const {
+        if (query.size() != my_prebuilt.num_dimensions()) {
+            throw std::runtime_error("length of the query vector should be equal to the number of dimensions");
+        }
+        return Request{ std::move(query), k, std::move(callback) };
+    }
+
+    static Callback make_promise_callback(std::promise<HnswSearchResult<Index_, Distance_> >& promise) {
+        auto shared = std::make_shared<std::promise<HnswSearchResult<Index_, Distance_> > >(std::move(promise));
+        return [shared](HnswSearchResult<Index_, Distance_> result, std::exception_ptr error) -> void {
+            if (error) {
+                shared->set_exception(error);
+            } else {
+                shared->set_value(std::move(result));
+            }
+        };
+    }
+
+public:
+    /**
+     * Submit a search request, blocking if the queue is full.
+     * The callback is invoked by a worker thread, so it should be cheap, thread-safe and should not throw.
+     *
+     * @param query Query vector of length equal to the number of dimensions.
+     * @param k Number of nearest neighbors to find.
+     * @param callback Function to be called with the results of the search.
+     */
+    void submit(std::vector<Data_> query, Index_ k, Callback callback) {
+        auto req = make_request(std::move(query), k, std::move(callback));
+        {
+            std::unique_lock<std::mutex> lck(my_lock);
+            my_not_full.wait(lck, [&]() -> bool { return my_queue.size() < my_options.queue_capacity; });
+            my_queue.push_back(std::move(req));
+        }
+        my_not_empty.notify_one();
+    }
+
+    /**
+     * Overload of `submit()` that returns a future instead of invoking a callback.
+     *
+     * @param query Query vector of length equal to the number of dimensions.
+     * @param k Number of nearest neighbors to find.
+     *
+     * @return Future containing the results of the search.
+     */
+    std::future<HnswSearchResult<Index_, Distance_> > submit(std::vector<Data_> query, Index_ k) {
+        std::promise<HnswSearchResult<Index_, Distance_> > promise;
+        auto output = promise.get_future();
+        submit(std::move(query), k, make_promise_callback(promise));
+        return output;
+    }
+
+    /**
+     * Submit a search request without blocking.
+     *
+     * @param query Query vector of length equal to the number of dimensions.
+     * @param k Number of nearest neighbors to find.
+     * @param callback Function to be called with the results of the search, see `submit()`.
+     *
+     * @return Whether the request was accepted.
+     * If false, the queue was full and `callback` will not be called.
+     */
+    bool try_submit(std::vector<Data_> query, Index_ k, Callback callback) {
+        auto req = make_request(std::move(query), k, std::move(callback));
+        {
+            std::lock_guard<std::mutex> lck(my_lock);
+            if (my_queue.size() >= my_options.queue_capacity) {
+                return false;
+            }
+            my_queue.push_back(std::move(req));
+        }
+        my_not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Overload of `try_submit()` that returns a future instead of invoking a callback.
+     *
+     * @param query Query vector of length equal to the number of dimensions.
+     * @param k Number of nearest neighbors to find.
+     *
+     * @return Future containing the results of the search, or no value if the queue was full.
+     */
+    std::optional<std::future<HnswSearchResult<Index_, Distance_> > > try_submit(std::vector<Data_> query, Index_ k) {
+        std::promise<HnswSearchResult<Index_, Distance_> > promise;
+        auto output = promise.get_future();
+        if (!try_submit(std::move(query), k, make_promise_callback(promise))) {
+            return std::nullopt;
+        }
+        return output;
+    }
+
+    /**
+     * @return Number of requests that are waiting to be taken by a worker.
+     */
+    std::size_t num_pending() {
+        std::lock_guard<std::mutex> lck(my_lock);
+        return my_queue.size();
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,584 @@
+#ifndef KNNCOLLE_HNSW_MULTI_METRIC_HNSW_HPP
+#define KNNCOLLE_HNSW_MULTI_METRIC_HNSW_HPP
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <string>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+
+#include "knncolle/knncolle.hpp"
+#include "sanisizer/sanisizer.hpp"
+#include "hnswlib/hnswalg.h"
+
+#include "Hnsw.hpp"
+#include "distances.hpp"
+#include "visited_set.hpp"
+#include "entry_points.hpp"
+#include "utils.hpp"
+
+/**
+ * @file MultiMetricHnsw.hpp
+ *
+ * @brief HNSW graphs for multiple distance metrics over a shared set of observations.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * Name of the multi-metric HNSW algorithm when registering a loading function to `knncolle::load_prebuilt_registry()`.
+ */
+inline static constexpr const char* multi_metric_hnsw_prebuilt_save_name = "knncolle_hnsw::MultiMetricHnsw";
+
+/**
+ * @cond
+ */
+// HNSW graph for a single metric, without the observation data. Node IDs are
+// always equal to the observation indices, so that all graphs can share the
+// same block of observation data. Link lists have the same layout as in
+// hnswlib::HierarchicalNSW, i.e., a header with the number of links followed
+// by the links themselves.
+template<typename Distance_, typename HnswData_>
+struct MetricGraph {
+    std::shared_ptr<hnswlib::SpaceInterface<HnswData_> > space;
+    hnswlib::DISTFUNC<HnswData_> distance;
+    void* distance_param;
+    DistanceNormalizeMethod normalize_method;
+    std::function<Distance_(Distance_)> custom_normalize;
+    std::function<void(std::size_t, Distance_*)> custom_normalize_block;
+
+    hnswlib::tableint entry_point = 0;
+    int max_level = -1;
+    std::size_t ef = 10;
+    std::size_t level0_stride = 0, upper_stride = 0; // in units of linklistsizeint.
+    std::vector<hnswlib::linklistsizeint> level0_links;
+    std::vector<int> levels;
+    std::vector<std::size_t> upper_offsets;
+    std::vector<hnswlib::linklistsizeint> upper_links;
+    std::vector<hnswlib::tableint> entry_points;
+
+    void set_space(std::shared_ptr<hnswlib::SpaceInterface<HnswData_> > ptr) {
+        space = std::move(ptr);
+        distance = space->get_dist_func();
+        distance_param = space->get_dist_func_param();
+    }
+
+    void compute_upper_offsets() {
+        upper_offsets.clear();
+        upper_offsets.reserve(levels.size());
+        std::size_t total = 0;
+        for (auto l : levels) {
+            upper_offsets.push_back(total);
+            if (l > 0) {
+                total = sanisizer::sum<std::size_t>(total, sanisizer::product<std::size_t>(l, upper_stride));
+            }
+        }
+        sanisizer::resize(upper_links, total);
+    }
+
+    const hnswlib::linklistsizeint* get_links(hnswlib::tableint i, int level) const {
+        if (level == 0) {
+            return level0_links.data() + sanisizer::product_unsafe<std::size_t>(i, level0_stride);
+        } else {
+            return upper_links.data() + upper_offsets[i] + sanisizer::product_unsafe<std::size_t>(level - 1, upper_stride);
+        }
+    }
+
+    hnswlib::linklistsizeint* get_links(hnswlib::tableint i, int level) {
+        return const_cast<hnswlib::linklistsizeint*>(static_cast<const MetricGraph&>(*this).get_links(i, level));
+    }
+
+    void normalize_distances(std::vector<Distance_>& output_distances) const {
+        normalize_distance_block(normalize_method, custom_normalize, custom_normalize_block, output_distances.size(), output_distances.data());
+    }
+};
+
+// Graph view for search_knn_with_visited(), combining a metric's graph with the shared data.
+template<typename Distance_, typename HnswData_>
+class MetricGraphView {
+public:
+    MetricGraphView(const MetricGraph<Distance_, HnswData_>& graph, const std::vector<HnswData_>& vectors, std::size_t num_dim) :
+        my_graph(graph), my_vectors(vectors), my_dim(num_dim) {}
+
+private:
+    const MetricGraph<Distance_, HnswData_>& my_graph;
+    const std::vector<HnswData_>& my_vectors;
+    std::size_t my_dim;
+
+public:
+    std::size_t size() const {
+        return my_graph.levels.size();
+    }
+
+    hnswlib::tableint entry_point() const {
+        return my_graph.entry_point;
+    }
+
+    int max_level() const {
+        return my_graph.max_level;
+    }
+
+    std::size_t ef() const {
+        return my_graph.ef;
+    }
+
+    bool has_deleted() const {
+        return false;
+    }
+
+    bool is_deleted(hnswlib::tableint) const {
+        return false;
+    }
+
+    const hnswlib::linklistsizeint* links(hnswlib::tableint i, int level) const {
+        return my_graph.get_links(i, level);
+    }
+
+    HnswData_ distance(const HnswData_* query, hnswlib::tableint i) const {
+        return my_graph.distance(query, my_vectors.data() + sanisizer::product_unsafe<std::size_t>(i, my_dim), my_graph.distance_param);
+    }
+
+    hnswlib::labeltype label(hnswlib::tableint i) const {
+        return i;
+    }
+};
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class MultiMetricHnswPrebuilt;
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class MultiMetricHnswSearcher final : public knncolle::Searcher<Index_, Data_, Distance_> {
+private:
+    const MultiMetricHnswPrebuilt<Index_, Data_, Distance_, HnswData_>& my_parent;
+    const MetricGraph<Distance_, HnswData_>& my_graph;
+
+    std::vector<HnswData_> my_buffer;
+    EpochVisitedSet my_epoch_visited;
+    HashVisitedSet my_hash_visited;
+    CandidateQueue<HnswData_> my_top_candidates, my_candidate_set;
+    std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> > my_queue;
+
+public:
+    MultiMetricHnswSearcher(const MultiMetricHnswPrebuilt<Index_, Data_, Distance_, HnswData_>& parent, std::size_t metric) :
+        my_parent(parent), my_graph(my_parent.my_graphs[metric])
+    {
+        sanisizer::resize(my_buffer, my_parent.my_dim);
+
+        const auto num_nodes = my_graph.levels.size();
+        const auto visits = expected_visits(my_graph.level0_stride - 1, my_graph.ef);
+        if (use_hash_visited_set(my_parent.my_visited_set, visits, num_nodes)) {
+            my_hash_visited.reset(visits);
+        } else {
+            my_epoch_visited.reset(num_nodes);
+        }
+    }
+
+private:
+    void search_raw(const HnswData_* query, std::size_t k) {
+        const MetricGraphView<Distance_, HnswData_> view(my_graph, my_parent.my_vectors, my_parent.my_dim);
+        const auto visits = expected_visits(my_graph.level0_stride - 1, std::max(my_graph.ef, k));
+        if (use_hash_visited_set(my_parent.my_visited_set, visits, view.size())) {
+            my_hash_visited.reset(visits);
+            search_knn_with_visited(view, my_graph.entry_points, query, k, my_hash_visited, my_top_candidates, my_candidate_set, my_queue);
+        } else {
+            my_epoch_visited.reset(view.size());
+            search_knn_with_visited(view, my_graph.entry_points, query, k, my_epoch_visited, my_top_candidates, my_candidate_set, my_queue);
+        }
+    }
+
+public:
+    void search(Index_ i, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        if (static_cast<std::size_t>(i) >= static_cast<std::size_t>(my_parent.my_obs)) {
+            throw std::runtime_error("Label not found");
+        }
+        search_raw(my_parent.my_vectors.data() + sanisizer::product_unsafe<std::size_t>(i, my_parent.my_dim), static_cast<std::size_t>(k) + 1); // +1, as we need to discard 'self'.
+
+        report_queue_without_self(my_queue, i, output_indices, output_distances);
+        if (output_distances) {
+            my_graph.normalize_distances(*output_distances);
+        }
+    }
+
+    void search(const Data_* query, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        std::copy_n(query, my_parent.my_dim, my_buffer.begin());
+        search_raw(my_buffer.data(), k);
+
+        report_queue(my_queue, output_indices, output_distances);
+        if (output_distances) {
+            my_graph.normalize_distances(*output_distances);
+        }
+    }
+};
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class MultiMetricHnswPrebuilt final : public knncolle::Prebuilt<Index_, Data_, Distance_> {
+public:
+    template<class Matrix_>
+    MultiMetricHnswPrebuilt(const Matrix_& data, const std::vector<DistanceConfig<Distance_, HnswData_> >& distance_configs, const HnswOptions& options) :
+        my_dim(data.num_dimensions()),
+        my_obs(data.num_observations()),
+        my_visited_set(options.visited_set)
+    {
+        const std::size_t expected_size = sanisizer::product<std::size_t>(my_dim, sizeof(HnswData_));
+        my_graphs.reserve(distance_configs.size());
+
+        // Each index is built and converted into a data-free graph before
+        // building the next, so only one full index exists at any time.
+        for (const auto& config : distance_configs) {
+            HnswPrebuilt<Index_, Data_, Distance_, HnswData_> built(data, config, options);
+            const auto& index = built.my_index;
+            if (index.data_size_ != expected_size) {
+                throw std::runtime_error("all distances should use dense arrays of 'HnswData_' with length equal to the number of dimensions");
+            }
+
+            if (my_graphs.empty()) {
+                sanisizer::resize(my_vectors, sanisizer::product<std::size_t>(my_dim, my_obs));
+                for (hnswlib::tableint i = 0, count = index.cur_element_count; i < count; ++i) {
+                    const auto ptr = reinterpret_cast<const HnswData_*>(index.getDataByInternalId(i));
+                    std::copy_n(ptr, my_dim, my_vectors.begin() + sanisizer::product_unsafe<std::size_t>(index.getExternalLabel(i), my_dim));
+                }
+            }
+
+            auto& graph = my_graphs.emplace_back();
+            graph.set_space(built.my_space); // the index itself is discarded, so we can re-use its space.
+            graph.normalize_method = built.my_normalize_method;
+            graph.custom_normalize = built.my_custom_normalize;
+            graph.custom_normalize_block = built.my_custom_normalize_block;
+            extract_graph(index, built.my_entry_points, graph);
+        }
+    }
+
+private:
+    std::size_t my_dim;
+    Index_ my_obs;
+    VisitedSetType my_visited_set = VisitedSetType::AUTO;
+    std::vector<HnswData_> my_vectors;
+    std::vector<MetricGraph<Distance_, HnswData_> > my_graphs;
+
+    friend class MultiMetricHnswSearcher<Index_, Data_, Distance_, HnswData_>;
+
+    // Copies the links from 'index' into 'graph', renumbering the nodes so
+    // that each node's ID is equal to its label.
+    static void extract_graph(const hnswlib::HierarchicalNSW<HnswData_>& index, const std::vector<hnswlib::tableint>& entry_points, MetricGraph<Distance_, HnswData_>& graph) {
+        const hnswlib::tableint count = index.cur_element_count;
+        std::vector<hnswlib::tableint> remapping;
+        remapping.reserve(count);
+        for (hnswlib::tableint i = 0; i < count; ++i) {
+            remapping.push_back(index.getExternalLabel(i));
+        }
+
+        graph.ef = index.ef_;
+        graph.max_level = index.maxlevel_;
+        graph.entry_point = (count ? remapping[index.enterpoint_node_] : 0);
+        graph.level0_stride = sanisizer::sum<std::size_t>(index.maxM0_, 1);
+        graph.upper_stride = sanisizer::sum<std::size_t>(index.maxM_, 1);
+        for (auto e : entry_points) {
+            graph.entry_points.push_back(remapping[e]);
+        }
+
+        sanisizer::resize(graph.levels, count);
+        for (hnswlib::tableint i = 0; i < count; ++i) {
+            graph.levels[remapping[i]] = index.element_levels_[i];
+        }
+        graph.compute_upper_offsets();
+        sanisizer::resize(graph.level0_links, sanisizer::product<std::size_t>(count, graph.level0_stride));
+
+        auto copy_links = [&](const hnswlib::linklistsizeint* source, hnswlib::linklistsizeint* destination) -> void {
+            const std::size_t size = *reinterpret_cast<const unsigned short*>(source);
+            *destination = size; // dropping any flags, which are only used for deletions.
+            auto src = reinterpret_cast<const hnswlib::tableint*>(source + 1);
+            auto dest = reinterpret_cast<hnswlib::tableint*>(destination + 1);
+            for (std::size_t n = 0; n < size; ++n) {
+                dest[n] = remapping[src[n]];
+            }
+        };
+
+        for (hnswlib::tableint i = 0; i < count; ++i) {
+            const auto id = remapping[i];
+            copy_links(index.get_linklist0(i), graph.get_links(id, 0));
+            for (int level = 1; level <= index.element_levels_[i]; ++level) {
+                copy_links(index.get_linklist(i, level), graph.get_links(id, level));
+            }
+        }
+    }
+
+    static std::filesystem::path metric_directory(const std::filesystem::path& dir, std::size_t m) {
+        return dir / ("metric" + std::to_string(m));
+    }
+
+public:
+    std::size_t num_dimensions() const {
+        return my_dim;
+    }
+
+    Index_ num_observations() const {
+        return my_obs;
+    }
+
+    std::size_t num_metrics() const {
+        return my_graphs.size();
+    }
+
+    void fetch_observation(Index_ i, Data_* buffer) const {
+        auto ptr = my_vectors.begin() + sanisizer::product_unsafe<std::size_t>(i, my_dim);
+        std::copy(ptr, ptr + my_dim, buffer);
+    }
+
+public:
+    std::unique_ptr<knncolle::Searcher<Index_, Data_, Distance_> > initialize() const {
+        return initialize_known(0);
+    }
+
+    std::unique_ptr<knncolle::Searcher<Index_, Data_, Distance_> > initialize(std::size_t metric) const {
+        return initialize_known(metric);
+    }
+
+    auto initialize_known(std::size_t metric = 0) const {
+        if (metric >= my_graphs.size()) {
+            throw std::out_of_range("'metric' should be less than the number of metrics");
+        }
+        return std::make_unique<MultiMetricHnswSearcher<Index_, Data_, Distance_, HnswData_> >(*this, metric);
+    }
+
+public:
+    void save(const std::filesystem::path& dir) const {
+        knncolle::quick_save(dir / "ALGORITHM", multi_metric_hnsw_prebuilt_save_name, std::strlen(multi_metric_hnsw_prebuilt_save_name));
+        knncolle::quick_save(dir / "NUM_OBS", &my_obs, 1);
+        knncolle::quick_save(dir / "NUM_DIM", &my_dim, 1);
+
+        auto type = knncolle::get_numeric_type<HnswData_>();
+        knncolle::quick_save(dir / "TYPE", &type, 1);
+
+        // The observation data is only saved once for all metrics.
+        knncolle::quick_save(dir / "VECTORS", my_vectors.data(), my_vectors.size());
+        auto& datafunc = custom_save_for_hnsw_data<HnswData_>();
+        if (datafunc) {
+            datafunc(dir);
+        }
+
+        const std::size_t num_metrics = my_graphs.size();
+        knncolle::quick_save(dir / "NUM_METRICS", &num_metrics, 1);
+        for (std::size_t m = 0; m < num_metrics; ++m) {
+            const auto subdir = metric_directory(dir, m);
+            std::filesystem::create_directory(subdir);
+            const auto& graph = my_graphs[m];
+
+            const char* distname = get_distance_name(graph.space.get());
+            knncolle::quick_save(subdir / "DISTANCE", distname, std::strlen(distname));
+            knncolle::quick_save(subdir / "NORMALIZE", &graph.normalize_method, 1);
+
+            auto& distfunc = custom_save_for_hnsw_distance<HnswData_>();
+            if (std::strcmp(distname, "unknown") == 0 && distfunc) {
+                distfunc(subdir, graph.space.get());
+            }
+            auto& normfunc = custom_save_for_hnsw_normalize<Distance_>();
+            if (graph.normalize_method == DistanceNormalizeMethod::CUSTOM && normfunc) {
+                normfunc(subdir, graph.custom_normalize);
+            }
+
+            const std::size_t header[] = { graph.level0_stride, graph.upper_stride, graph.entry_point, static_cast<std::size_t>(graph.max_level + 1), graph.ef };
+            knncolle::quick_save(subdir / "HEADER", header, 5);
+            knncolle::quick_save(subdir / "LEVELS", graph.levels.data(), graph.levels.size());
+            knncolle::quick_save(subdir / "LEVEL0_LINKS", graph.level0_links.data(), graph.level0_links.size());
+            knncolle::quick_save(subdir / "UPPER_LINKS", graph.upper_links.data(), graph.upper_links.size());
+            if (!graph.entry_points.empty()) {
+                knncolle::quick_save(subdir / "ENTRY_POINTS", graph.entry_points.data(), graph.entry_points.size());
+            }
+        }
+    }
+
+    MultiMetricHnswPrebuilt(const std::filesystem::path& dir) {
+        if (knncolle::quick_load_as_string(dir / "ALGORITHM") != multi_metric_hnsw_prebuilt_save_name) {
+            throw std::runtime_error("directory does not contain a multi-metric HNSW index");
+        }
+        knncolle::quick_load(dir / "NUM_DIM", &my_dim, 1);
+        knncolle::quick_load(dir / "NUM_OBS", &my_obs, 1);
+
+        sanisizer::resize(my_vectors, sanisizer::product<std::size_t>(my_dim, my_obs));
+        knncolle::quick_load(dir / "VECTORS", my_vectors.data(), my_vectors.size());
+
+        std::size_t num_metrics;
+        knncolle::quick_load(dir / "NUM_METRICS", &num_metrics, 1);
+        my_graphs.reserve(num_metrics);
+        for (std::size_t m = 0; m < num_metrics; ++m) {
+            const auto subdir = metric_directory(dir, m);
+            auto& graph = my_graphs.emplace_back();
+
+            std::string method = knncolle::quick_load_as_string(subdir / "DISTANCE");
+            auto known = create_known_distance<HnswData_>(method, my_dim);
+            if (known) {
+                graph.set_space(std::shared_ptr<hnswlib::SpaceInterface<HnswData_> >(known));
+            } else {
+                auto& loadfun = custom_load_for_hnsw_distance<HnswData_>();
+                if (!loadfun) {
+                    throw std::runtime_error("no loader provided for an unknown distance");
+                }
+                graph.set_space(std::shared_ptr<hnswlib::SpaceInterface<HnswData_> >(loadfun(subdir, my_dim)));
+            }
+
+            knncolle::quick_load(subdir / "NORMALIZE", &graph.normalize_method, 1);
+            if (graph.normalize_method == DistanceNormalizeMethod::CUSTOM) {
+                auto& normfun = custom_load_for_hnsw_normalize<Distance_>();
+                if (!normfun) {
+                    throw std::runtime_error("no loader provided for an unknown normalization");
+                }
+                graph.custom_normalize = normfun(subdir);
+            }
+
+            std::size_t header[5];
+            knncolle::quick_load(subdir / "HEADER", header, 5);
+            graph.level0_stride = header[0];
+            graph.upper_stride = header[1];
+            graph.entry_point = header[2];
+            graph.max_level = static_cast<int>(header[3]) - 1;
+            graph.ef = header[4];
+
+            sanisizer::resize(graph.levels, my_obs);
+            knncolle::quick_load(subdir / "LEVELS", graph.levels.data(), graph.levels.size());
+            graph.compute_upper_offsets();
+            sanisizer::resize(graph.level0_links, sanisizer::product<std::size_t>(my_obs, graph.level0_stride));
+            knncolle::quick_load(subdir / "LEVEL0_LINKS", graph.level0_links.data(), graph.level0_links.size());
+            knncolle::quick_load(subdir / "UPPER_LINKS", graph.upper_links.data(), graph.upper_links.size());
+            load_entry_points(subdir / "ENTRY_POINTS", graph.entry_points);
+            check_entry_points(graph.entry_points, my_obs);
+        }
+    }
+};
+/**
+ * @endcond
+ */
+
+/**
+ * @brief HNSW graphs for multiple distance metrics over a shared set of observations.
+ *
+ * An HNSW graph is built for each distance metric, as described for `HnswBuilder`.
+ * However, the observation data is only stored once and is shared by all graphs, rather than being duplicated in each graph.
+ * This reduces memory usage compared to building a separate `HnswBuilder` index for each metric, especially for high-dimensional data where the data dominates the size of the index.
+ * The graphs are built one at a time, so the peak memory usage during construction is that of the shared data plus a single HNSW index.
+ *
+ * The metric to search is chosen when creating a searcher, via the `initialize(std::size_t)` method of the prebuilt index;
+ * the usual `knncolle::Prebuilt::initialize()` method searches the first metric.
+ * The multi-metric index can be saved to disk via `knncolle::Prebuilt::save()` and reloaded with `load_multi_metric_hnsw_prebuilt()`.
+ * Searches give the same results as a `HnswBuilder` index with the corresponding distance and the same `HnswOptions`.
+ *
+ * All distances must operate on dense arrays of `HnswData_` with length equal to the number of dimensions,
+ * i.e., `hnswlib::SpaceInterface::get_data_size()` should be equal to the number of dimensions multiplied by `sizeof(HnswData_)`.
+ * Deletion and compaction are not supported.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating point type for the distances.
+ * @tparam Matrix_ Class of the input data matrix.
+ * This should satisfy the `knncolle::Matrix` interface.
+ * @tparam HnswData_ Type of data in the HNSW index, usually floating-point.
+ */
+template<
+    typename Index_,
+    typename Data_,
+    typename Distance_,
+    class Matrix_ = knncolle::Matrix<Index_, Data_>,
+    typename HnswData_ = float
+>
+class MultiMetricHnswBuilder final : public knncolle::Builder<Index_, Data_, Distance_, Matrix_> {
+private:
+    std::vector<DistanceConfig<Distance_, HnswData_> > my_distance_configs;
+    HnswOptions my_options;
+
+public:
+    /**
+     * @param distance_configs Configuration for computing distances for each metric, e.g., `configure_euclidean_distance()`.
+     * This should contain at least one entry.
+     * @param options Further options for building and searching each graph.
+     */
+    MultiMetricHnswBuilder(std::vector<DistanceConfig<Distance_, HnswData_> > distance_configs, HnswOptions options) :
+        my_distance_configs(std::move(distance_configs)),
+        my_options(std::move(options))
+    {
+        if (my_distance_configs.empty()) {
+            throw std::runtime_error("at least one distance configuration should be provided");
+        }
+        for (const auto& config : my_distance_configs) {
+            if (!config.create) {
+                throw std::runtime_error("'distance_config.create' was not provided");
+            }
+            if (config.normalize_method == DistanceNormalizeMethod::CUSTOM && !config.custom_normalize && !config.custom_normalize_block) {
+                throw std::runtime_error("neither 'distance_config.custom_normalize' nor 'distance_config.custom_normalize_block' was provided");
+            }
+        }
+    }
+
+    /**
+     * Overload that uses the default `HnswOptions`.
+     * @param distance_configs Configuration for computing distances for each metric, e.g., `configure_euclidean_distance()`.
+     */
+    MultiMetricHnswBuilder(std::vector<DistanceConfig<Distance_, HnswData_> > distance_configs) : MultiMetricHnswBuilder(std::move(distance_configs), {}) {}
+
+    /**
+     * @return Options for HNSW, to be modified prior to calling `knncolle::Builder::build_raw()` and friends.
+     */
+    HnswOptions& get_options() {
+        return my_options;
+    }
+
+public:
+    /**
+     * @cond
+     */
+    knncolle::Prebuilt<Index_, Data_, Distance_>* build_raw(const Matrix_& data) const {
+        return build_known_raw(data);
+    }
+    /**
+     * @endcond
+     */
+
+public:
+    /**
+     * Override to assist devirtualization.
+     */
+    auto build_known_raw(const Matrix_& data) const {
+        return new MultiMetricHnswPrebuilt<Index_, Data_, Distance_, HnswData_>(data, my_distance_configs, my_options);
+    }
+
+    /**
+     * Override to assist devirtualization.
+     */
+    auto build_known_unique(const Matrix_& data) const {
+        return std::unique_ptr<I<decltype(*build_known_raw(data))> >(build_known_raw(data));
+    }
+
+    /**
+     * Override to assist devirtualization.
+     */
+    auto build_known_shared(const Matrix_& data) const {
+        return std::shared_ptr<I<decltype(*build_known_raw(data))> >(build_known_raw(data));
+    }
+};
+
+/**
+ * Load a multi-metric HNSW index that was saved by the `knncolle::Prebuilt::save()` method of a `MultiMetricHnswBuilder`-generated instance.
+ * Custom loading functions for distances and normalization (see `custom_load_for_hnsw_distance()` and `custom_load_for_hnsw_normalize()`) are called on the subdirectory for each metric.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ *
+ * @param dir Path to a directory in which a prebuilt multi-metric HNSW index was saved.
+ *
+ * @return Pointer to a `knncolle::Prebuilt` multi-metric HNSW index.
+ * This can be registered in `knncolle::load_prebuilt_registry()` with the key in `knncolle_hnsw::multi_metric_hnsw_prebuilt_save_name`.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_ = float>
+auto load_multi_metric_hnsw_prebuilt(const std::filesystem::path& dir) {
+    return new MultiMetricHnswPrebuilt<Index_, Data_, Distance_, HnswData_>(dir);
+}
+
+}
+
+#endif
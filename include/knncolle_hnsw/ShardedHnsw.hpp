@@ -0,0 +1,674 @@
+#ifndef KNNCOLLE_HNSW_SHARDED_HNSW_HPP
+#define KNNCOLLE_HNSW_SHARDED_HNSW_HPP
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <memory>
+#include <limits>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+
+#include "knncolle/knncolle.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "Hnsw.hpp"
+#include "distances.hpp"
+#include "utils.hpp"
+
+/**
+ * @file ShardedHnsw.hpp
+ *
+ * @brief Approximate nearest neighbor search with multiple HNSW shards.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * Name of the sharded HNSW algorithm when registering a loading function to `knncolle::load_prebuilt_registry()`.
+ */
+inline static constexpr const char* sharded_hnsw_prebuilt_save_name = "knncolle_hnsw::ShardedHnsw";
+
+/**
+ * Strategy for partitioning observations across shards in `ShardedHnswBuilder`.
+ *
+ * - `RANDOM`: observations are randomly allocated to shards of (near-)equal size.
+ *   Every shard must be searched for each query.
+ * - `KMEANS`: observations are clustered by k-means with the Euclidean distance, and each cluster is used as a shard.
+ *   This allows the search to be restricted to the shards with the closest centroids, see `ShardedHnswOptions::num_probes`.
+ */
+enum class ShardPartition : char { RANDOM, KMEANS };
+
+/**
+ * @brief Options for `ShardedHnswBuilder`.
+ */
+struct ShardedHnswOptions {
+    /**
+     * Number of shards.
+     * Each shard is a separate HNSW index that is built and searched independently.
+     * This is capped at the number of observations, and empty shards are discarded.
+     */
+    int num_shards = 4;
+
+    /**
+     * Strategy for partitioning observations across shards.
+     */
+    ShardPartition partition = ShardPartition::RANDOM;
+
+    /**
+     * Maximum number of iterations for k-means clustering.
+     * Only used if `ShardedHnswOptions::partition = ShardPartition::KMEANS`.
+     */
+    int kmeans_iterations = 10;
+
+    /**
+     * Number of shards to search for each query, namely those with the closest centroids.
+     * For searches by observation index, the shard containing the observation is always searched.
+     * If zero or greater than the number of shards, all shards are searched.
+     * Only used if `ShardedHnswOptions::partition = ShardPartition::KMEANS`, otherwise all shards are searched.
+     */
+    int num_probes = 0;
+
+    /**
+     * Number of threads to use for k-means clustering and for building the shards.
+     * Each shard is built by a single thread.
+     */
+    int num_threads = 1;
+
+    /**
+     * Seed for the random partitioning or the k-means initialization.
+     */
+    std::uint64_t seed = 1234567890;
+
+    /**
+     * Options for building and searching each shard.
+     */
+    HnswOptions hnsw;
+};
+
+/**
+ * @cond
+ */
+// Matrix of the observations in a single shard, reading from the store of all
+// observations through the shard's mapping to avoid a per-shard copy.
+template<typename Index_, typename Data_>
+class ShardSubsetExtractor final : public knncolle::MatrixExtractor<Data_> {
+public:
+    ShardSubsetExtractor(const Data_* store, std::size_t num_dim, const Index_* mapping) :
+        my_store(store), my_num_dim(num_dim), my_mapping(mapping) {}
+
+private:
+    const Data_* my_store;
+    std::size_t my_num_dim;
+    const Index_* my_mapping;
+    Index_ my_position = 0;
+
+public:
+    const Data_* next() {
+        return my_store + sanisizer::product_unsafe<std::size_t>(my_mapping[my_position++], my_num_dim);
+    }
+};
+
+template<typename Index_, typename Data_>
+class ShardSubsetMatrix final : public knncolle::Matrix<Index_, Data_> {
+public:
+    ShardSubsetMatrix(const Data_* store, std::size_t num_dim, const std::vector<Index_>& mapping) :
+        my_store(store), my_num_dim(num_dim), my_mapping(mapping) {}
+
+private:
+    const Data_* my_store;
+    std::size_t my_num_dim;
+    const std::vector<Index_>& my_mapping;
+
+public:
+    Index_ num_observations() const {
+        return my_mapping.size();
+    }
+
+    std::size_t num_dimensions() const {
+        return my_num_dim;
+    }
+
+    std::unique_ptr<knncolle::MatrixExtractor<Data_> > new_extractor() const {
+        return new_known_extractor();
+    }
+
+    auto new_known_extractor() const {
+        return std::make_unique<ShardSubsetExtractor<Index_, Data_> >(my_store, my_num_dim, my_mapping.data());
+    }
+
+    // Allows the shard's builder to convert observations in parallel, see has_densify.
+    template<typename Output_>
+    void densify(Index_ i, Output_* output) const {
+        convert_block(my_store + sanisizer::product_unsafe<std::size_t>(my_mapping[i], my_num_dim), my_num_dim, output);
+    }
+};
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class ShardedHnswPrebuilt;
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class ShardedHnswSearcher final : public knncolle::Searcher<Index_, Data_, Distance_> {
+private:
+    const ShardedHnswPrebuilt<Index_, Data_, Distance_, HnswData_>& my_parent;
+
+    std::vector<std::unique_ptr<HnswSearcher<Index_, Data_, Distance_, HnswData_> > > my_searchers;
+    std::vector<std::size_t> my_selected;
+    std::vector<std::pair<double, std::size_t> > my_order;
+
+    std::vector<Data_> my_query;
+    std::vector<Index_> my_indices;
+    std::vector<Distance_> my_distances;
+    std::vector<std::pair<Distance_, Index_> > my_candidates;
+
+public:
+    ShardedHnswSearcher(const ShardedHnswPrebuilt<Index_, Data_, Distance_, HnswData_>& parent) : my_parent(parent) {
+        my_searchers.reserve(my_parent.my_shards.size());
+        for (const auto& shard : my_parent.my_shards) {
+            my_searchers.push_back(shard->initialize_known());
+        }
+    }
+
+private:
+    // Chooses the shards to be searched, always including 'home' if it is a valid shard index.
+    void select_shards(const Data_* query, std::size_t home) {
+        const std::size_t num_shards = my_parent.my_shards.size();
+        my_selected.clear();
+
+        const std::size_t num_probes = my_parent.my_num_probes;
+        if (my_parent.my_centroids.empty() || num_probes == 0 || num_probes >= num_shards) {
+            my_selected.resize(num_shards);
+            std::iota(my_selected.begin(), my_selected.end(), static_cast<std::size_t>(0));
+            return;
+        }
+
+        const std::size_t ndim = my_parent.my_dim;
+        my_order.clear();
+        for (std::size_t s = 0; s < num_shards; ++s) {
+            if (s == home) {
+                continue;
+            }
+            auto centroid = my_parent.my_centroids.data() + sanisizer::product_unsafe<std::size_t>(s, ndim);
+            double dist = 0;
+            for (std::size_t d = 0; d < ndim; ++d) {
+                double delta = static_cast<double>(query[d]) - centroid[d];
+                dist += delta * delta;
+            }
+            my_order.emplace_back(dist, s);
+        }
+
+        std::size_t remaining = num_probes;
+        if (home < num_shards) {
+            my_selected.push_back(home);
+            --remaining;
+        }
+        remaining = std::min(remaining, my_order.size());
+        std::partial_sort(my_order.begin(), my_order.begin() + remaining, my_order.end());
+        for (std::size_t o = 0; o < remaining; ++o) {
+            my_selected.push_back(my_order[o].second);
+        }
+    }
+
+    void add_candidates(std::size_t shard) {
+        const auto& mapping = my_parent.my_mapping[shard];
+        const auto num = my_indices.size();
+        for (I<decltype(num)> x = 0; x < num; ++x) {
+            my_candidates.emplace_back(my_distances[x], mapping[my_indices[x]]);
+        }
+    }
+
+    void report(Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        const auto num = std::min(static_cast<std::size_t>(k), my_candidates.size());
+        std::partial_sort(my_candidates.begin(), my_candidates.begin() + num, my_candidates.end());
+
+        if (output_indices) {
+            output_indices->clear();
+            output_indices->reserve(num);
+            for (std::size_t x = 0; x < num; ++x) {
+                output_indices->push_back(my_candidates[x].second);
+            }
+        }
+        if (output_distances) {
+            output_distances->clear();
+            output_distances->reserve(num);
+            for (std::size_t x = 0; x < num; ++x) {
+                output_distances->push_back(my_candidates[x].first);
+            }
+        }
+    }
+
+public:
+    void search(Index_ i, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        const auto home = my_parent.my_shard_of[i];
+        const auto local = my_parent.my_local_of[i];
+
+        // We need the observation's coordinates to query the other shards.
+        my_query.resize(my_parent.my_dim);
+        my_parent.my_shards[home]->fetch_observation(local, my_query.data());
+        select_shards(my_query.data(), home);
+
+        my_candidates.clear();
+        for (auto s : my_selected) {
+            if (s == home) {
+                my_searchers[s]->search(local, k, &my_indices, &my_distances);
+            } else {
+                my_searchers[s]->search(my_query.data(), k, &my_indices, &my_distances);
+            }
+            add_candidates(s);
+        }
+
+        report(k, output_indices, output_distances);
+    }
+
+    void search(const Data_* query, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        select_shards(query, std::numeric_limits<std::size_t>::max());
+
+        my_candidates.clear();
+        for (auto s : my_selected) {
+            my_searchers[s]->search(query, k, &my_indices, &my_distances);
+            add_candidates(s);
+        }
+
+        report(k, output_indices, output_distances);
+    }
+};
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class ShardedHnswPrebuilt final : public knncolle::Prebuilt<Index_, Data_, Distance_> {
+public:
+    template<class Matrix_>
+    ShardedHnswPrebuilt(const Matrix_& data, const DistanceConfig<Distance_, HnswData_>& distance_config, const ShardedHnswOptions& options) :
+        my_dim(data.num_dimensions()),
+        my_obs(data.num_observations()),
+        my_num_probes(std::max(options.num_probes, 0))
+    {
+        const std::size_t requested = std::max(std::min(static_cast<std::size_t>(std::max(options.num_shards, 1)), static_cast<std::size_t>(my_obs)), static_cast<std::size_t>(1));
+        auto assignment = sanisizer::create<std::vector<std::size_t> >(my_obs);
+        std::mt19937_64 rng(options.seed);
+        std::vector<double> centroids;
+
+        // k-means needs all observations in memory, so they are copied into a
+        // single store that is shared by all shards. A random partition does
+        // not depend on the data, so each observation is instead scattered
+        // directly into its shard's block after partitioning.
+        const bool use_kmeans = (options.partition == ShardPartition::KMEANS && my_obs > 0);
+        std::vector<Data_> store;
+        if (use_kmeans) {
+            store.resize(sanisizer::product<typename std::vector<Data_>::size_type>(my_dim, my_obs));
+            auto work = data.new_known_extractor();
+            for (Index_ i = 0; i < my_obs; ++i) {
+                std::copy_n(work->next(), my_dim, store.begin() + sanisizer::product_unsafe<std::size_t>(i, my_dim));
+            }
+            partition_kmeans(store, requested, options, rng, assignment, centroids);
+        } else {
+            partition_random(requested, rng, assignment);
+        }
+
+        // Discarding empty shards, which can occur with k-means.
+        std::vector<std::vector<Index_> > members(requested);
+        for (Index_ i = 0; i < my_obs; ++i) {
+            members[assignment[i]].push_back(i);
+        }
+        for (std::size_t s = 0; s < requested; ++s) {
+            if (members[s].empty()) {
+                continue;
+            }
+            if (!centroids.empty()) {
+                auto cstart = centroids.begin() + sanisizer::product_unsafe<std::size_t>(s, my_dim);
+                my_centroids.insert(my_centroids.end(), cstart, cstart + my_dim);
+            }
+            my_mapping.push_back(std::move(members[s]));
+        }
+        populate_lookup();
+
+        const std::size_t num_shards = my_mapping.size();
+        my_shards.resize(num_shards);
+        if (use_kmeans) {
+            knncolle::parallelize(options.num_threads, num_shards, [&](int, std::size_t start, std::size_t length) -> void {
+                for (std::size_t s = start, end = start + length; s < end; ++s) {
+                    ShardSubsetMatrix<Index_, Data_> mat(store.data(), my_dim, my_mapping[s]);
+                    my_shards[s].reset(new HnswPrebuilt<Index_, Data_, Distance_, HnswData_>(mat, distance_config, options.hnsw));
+                }
+            });
+            return;
+        }
+
+        std::vector<std::vector<Data_> > blocks(num_shards);
+        for (std::size_t s = 0; s < num_shards; ++s) {
+            blocks[s].resize(sanisizer::product<typename std::vector<Data_>::size_type>(my_dim, my_mapping[s].size()));
+        }
+        {
+            auto work = data.new_known_extractor();
+            for (Index_ i = 0; i < my_obs; ++i) {
+                std::copy_n(work->next(), my_dim, blocks[my_shard_of[i]].begin() + sanisizer::product_unsafe<std::size_t>(my_local_of[i], my_dim));
+            }
+        }
+        knncolle::parallelize(options.num_threads, num_shards, [&](int, std::size_t start, std::size_t length) -> void {
+            for (std::size_t s = start, end = start + length; s < end; ++s) {
+                knncolle::SimpleMatrix<Index_, Data_> mat(my_dim, my_mapping[s].size(), blocks[s].data());
+                my_shards[s].reset(new HnswPrebuilt<Index_, Data_, Distance_, HnswData_>(mat, distance_config, options.hnsw));
+                std::vector<Data_>().swap(blocks[s]); // releasing each block once its shard is built.
+            }
+        });
+    }
+
+private:
+    std::size_t my_dim;
+    Index_ my_obs;
+    std::size_t my_num_probes;
+
+    std::vector<std::unique_ptr<HnswPrebuilt<Index_, Data_, Distance_, HnswData_> > > my_shards;
+    std::vector<std::vector<Index_> > my_mapping; // local index -> global index, per shard.
+    std::vector<std::size_t> my_shard_of; // global index -> shard.
+    std::vector<Index_> my_local_of; // global index -> local index.
+    std::vector<double> my_centroids; // empty if partitioning was random.
+
+    friend class ShardedHnswSearcher<Index_, Data_, Distance_, HnswData_>;
+
+private:
+    void partition_random(std::size_t num_shards, std::mt19937_64& rng, std::vector<std::size_t>& assignment) const {
+        auto order = sanisizer::create<std::vector<Index_> >(my_obs);
+        std::iota(order.begin(), order.end(), static_cast<Index_>(0));
+        std::shuffle(order.begin(), order.end(), rng);
+        for (Index_ i = 0; i < my_obs; ++i) {
+            assignment[order[i]] = i % num_shards;
+        }
+    }
+
+    template<class Store_>
+    std::size_t closest_centroid(const Store_& store, Index_ i, const std::vector<double>& centroids, std::size_t num_centers) const {
+        auto ptr = store.begin() + sanisizer::product_unsafe<std::size_t>(i, my_dim);
+        std::size_t best = 0;
+        double best_dist = std::numeric_limits<double>::infinity();
+        for (std::size_t c = 0; c < num_centers; ++c) {
+            auto cptr = centroids.data() + sanisizer::product_unsafe<std::size_t>(c, my_dim);
+            double dist = 0;
+            for (std::size_t d = 0; d < my_dim; ++d) {
+                double delta = static_cast<double>(ptr[d]) - cptr[d];
+                dist += delta * delta;
+            }
+            if (dist < best_dist) {
+                best_dist = dist;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    template<class Store_>
+    void partition_kmeans(const Store_& store, std::size_t num_centers, const ShardedHnswOptions& options, std::mt19937_64& rng, std::vector<std::size_t>& assignment, std::vector<double>& centroids) const {
+        // Initializing the centers with a random subset of observations.
+        auto order = sanisizer::create<std::vector<Index_> >(my_obs);
+        std::iota(order.begin(), order.end(), static_cast<Index_>(0));
+        std::shuffle(order.begin(), order.end(), rng);
+        centroids.resize(sanisizer::product<std::size_t>(num_centers, my_dim));
+        for (std::size_t c = 0; c < num_centers; ++c) {
+            std::copy_n(
+                store.begin() + sanisizer::product_unsafe<std::size_t>(order[c], my_dim),
+                my_dim,
+                centroids.begin() + sanisizer::product_unsafe<std::size_t>(c, my_dim)
+            );
+        }
+
+        auto assign = [&]() -> bool {
+            std::vector<char> changed(std::max(options.num_threads, 1));
+            knncolle::parallelize(options.num_threads, my_obs, [&](int t, Index_ start, Index_ length) -> void {
+                for (Index_ i = start, end = start + length; i < end; ++i) {
+                    auto best = closest_centroid(store, i, centroids, num_centers);
+                    if (best != assignment[i]) {
+                        assignment[i] = best;
+                        changed[t] = true;
+                    }
+                }
+            });
+            return std::find(changed.begin(), changed.end(), true) != changed.end();
+        };
+
+        std::fill(assignment.begin(), assignment.end(), num_centers); // forcing a change on the first assignment.
+        assign();
+
+        std::vector<std::size_t> sizes(num_centers);
+        for (int it = 0; it < options.kmeans_iterations; ++it) {
+            std::fill(sizes.begin(), sizes.end(), 0);
+            std::vector<double> updated(centroids.size());
+            for (Index_ i = 0; i < my_obs; ++i) {
+                auto c = assignment[i];
+                ++sizes[c];
+                auto ptr = store.begin() + sanisizer::product_unsafe<std::size_t>(i, my_dim);
+                auto uptr = updated.data() + sanisizer::product_unsafe<std::size_t>(c, my_dim);
+                for (std::size_t d = 0; d < my_dim; ++d) {
+                    uptr[d] += ptr[d];
+                }
+            }
+
+            for (std::size_t c = 0; c < num_centers; ++c) {
+                if (sizes[c] == 0) { // empty clusters just keep their previous center.
+                    continue;
+                }
+                auto uptr = updated.data() + sanisizer::product_unsafe<std::size_t>(c, my_dim);
+                auto cptr = centroids.data() + sanisizer::product_unsafe<std::size_t>(c, my_dim);
+                for (std::size_t d = 0; d < my_dim; ++d) {
+                    cptr[d] = uptr[d] / sizes[c];
+                }
+            }
+
+            if (!assign()) {
+                break;
+            }
+        }
+    }
+
+    void populate_lookup() {
+        sanisizer::resize(my_shard_of, my_obs);
+        sanisizer::resize(my_local_of, my_obs);
+        for (std::size_t s = 0, num_shards = my_mapping.size(); s < num_shards; ++s) {
+            const auto& mapping = my_mapping[s];
+            for (Index_ x = 0, num = mapping.size(); x < num; ++x) {
+                my_shard_of[mapping[x]] = s;
+                my_local_of[mapping[x]] = x;
+            }
+        }
+    }
+
+    static std::filesystem::path shard_directory(const std::filesystem::path& dir, std::size_t s) {
+        return dir / ("shard" + std::to_string(s));
+    }
+
+public:
+    std::size_t num_dimensions() const {
+        return my_dim;
+    }
+
+    Index_ num_observations() const {
+        return my_obs;
+    }
+
+    std::size_t num_shards() const {
+        return my_shards.size();
+    }
+
+public:
+    std::unique_ptr<knncolle::Searcher<Index_, Data_, Distance_> > initialize() const {
+        return initialize_known();
+    }
+
+    auto initialize_known() const {
+        return std::make_unique<ShardedHnswSearcher<Index_, Data_, Distance_, HnswData_> >(*this);
+    }
+
+public:
+    void save(const std::filesystem::path& dir) const {
+        knncolle::quick_save(dir / "ALGORITHM", sharded_hnsw_prebuilt_save_name, std::strlen(sharded_hnsw_prebuilt_save_name));
+        knncolle::quick_save(dir / "NUM_OBS", &my_obs, 1);
+        knncolle::quick_save(dir / "NUM_DIM", &my_dim, 1);
+
+        auto type = knncolle::get_numeric_type<HnswData_>();
+        knncolle::quick_save(dir / "TYPE", &type, 1);
+
+        const std::size_t num_shards = my_shards.size();
+        knncolle::quick_save(dir / "NUM_SHARDS", &num_shards, 1);
+        knncolle::quick_save(dir / "NUM_PROBES", &my_num_probes, 1);
+        const std::size_t num_centroids = my_centroids.size();
+        knncolle::quick_save(dir / "NUM_CENTROIDS", &num_centroids, 1);
+        if (num_centroids) {
+            knncolle::quick_save(dir / "CENTROIDS", my_centroids.data(), num_centroids);
+        }
+
+        for (std::size_t s = 0; s < num_shards; ++s) {
+            auto subdir = shard_directory(dir, s);
+            std::filesystem::create_directory(subdir);
+            my_shards[s]->save(subdir);
+            knncolle::quick_save(subdir / "MAPPING", my_mapping[s].data(), my_mapping[s].size());
+        }
+    }
+
+    ShardedHnswPrebuilt(const std::filesystem::path& dir) {
+        knncolle::quick_load(dir / "NUM_DIM", &my_dim, 1);
+        knncolle::quick_load(dir / "NUM_OBS", &my_obs, 1);
+        knncolle::quick_load(dir / "NUM_PROBES", &my_num_probes, 1);
+
+        std::size_t num_centroids;
+        knncolle::quick_load(dir / "NUM_CENTROIDS", &num_centroids, 1);
+        if (num_centroids) {
+            sanisizer::resize(my_centroids, num_centroids);
+            knncolle::quick_load(dir / "CENTROIDS", my_centroids.data(), num_centroids);
+        }
+
+        std::size_t num_shards;
+        knncolle::quick_load(dir / "NUM_SHARDS", &num_shards, 1);
+        my_shards.reserve(num_shards);
+        my_mapping.reserve(num_shards);
+        for (std::size_t s = 0; s < num_shards; ++s) {
+            auto subdir = shard_directory(dir, s);
+            my_shards.emplace_back(new HnswPrebuilt<Index_, Data_, Distance_, HnswData_>(subdir));
+            auto& mapping = my_mapping.emplace_back(sanisizer::cast<typename std::vector<Index_>::size_type>(my_shards.back()->num_observations()));
+            knncolle::quick_load(subdir / "MAPPING", mapping.data(), mapping.size());
+        }
+        populate_lookup();
+    }
+};
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Approximate nearest neighbor search with multiple HNSW shards.
+ *
+ * Observations are partitioned into several shards, each of which is indexed by a separate HNSW graph (see `HnswBuilder`).
+ * The shards are built in parallel, which avoids the lock contention of concurrent insertions into a single large graph.
+ * For each query, each shard (or a subset thereof, see `ShardedHnswOptions::num_probes`) is searched and the results are merged to obtain the top `k` neighbors.
+ * Observation indices in the search results refer to the original matrix, so the sharding is transparent to callers of the `knncolle::Prebuilt` interface.
+ *
+ * The sharded index can be saved to disk via `knncolle::Prebuilt::save()` and reloaded with `load_sharded_hnsw_prebuilt()`.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating point type for the distances.
+ * @tparam Matrix_ Class of the input data matrix.
+ * This should satisfy the `knncolle::Matrix` interface.
+ * @tparam HnswData_ Type of data in each HNSW index, usually floating-point.
+ */
+template<
+    typename Index_,
+    typename Data_,
+    typename Distance_,
+    class Matrix_ = knncolle::Matrix<Index_, Data_>,
+    typename HnswData_ = float
+>
+class ShardedHnswBuilder final : public knncolle::Builder<Index_, Data_, Distance_, Matrix_> {
+private:
+    DistanceConfig<Distance_, HnswData_> my_distance_config;
+    ShardedHnswOptions my_options;
+
+public:
+    /**
+     * @param distance_config Configuration for computing distances in each HNSW index, e.g., `configure_euclidean_distance()`.
+     * @param options Further options for partitioning, index construction and searching.
+     */
+    ShardedHnswBuilder(DistanceConfig<Distance_, HnswData_> distance_config, ShardedHnswOptions options) :
+        my_distance_config(std::move(distance_config)),
+        my_options(std::move(options))
+    {
+        if (!my_distance_config.create) {
+            throw std::runtime_error("'distance_config.create' was not provided");
+        }
+        if (my_distance_config.normalize_method == DistanceNormalizeMethod::CUSTOM && !my_distance_config.custom_normalize && !my_distance_config.custom_normalize_block) {
+            throw std::runtime_error("neither 'distance_config.custom_normalize' nor 'distance_config.custom_normalize_block' was provided");
+        }
+    }
+
+    /**
+     * Overload that uses the default `ShardedHnswOptions`.
+     * @param distance_config Configuration for computing distances in each HNSW index, e.g., `configure_euclidean_distance()`.
+     */
+    ShardedHnswBuilder(DistanceConfig<Distance_, HnswData_> distance_config) : ShardedHnswBuilder(std::move(distance_config), {}) {}
+
+    /**
+     * @return Options for sharded HNSW, to be modified prior to calling `knncolle::Builder::build_raw()` and friends.
+     */
+    ShardedHnswOptions& get_options() {
+        return my_options;
+    }
+
+public:
+    /**
+     * @cond
+     */
+    knncolle::Prebuilt<Index_, Data_, Distance_>* build_raw(const Matrix_& data) const {
+        return build_known_raw(data);
+    }
+    /**
+     * @endcond
+     */
+
+public:
+    /**
+     * Override to assist devirtualization.
+     */
+    auto build_known_raw(const Matrix_& data) const {
+        return new ShardedHnswPrebuilt<Index_, Data_, Distance_, HnswData_>(data, my_distance_config, my_options);
+    }
+
+    /**
+     * Override to assist devirtualization.
+     */
+    auto build_known_unique(const Matrix_& data) const {
+        return std::unique_ptr<I<decltype(*build_known_raw(data))> >(build_known_raw(data));
+    }
+
+    /**
+     * Override to assist devirtualization.
+     */
+    auto build_known_shared(const Matrix_& data) const {
+        return std::shared_ptr<I<decltype(*build_known_raw(data))> >(build_known_raw(data));
+    }
+};
+
+/**
+ * Load a sharded HNSW index that was saved by the `knncolle::Prebuilt::save()` method of a `ShardedHnswBuilder`-generated instance.
+ * The `HnswData_` type can be determined by calling `load_hnsw_prebuilt_types()` on the same directory.
+ * Each shard is loaded as described in `load_hnsw_prebuilt()`, so any custom loading functions for HNSW indices are also respected here.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in each HNSW index.
+ *
+ * @param dir Path to a directory in which a prebuilt sharded HNSW index was saved.
+ *
+ * @return Pointer to a `knncolle::Prebuilt` sharded HNSW index.
+ * This can be registered in `knncolle::load_prebuilt_registry()` with the key in `knncolle_hnsw::sharded_hnsw_prebuilt_save_name`.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_ = float>
+auto load_sharded_hnsw_prebuilt(const std::filesystem::path& dir) {
+    return new ShardedHnswPrebuilt<Index_, Data_, Distance_, HnswData_>(dir);
+}
+
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef KNNCOLLE_HNSW_SPARSE_MATRIX_HPP
+#define KNNCOLLE_HNSW_SPARSE_MATRIX_HPP
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <stdexcept>
+#include <cstddef>
+
+#include "knncolle/knncolle.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+/**
+ * @file SparseMatrix.hpp
+ * @brief Sparse input matrix for building HNSW indices.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+template<typename Index_, typename Data_, typename Value_, typename DimIndex_, typename Pointer_>
+class SparseMatrixExtractor final : public knncolle::MatrixExtractor<Data_> {
+public:
+    SparseMatrixExtractor(std::size_t num_dim, const Pointer_* pointers, const DimIndex_* indices, const Value_* values) :
+        my_pointers(pointers), my_indices(indices), my_values(values)
+    {
+        sanisizer::resize(my_buffer, num_dim);
+    }
+
+private:
+    const Pointer_* my_pointers;
+    const DimIndex_* my_indices;
+    const Value_* my_values;
+    std::vector<Data_> my_buffer;
+    Index_ my_position = 0;
+
+public:
+    const Data_* next() {
+        // Only zeroing the non-zero entries of the previous observation, to avoid a pass over all dimensions.
+        if (my_position > 0) {
+            for (auto p = my_pointers[my_position - 1], end = my_pointers[my_position]; p < end; ++p) {
+                my_buffer[my_indices[p]] = 0;
+            }
+        }
+        for (auto p = my_pointers[my_position], end = my_pointers[my_position + 1]; p < end; ++p) {
+            my_buffer[my_indices[p]] = my_values[p];
+        }
+        ++my_position;
+        return my_buffer.data();
+    }
+};
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Sparse matrix of observations in compressed sparse format.
+ *
+ * Observations are stored in compressed sparse form, i.e., the non-zero entries for observation `i` are stored in `indices` and `values` from `pointers[i]` to `pointers[i + 1]`.
+ * This is equivalent to a CSC matrix where the dimensions are rows and the observations are columns, consistent with **knncolle**'s convention for dense matrices.
+ * It can be used as the `Matrix_` type of a `HnswBuilder` to build an index from sparse data without creating a dense copy of the entire dataset.
+ * How the observations are densified depends on how the index is built:
+ *
+ * - If the base layer is constructed in bulk, i.e., with NN-descent (`HnswOptions::nn_descent_iterations`) or from existing neighbors (`HnswBuilder::build_known_raw()`),
+ *   observations are densified in parallel directly into the index.
+ * - If the index is built by insertion with `InsertionOrder::INPUT` (the default), observations are densified one at a time by the extractor,
+ *   so only one dense observation is held in memory at any time.
+ * - If the index is built by insertion with any other `HnswOptions::insertion_order`, all observations are densified in parallel into a temporary dense copy of the entire dataset,
+ *   as this is required to compute the insertion order.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the dense data returned by the extractor.
+ * @tparam Value_ Numeric type for the stored non-zero values.
+ * @tparam DimIndex_ Integer type for the dimension indices of the non-zero values.
+ * @tparam Pointer_ Integer type for the pointers to the start of each observation.
+ */
+template<typename Index_, typename Data_, typename Value_ = Data_, typename DimIndex_ = int, typename Pointer_ = std::size_t>
+class SparseMatrix final : public knncolle::Matrix<Index_, Data_> {
+public:
+    /**
+     * @param num_dim Number of dimensions.
+     * @param num_obs Number of observations.
+     * @param pointers Pointer to an array of length `num_obs + 1`, containing the offsets to the start of each observation's non-zero values in `indices` and `values`.
+     * @param indices Pointer to an array containing the dimension index of each non-zero value.
+     * All indices should be less than `num_dim` and should be unique within each observation.
+     * @param values Pointer to an array containing the non-zero values.
+     *
+     * All arrays should remain valid for the lifetime of the `SparseMatrix` and any extractors created from it.
+     */
+    SparseMatrix(std::size_t num_dim, Index_ num_obs, const Pointer_* pointers, const DimIndex_* indices, const Value_* values) :
+        my_num_dim(num_dim), my_num_obs(num_obs), my_pointers(pointers), my_indices(indices), my_values(values)
+    {
+        for (Index_ i = 0; i < num_obs; ++i) {
+            if (pointers[i] > pointers[i + 1]) {
+                throw std::runtime_error("pointers should be non-decreasing");
+            }
+            for (auto p = pointers[i], end = pointers[i + 1]; p < end; ++p) {
+                if (static_cast<std::size_t>(indices[p]) >= num_dim) {
+                    throw std::runtime_error("dimension indices should be less than the number of dimensions");
+                }
+            }
+        }
+    }
+
+private:
+    std::size_t my_num_dim;
+    Index_ my_num_obs;
+    const Pointer_* my_pointers;
+    const DimIndex_* my_indices;
+    const Value_* my_values;
+
+public:
+    Index_ num_observations() const {
+        return my_num_obs;
+    }
+
+    std::size_t num_dimensions() const {
+        return my_num_dim;
+    }
+
+    /**
+     * Creates an extractor that returns a dense array for each observation in turn.
+     */
+    std::unique_ptr<knncolle::MatrixExtractor<Data_> > new_extractor() const {
+        return new_known_extractor();
+    }
+
+    /**
+     * Override to assist devirtualization.
+     */
+    auto new_known_extractor() const {
+        return std::make_unique<SparseMatrixExtractor<Index_, Data_, Value_, DimIndex_, Pointer_> >(my_num_dim, my_pointers, my_indices, my_values);
+    }
+
+    /**
+     * Densify a single observation.
+     * This can be called concurrently from multiple threads.
+     *
+     * @tparam Output_ Numeric type of the output.
+     * @param i Index of the observation.
+     * @param[out] output Pointer to an array of length equal to the number of dimensions.
+     * On output, this contains the dense values for observation `i`.
+     */
+    template<typename Output_>
+    void densify(Index_ i, Output_* output) const {
+        std::fill_n(output, my_num_dim, static_cast<Output_>(0));
+        for (auto p = my_pointers[i], end = my_pointers[i + 1]; p < end; ++p) {
+            output[my_indices[p]] = my_values[p];
+        }
+    }
+};
+
+/**
+ * @cond
+ */
+// Whether a matrix supports random access to densified observations, which
+// allows the builder to densify observations in parallel.
+template<class Matrix_, typename Output_, typename = void>
+struct has_densify : std::false_type {};
+
+template<class Matrix_, typename Output_>
+struct has_densify<Matrix_, Output_, std::void_t<decltype(std::declval<const Matrix_&>().densify(0, static_cast<Output_*>(NULL)))> > : std::true_type {};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -0,0 +1,757 @@
+#ifndef KNNCOLLE_HNSW_TIERED_HNSW_HPP
+#define KNNCOLLE_HNSW_TIERED_HNSW_HPP
+
+#include <vector>
+#include <list>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <limits>
+#include <cmath>
+#include <string>
+#include <fstream>
+#include <functional>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "knncolle/knncolle.hpp"
+#include "sanisizer/sanisizer.hpp"
+#include "hnswlib/hnswalg.h"
+
+#include "Hnsw.hpp"
+#include "distances.hpp"
+#include "utils.hpp"
+#include "entry_points.hpp"
+#include "visited_set.hpp"
+
+/**
+ * @file TieredHnsw.hpp
+ *
+ * @brief HNSW index with the graph in memory and the observation data on disk.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * Name of the tiered HNSW algorithm when registering a loading function to `knncolle::load_prebuilt_registry()`.
+ */
+inline static constexpr const char* tiered_hnsw_prebuilt_save_name = "knncolle_hnsw::TieredHnsw";
+
+/**
+ * @brief Options for `TieredHnswPrebuilt`.
+ */
+struct TieredHnswOptions {
+    /**
+     * Maximum number of observations to cache in memory.
+     * The cache is shared by all searchers and evicts the least recently used observations when full.
+     * Observations near the entry point are visited by every search and will stay in the cache.
+     * If zero, every observation is read from disk whenever it is needed.
+     */
+    std::size_t cache_size = 65536;
+
+    /**
+     * Size of the dynamic candidate list during the search, see `HnswOptions::ef_search` for details.
+     */
+    int ef_search = 10;
+
+    /**
+     * Type of set used by each searcher to track the visited nodes, see `HnswOptions::visited_set` for details.
+     * For very large indices, `VisitedSetType::HASH` avoids allocating an array with one entry per node for each searcher.
+     */
+    VisitedSetType visited_set = VisitedSetType::AUTO;
+};
+
+/**
+ * @brief Statistics for the cache of a `TieredHnswPrebuilt`.
+ */
+struct TieredHnswCacheStatistics {
+    /**
+     * Number of observations that were found in the cache.
+     */
+    std::size_t hits = 0;
+
+    /**
+     * Number of observations that were read from disk.
+     */
+    std::size_t reads = 0;
+};
+
+/**
+ * Convert an HNSW index saved by `knncolle::Prebuilt::save()` into the layout used by `TieredHnswPrebuilt`.
+ * The graph (i.e., the links and labels of all layers) is written to a `GRAPH` file while the observation data is written to a separate `VECTORS` file.
+ * All other files in `input`, including those created by custom saving functions, are copied to `output`.
+ * The input index is streamed so that the conversion does not need to hold the index in memory.
+ *
+ * @param input Path to a directory in which a prebuilt HNSW index was saved.
+ * @param output Path to a directory in which to store the converted index.
+ * This should already exist and should be different from `input`.
+ */
+inline void convert_to_tiered_hnsw(const std::filesystem::path& input, const std::filesystem::path& output) {
+    if (knncolle::quick_load_as_string(input / "ALGORITHM") != hnsw_prebuilt_save_name) {
+        throw std::runtime_error("directory does not contain a saved HNSW index");
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(input)) {
+        const auto name = entry.path().filename();
+        if (!entry.is_regular_file() || name == "INDEX" || name == "ALGORITHM") {
+            continue;
+        }
+        std::filesystem::copy_file(entry.path(), output / name, std::filesystem::copy_options::overwrite_existing);
+    }
+    knncolle::quick_save(output / "ALGORITHM", tiered_hnsw_prebuilt_save_name, std::strlen(tiered_hnsw_prebuilt_save_name));
+
+    const auto index_path = input / "INDEX";
+    std::ifstream source(index_path, std::ios::binary);
+    std::ofstream graph(output / "GRAPH", std::ios::binary), vectors(output / "VECTORS", std::ios::binary);
+    if (!source || !graph || !vectors) {
+        throw std::runtime_error("failed to open the files for converting '" + index_path.string() + "'");
+    }
+
+    auto read = [&](void* dest, std::size_t n) -> void {
+        source.read(static_cast<char*>(dest), n);
+        if (!source) {
+            throw std::runtime_error("HNSW index file '" + index_path.string() + "' is truncated");
+        }
+    };
+
+    // The header is copied verbatim, but we need a few fields to split each node.
+    std::vector<char> header(index_header_size);
+    read(header.data(), header.size());
+    graph.write(header.data(), header.size());
+    std::size_t count, size_data_per_element, label_offset, offset_data;
+    std::memcpy(&count, header.data() + 2 * sizeof(std::size_t), sizeof(std::size_t));
+    std::memcpy(&size_data_per_element, header.data() + 3 * sizeof(std::size_t), sizeof(std::size_t));
+    std::memcpy(&label_offset, header.data() + 4 * sizeof(std::size_t), sizeof(std::size_t));
+    std::memcpy(&offset_data, header.data() + 5 * sizeof(std::size_t), sizeof(std::size_t));
+    if (offset_data > label_offset || label_offset + sizeof(hnswlib::labeltype) != size_data_per_element) {
+        throw std::runtime_error("inconsistent element size in the HNSW index file '" + index_path.string() + "'");
+    }
+
+    std::vector<char> element(size_data_per_element);
+    for (std::size_t i = 0; i < count; ++i) {
+        read(element.data(), element.size());
+        graph.write(element.data(), offset_data);
+        graph.write(element.data() + label_offset, sizeof(hnswlib::labeltype));
+        vectors.write(element.data() + offset_data, label_offset - offset_data);
+    }
+
+    // The rest of the file contains the upper-layer link lists.
+    constexpr std::size_t chunk_size = 1024 * 1024;
+    std::vector<char> chunk(chunk_size);
+    while (source) {
+        source.read(chunk.data(), chunk_size);
+        graph.write(chunk.data(), source.gcount());
+    }
+
+    if (!graph || !vectors) {
+        throw std::runtime_error("failed to write the converted HNSW index");
+    }
+}
+
+/**
+ * @cond
+ */
+// Reads observations from the VECTORS file, with an LRU cache that is shared
+// across threads. Each request is processed as a batch so that the cache lock
+// is acquired twice per batch rather than once per observation, and the disk
+// reads for all cache misses are issued together without holding the lock.
+template<typename HnswData_>
+class TieredVectorStore {
+public:
+    TieredVectorStore(const std::filesystem::path& path, std::size_t num_dim, std::size_t capacity) :
+        my_path(path),
+        my_dim(num_dim),
+        my_capacity(capacity)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        my_fd = ::open(my_path.c_str(), O_RDONLY);
+        if (my_fd < 0) {
+            throw std::runtime_error("failed to open '" + my_path.string() + "'");
+        }
+#else
+        my_stream.open(my_path, std::ios::binary);
+        if (!my_stream) {
+            throw std::runtime_error("failed to open '" + my_path.string() + "'");
+        }
+#endif
+        sanisizer::product<std::size_t>(my_capacity, my_dim); // check for overflow, though the pool itself is only filled as needed.
+    }
+
+    ~TieredVectorStore() {
+#if defined(__unix__) || defined(__APPLE__)
+        ::close(my_fd);
+#endif
+    }
+
+    TieredVectorStore(const TieredVectorStore&) = delete;
+    TieredVectorStore& operator=(const TieredVectorStore&) = delete;
+
+private:
+    std::filesystem::path my_path;
+    std::size_t my_dim;
+    std::size_t my_capacity;
+
+#if defined(__unix__) || defined(__APPLE__)
+    int my_fd = -1;
+#else
+    std::mutex my_stream_lock;
+    std::ifstream my_stream;
+#endif
+
+    std::mutex my_lock;
+    std::vector<HnswData_> my_pool;
+    std::vector<hnswlib::tableint> my_owners; // observation in each slot of the pool.
+    std::list<std::size_t> my_recency; // slots, from most to least recently used.
+    std::unordered_map<hnswlib::tableint, std::list<std::size_t>::iterator> my_slots;
+
+    std::atomic<std::size_t> my_hits = 0, my_reads = 0;
+
+    void read(hnswlib::tableint id, HnswData_* output) {
+        const std::size_t nbytes = sanisizer::product_unsafe<std::size_t>(my_dim, sizeof(HnswData_));
+        const std::size_t offset = sanisizer::product_unsafe<std::size_t>(id, nbytes);
+#if defined(__unix__) || defined(__APPLE__)
+        auto dest = reinterpret_cast<char*>(output);
+        std::size_t done = 0;
+        while (done < nbytes) {
+            const auto got = ::pread(my_fd, dest + done, nbytes - done, offset + done);
+            if (got <= 0) {
+                throw std::runtime_error("failed to read from '" + my_path.string() + "'");
+            }
+            done += got;
+        }
+#else
+        std::lock_guard<std::mutex> lck(my_stream_lock);
+        my_stream.seekg(static_cast<std::streamoff>(offset));
+        my_stream.read(reinterpret_cast<char*>(output), nbytes);
+        if (!my_stream) {
+            throw std::runtime_error("failed to read from '" + my_path.string() + "'");
+        }
+#endif
+    }
+
+public:
+    // Fills 'output' with the observations in 'ids', stored contiguously.
+    // 'misses' is just a workspace to avoid reallocations.
+    void fetch(const hnswlib::tableint* ids, std::size_t num, HnswData_* output, std::vector<std::size_t>& misses) {
+        misses.clear();
+        if (my_capacity) {
+            std::lock_guard<std::mutex> lck(my_lock);
+            for (std::size_t j = 0; j < num; ++j) {
+                auto found = my_slots.find(ids[j]);
+                if (found == my_slots.end()) {
+                    misses.push_back(j);
+                    continue;
+                }
+                auto slot_it = found->second;
+                std::copy_n(my_pool.data() + sanisizer::product_unsafe<std::size_t>(*slot_it, my_dim), my_dim, output + sanisizer::product_unsafe<std::size_t>(j, my_dim));
+                my_recency.splice(my_recency.begin(), my_recency, slot_it);
+            }
+        } else {
+            misses.resize(num);
+            for (std::size_t j = 0; j < num; ++j) {
+                misses[j] = j;
+            }
+        }
+
+        my_hits += num - misses.size();
+        my_reads += misses.size();
+        for (auto j : misses) {
+            read(ids[j], output + sanisizer::product_unsafe<std::size_t>(j, my_dim));
+        }
+
+        if (my_capacity == 0 || misses.empty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lck(my_lock);
+        for (auto j : misses) {
+            const auto id = ids[j];
+            if (my_slots.find(id) != my_slots.end()) { // another thread got here first.
+                continue;
+            }
+
+            std::size_t slot;
+            if (my_owners.size() < my_capacity) {
+                slot = my_owners.size();
+                my_owners.push_back(id);
+                my_pool.resize(my_pool.size() + my_dim);
+                my_recency.push_front(slot);
+            } else {
+                slot = my_recency.back();
+                my_slots.erase(my_owners[slot]);
+                my_owners[slot] = id;
+                my_recency.splice(my_recency.begin(), my_recency, std::prev(my_recency.end()));
+            }
+            my_slots[id] = my_recency.begin();
+            std::copy_n(output + sanisizer::product_unsafe<std::size_t>(j, my_dim), my_dim, my_pool.data() + sanisizer::product_unsafe<std::size_t>(slot, my_dim));
+        }
+    }
+
+    TieredHnswCacheStatistics statistics() const {
+        TieredHnswCacheStatistics output;
+        output.hits = my_hits;
+        output.reads = my_reads;
+        return output;
+    }
+};
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class TieredHnswPrebuilt;
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class TieredHnswSearcher final : public knncolle::Searcher<Index_, Data_, Distance_> {
+private:
+    const TieredHnswPrebuilt<Index_, Data_, Distance_, HnswData_>& my_parent;
+
+    std::vector<HnswData_> my_query;
+    std::vector<hnswlib::tableint> my_batch_ids;
+    std::vector<HnswData_> my_batch;
+    std::vector<std::size_t> my_misses;
+
+    EpochVisitedSet my_epoch_visited;
+    HashVisitedSet my_hash_visited;
+    CandidateQueue<HnswData_> my_top_candidates, my_candidate_set;
+    std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> > my_queue;
+
+public:
+    TieredHnswSearcher(const TieredHnswPrebuilt<Index_, Data_, Distance_, HnswData_>& parent) : my_parent(parent) {
+        sanisizer::resize(my_query, my_parent.my_dim);
+
+        const auto num_nodes = my_parent.my_labels.size();
+        const auto visits = expected_visits(my_parent.my_level0_stride - 1, my_parent.my_ef);
+        if (use_hash_visited_set(my_parent.my_visited_set, visits, num_nodes)) {
+            my_hash_visited.reset(visits);
+        } else {
+            my_epoch_visited.reset(num_nodes);
+        }
+    }
+
+private:
+    HnswData_ distance(const HnswData_* other) const {
+        return my_parent.my_distance(my_query.data(), other, my_parent.my_distance_param);
+    }
+
+    // Loads the data for all nodes in 'my_batch_ids' into 'my_batch'.
+    void fetch_batch() {
+        my_batch.resize(sanisizer::product<std::size_t>(my_batch_ids.size(), my_parent.my_dim));
+        my_parent.my_vectors->fetch(my_batch_ids.data(), my_batch_ids.size(), my_batch.data(), my_misses);
+    }
+
+    const HnswData_* batch_entry(std::size_t j) const {
+        return my_batch.data() + sanisizer::product_unsafe<std::size_t>(j, my_parent.my_dim);
+    }
+
+    // Mirrors hnswlib::HierarchicalNSW::searchKnn(), except that the data for
+    // all unvisited neighbors of a node are fetched in a single batch before
+    // their distances are computed. The results are the same as those of an
+    // in-memory search with the same 'ef_search'.
+    void search_raw(Index_ k) {
+        my_queue = std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> >();
+        if (my_parent.my_labels.empty()) {
+            return;
+        }
+
+        // Same choice of starting node as search_knn_with_visited(), if the index has entry points.
+        const auto& entries = my_parent.my_entry_points;
+        auto current = my_parent.my_entry_point;
+        int max_level = my_parent.my_max_level;
+        if (entries.empty()) {
+            my_batch_ids.assign(1, current);
+        } else {
+            my_batch_ids.assign(entries.begin(), entries.end());
+            max_level = 0;
+        }
+        fetch_batch();
+        auto curdist = distance(batch_entry(0));
+        current = my_batch_ids[0];
+        for (I<decltype(my_batch_ids.size())> e = 1, num = my_batch_ids.size(); e < num; ++e) {
+            const auto d = distance(batch_entry(e));
+            if (d < curdist) {
+                curdist = d;
+                current = my_batch_ids[e];
+            }
+        }
+
+        for (int level = max_level; level > 0; --level) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                auto links = my_parent.get_links(current, level);
+                auto size = get_list_count(links);
+                my_batch_ids.assign(links + 1, links + 1 + size);
+                fetch_batch();
+                for (I<decltype(size)> n = 0; n < size; ++n) {
+                    const auto d = distance(batch_entry(n));
+                    if (d < curdist) {
+                        curdist = d;
+                        current = my_batch_ids[n];
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        const std::size_t ef = std::max(static_cast<std::size_t>(my_parent.my_ef), static_cast<std::size_t>(k));
+        const std::size_t num_nodes = my_parent.my_labels.size();
+        const auto visits = expected_visits(my_parent.my_level0_stride - 1, ef);
+        if (use_hash_visited_set(my_parent.my_visited_set, visits, num_nodes)) {
+            my_hash_visited.reset(visits);
+            search_base_layer(current, curdist, k, ef, my_hash_visited);
+        } else {
+            my_epoch_visited.reset(num_nodes);
+            search_base_layer(current, curdist, k, ef, my_epoch_visited);
+        }
+    }
+
+    // Base layer part of search_raw(), starting from 'current'. 'visited'
+    // should already be reset.
+    template<class Visited_>
+    void search_base_layer(hnswlib::tableint current, HnswData_ curdist, Index_ k, std::size_t ef, Visited_& visited) {
+        const bool bare_bone_search = (my_parent.my_num_deleted == 0);
+
+        HnswData_ lower_bound;
+        if (bare_bone_search || !my_parent.is_deleted(current)) {
+            lower_bound = curdist;
+            my_top_candidates.emplace(curdist, current);
+            my_candidate_set.emplace(-curdist, current);
+        } else {
+            lower_bound = std::numeric_limits<HnswData_>::max();
+            my_candidate_set.emplace(-lower_bound, current);
+        }
+        visited.insert(current);
+
+        while (!my_candidate_set.empty()) {
+            const auto top = my_candidate_set.top();
+            const HnswData_ candidate_dist = -top.first;
+            if (bare_bone_search ? candidate_dist > lower_bound : (candidate_dist > lower_bound && my_top_candidates.size() == ef)) {
+                break;
+            }
+            my_candidate_set.pop();
+
+            auto links = my_parent.get_links(top.second, 0);
+            auto size = get_list_count(links);
+            my_batch_ids.clear();
+            for (I<decltype(size)> n = 0; n < size; ++n) {
+                const auto candidate = links[n + 1];
+                if (visited.insert(candidate)) {
+                    my_batch_ids.push_back(candidate);
+                }
+            }
+            fetch_batch();
+
+            for (I<decltype(my_batch_ids.size())> b = 0, num = my_batch_ids.size(); b < num; ++b) {
+                const auto candidate = my_batch_ids[b];
+                const auto d = distance(batch_entry(b));
+                if (my_top_candidates.size() < ef || lower_bound > d) {
+                    my_candidate_set.emplace(-d, candidate);
+                    if (bare_bone_search || !my_parent.is_deleted(candidate)) {
+                        my_top_candidates.emplace(d, candidate);
+                    }
+                    while (my_top_candidates.size() > ef) {
+                        my_top_candidates.pop();
+                    }
+                    if (!my_top_candidates.empty()) {
+                        lower_bound = my_top_candidates.top().first;
+                    }
+                }
+            }
+        }
+
+        my_candidate_set = CandidateQueue<HnswData_>();
+        while (my_top_candidates.size() > static_cast<std::size_t>(k)) {
+            my_top_candidates.pop();
+        }
+        while (!my_top_candidates.empty()) {
+            const auto& top = my_top_candidates.top();
+            my_queue.emplace(top.first, my_parent.my_labels[top.second]);
+            my_top_candidates.pop();
+        }
+    }
+
+    static std::size_t get_list_count(const hnswlib::linklistsizeint* links) {
+        return *reinterpret_cast<const unsigned short*>(links);
+    }
+
+public:
+    void search(Index_ i, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        my_batch_ids.assign(1, my_parent.get_internal_id(i));
+        fetch_batch();
+        std::copy_n(my_batch.begin(), my_parent.my_dim, my_query.begin());
+        search_raw(std::min(k, my_parent.my_obs) + 1); // +1, as we need to discard 'self'.
+
+        report_queue_without_self(my_queue, i, output_indices, output_distances);
+        if (output_distances) {
+            my_parent.normalize_distances(*output_distances);
+        }
+    }
+
+    void search(const Data_* query, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        std::copy_n(query, my_parent.my_dim, my_query.begin());
+        search_raw(std::min(k, my_parent.my_obs));
+
+        report_queue(my_queue, output_indices, output_distances);
+        if (output_distances) {
+            my_parent.normalize_distances(*output_distances);
+        }
+    }
+};
+
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+class TieredHnswPrebuilt final : public knncolle::Prebuilt<Index_, Data_, Distance_> {
+public:
+    TieredHnswPrebuilt(const std::filesystem::path& dir, const TieredHnswOptions& options) : my_dir(dir), my_ef(options.ef_search), my_visited_set(options.visited_set) {
+        if (knncolle::quick_load_as_string(dir / "ALGORITHM") != tiered_hnsw_prebuilt_save_name) {
+            throw std::runtime_error("directory does not contain a tiered HNSW index");
+        }
+        knncolle::quick_load(dir / "NUM_DIM", &my_dim, 1);
+        knncolle::quick_load(dir / "NUM_OBS", &my_obs, 1);
+
+        std::string method = knncolle::quick_load_as_string(dir / "DISTANCE");
+        auto known = create_known_distance<HnswData_>(method, my_dim);
+        if (known) {
+            my_space.reset(known);
+        } else {
+            auto& loadfun = custom_load_for_hnsw_distance<HnswData_>();
+            if (!loadfun) {
+                throw std::runtime_error("no loader provided for an unknown distance");
+            }
+            my_space.reset(loadfun(dir, my_dim));
+        }
+        my_distance = my_space->get_dist_func();
+        my_distance_param = my_space->get_dist_func_param();
+
+        knncolle::quick_load(dir / "NORMALIZE", &my_normalize_method, 1);
+        if (my_normalize_method == DistanceNormalizeMethod::CUSTOM) {
+            auto& normfun = custom_load_for_hnsw_normalize<Distance_>();
+            if (!normfun) {
+                throw std::runtime_error("no loader provided for an unknown normalization");
+            }
+            my_custom_normalize = normfun(dir);
+        }
+
+        load_graph(dir / "GRAPH");
+        load_entry_points(dir / "ENTRY_POINTS", my_entry_points);
+        check_entry_points(my_entry_points, my_labels.size());
+
+        const auto vector_path = dir / "VECTORS";
+        if (std::filesystem::file_size(vector_path) != sanisizer::product<std::size_t>(my_labels.size(), my_space->get_data_size())) {
+            throw std::runtime_error("size of '" + vector_path.string() + "' is inconsistent with the HNSW graph");
+        }
+        my_vectors.reset(new TieredVectorStore<HnswData_>(vector_path, my_dim, options.cache_size));
+    }
+
+private:
+    std::filesystem::path my_dir;
+    std::size_t my_dim;
+    Index_ my_obs;
+    int my_ef;
+    VisitedSetType my_visited_set;
+
+    std::unique_ptr<hnswlib::SpaceInterface<HnswData_> > my_space;
+    hnswlib::DISTFUNC<HnswData_> my_distance;
+    void* my_distance_param;
+    DistanceNormalizeMethod my_normalize_method;
+    std::function<Distance_(Distance_)> my_custom_normalize;
+
+    // Graph structure, laid out as in hnswlib::HierarchicalNSW but without the data.
+    hnswlib::tableint my_entry_point = 0;
+    int my_max_level = -1;
+    std::size_t my_level0_stride = 0, my_upper_stride = 0; // in units of linklistsizeint.
+    std::vector<hnswlib::linklistsizeint> my_level0_links;
+    std::vector<hnswlib::linklistsizeint> my_upper_links;
+    std::vector<std::size_t> my_upper_offsets;
+    std::vector<hnswlib::labeltype> my_labels;
+    std::vector<hnswlib::tableint> my_internal_ids;
+    std::size_t my_num_deleted = 0;
+    std::vector<hnswlib::tableint> my_entry_points;
+
+    std::unique_ptr<TieredVectorStore<HnswData_> > my_vectors;
+
+    friend class TieredHnswSearcher<Index_, Data_, Distance_, HnswData_>;
+
+    static_assert(sizeof(hnswlib::tableint) == sizeof(hnswlib::linklistsizeint));
+
+    void load_graph(const std::filesystem::path& path) {
+        std::ifstream source(path, std::ios::binary);
+        if (!source) {
+            throw std::runtime_error("failed to open '" + path.string() + "'");
+        }
+        auto read = [&](void* dest, std::size_t n) -> void {
+            source.read(static_cast<char*>(dest), n);
+            if (!source) {
+                throw std::runtime_error("HNSW graph file '" + path.string() + "' is truncated");
+            }
+        };
+        auto read_pod = [&](auto& x) -> void {
+            read(&x, sizeof(x));
+        };
+
+        // Same header as hnswlib::HierarchicalNSW::saveIndex().
+        std::size_t offset_level0, max_elements, count, size_data_per_element, label_offset, offset_data, max_m, max_m0, m, ef_construction;
+        double mult;
+        read_pod(offset_level0);
+        read_pod(max_elements);
+        read_pod(count);
+        read_pod(size_data_per_element);
+        read_pod(label_offset);
+        read_pod(offset_data);
+        read_pod(my_max_level);
+        read_pod(my_entry_point);
+        read_pod(max_m);
+        read_pod(max_m0);
+        read_pod(m);
+        read_pod(mult);
+        read_pod(ef_construction);
+
+        my_level0_stride = max_m0 + 1;
+        my_upper_stride = max_m + 1;
+        if (offset_data != my_level0_stride * sizeof(hnswlib::linklistsizeint) || label_offset - offset_data != my_space->get_data_size()) {
+            throw std::runtime_error("inconsistent element size in the HNSW graph file '" + path.string() + "'");
+        }
+
+        sanisizer::resize(my_level0_links, sanisizer::product<std::size_t>(count, my_level0_stride));
+        sanisizer::resize(my_labels, count);
+        for (std::size_t i = 0; i < count; ++i) {
+            read(my_level0_links.data() + i * my_level0_stride, offset_data);
+            read_pod(my_labels[i]);
+        }
+
+        constexpr auto unassigned = std::numeric_limits<hnswlib::tableint>::max();
+        my_internal_ids.resize(count, unassigned);
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto label = my_labels[i];
+            if (label >= count || my_internal_ids[label] != unassigned) {
+                throw std::runtime_error("HNSW graph file '" + path.string() + "' contains invalid labels");
+            }
+            my_internal_ids[label] = i;
+            my_num_deleted += is_deleted(i);
+        }
+
+        sanisizer::resize(my_upper_offsets, sanisizer::sum<std::size_t>(count, 1));
+        std::vector<unsigned int> link_list_sizes(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            read_pod(link_list_sizes[i]);
+            if (link_list_sizes[i] % (my_upper_stride * sizeof(hnswlib::linklistsizeint)) != 0) {
+                throw std::runtime_error("inconsistent link list size in the HNSW graph file '" + path.string() + "'");
+            }
+            const std::size_t num_units = link_list_sizes[i] / sizeof(hnswlib::linklistsizeint);
+            my_upper_offsets[i + 1] = my_upper_offsets[i] + num_units;
+            my_upper_links.resize(my_upper_offsets[i + 1]);
+            read(my_upper_links.data() + my_upper_offsets[i], link_list_sizes[i]);
+        }
+    }
+
+    const hnswlib::linklistsizeint* get_links(hnswlib::tableint i, int level) const {
+        if (level == 0) {
+            return my_level0_links.data() + sanisizer::product_unsafe<std::size_t>(i, my_level0_stride);
+        } else {
+            return my_upper_links.data() + my_upper_offsets[i] + sanisizer::product_unsafe<std::size_t>(level - 1, my_upper_stride);
+        }
+    }
+
+    // Same as hnswlib::HierarchicalNSW::isMarkedDeleted().
+    bool is_deleted(hnswlib::tableint i) const {
+        auto flags = reinterpret_cast<const unsigned char*>(get_links(i, 0)) + 2;
+        return *flags & hnswlib::HierarchicalNSW<HnswData_>::DELETE_MARK;
+    }
+
+    hnswlib::tableint get_internal_id(Index_ i) const {
+        // Same behavior as hnswlib::HierarchicalNSW::getDataByLabel() for deleted observations.
+        if (static_cast<std::size_t>(i) >= my_internal_ids.size() || is_deleted(my_internal_ids[i])) {
+            throw std::runtime_error("Label not found");
+        }
+        return my_internal_ids[i];
+    }
+
+    void normalize_distances(std::vector<Distance_>& output_distances) const {
+        normalize_distance_block(my_normalize_method, my_custom_normalize, {}, output_distances.size(), output_distances.data());
+    }
+
+public:
+    std::size_t num_dimensions() const {
+        return my_dim;
+    }
+
+    Index_ num_observations() const {
+        return my_obs;
+    }
+
+    Index_ num_deleted() const {
+        return my_num_deleted;
+    }
+
+    void fetch_observation(Index_ i, Data_* buffer) const {
+        const auto id = get_internal_id(i);
+        std::vector<HnswData_> raw(my_dim);
+        std::vector<std::size_t> misses;
+        my_vectors->fetch(&id, 1, raw.data(), misses);
+        std::copy(raw.begin(), raw.end(), buffer);
+    }
+
+    TieredHnswCacheStatistics cache_statistics() const {
+        return my_vectors->statistics();
+    }
+
+public:
+    std::unique_ptr<knncolle::Searcher<Index_, Data_, Distance_> > initialize() const {
+        return initialize_known();
+    }
+
+    auto initialize_known() const {
+        return std::make_unique<TieredHnswSearcher<Index_, Data_, Distance_, HnswData_> >(*this);
+    }
+
+public:
+    void save(const std::filesystem::path& dir) const {
+        // The graph and the data already live on disk, so we just copy them over.
+        if (std::filesystem::exists(dir) && std::filesystem::equivalent(dir, my_dir)) {
+            return;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(my_dir)) {
+            if (entry.is_regular_file()) {
+                std::filesystem::copy_file(entry.path(), dir / entry.path().filename(), std::filesystem::copy_options::overwrite_existing);
+            }
+        }
+    }
+};
+/**
+ * @endcond
+ */
+
+/**
+ * Load an HNSW index that was converted by `convert_to_tiered_hnsw()`, or saved by the `knncolle::Prebuilt::save()` method of a previously loaded tiered index.
+ * The graph is held in memory while the observation data remains on disk and is read on demand during the search, with a cache of recently used observations.
+ * This allows indices that are larger than the available memory to be searched from a fast storage device.
+ * Searches will return the same results as an in-memory HNSW index loaded with `load_hnsw_prebuilt()` and with the same `TieredHnswOptions::ef_search`.
+ * The data files should not be modified while the index exists.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ * This should be the same as the type reported by `load_hnsw_prebuilt_types()`.
+ *
+ * @param dir Path to a directory containing the converted HNSW index.
+ * @param options Further options.
+ *
+ * @return Pointer to a `knncolle::Prebuilt` tiered HNSW index.
+ * This can be registered in `knncolle::load_prebuilt_registry()` with the key in `knncolle_hnsw::tiered_hnsw_prebuilt_save_name`.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_ = float>
+auto load_tiered_hnsw_prebuilt(const std::filesystem::path& dir, const TieredHnswOptions& options = {}) {
+    return new TieredHnswPrebuilt<Index_, Data_, Distance_, HnswData_>(dir, options);
+}
+
+}
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef KNNCOLLE_HNSW_BUILD_PROGRESS_HPP
+#define KNNCOLLE_HNSW_BUILD_PROGRESS_HPP
+
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <cstddef>
+
+#include "instrumentation.hpp"
+
+/**
+ * @file build_progress.hpp
+ * @brief Progress reporting and cancellation for building HNSW indices.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * Phase of the construction of an HNSW index.
+ *
+ * - `CONVERSION`: copying the input data into the index or into a temporary buffer, e.g., for `HnswOptions::insertion_order`.
+ *   When observations are inserted one at a time in their input order, each observation is converted immediately before its insertion, so this time is included in `INSERTION` instead.
+ * - `INSERTION`: inserting observations into the graph, either one at a time or in waves (see `HnswOptions::wave_size`).
+ * - `NN_DESCENT`: building the NN-descent graph, see `HnswOptions::nn_descent_iterations`.
+ * - `LINKING`: constructing the base layer from a neighbor graph, i.e., from NN-descent or from existing neighbors.
+ * - `REFINEMENT`: refining the base layer, see `HnswOptions::refine`.
+ * - `ENTRY_POINTS`: choosing the entry points, see `HnswOptions::num_entry_points`.
+ * - `FINALIZATION`: compacting the link lists and setting the search parameters.
+ */
+enum class BuildPhase : char { CONVERSION, INSERTION, NN_DESCENT, LINKING, REFINEMENT, ENTRY_POINTS, FINALIZATION };
+
+/**
+ * @brief Progress of the construction of an HNSW index.
+ */
+struct HnswBuildProgress {
+    /**
+     * Current phase of construction.
+     */
+    BuildPhase phase = BuildPhase::CONVERSION;
+
+    /**
+     * Number of units of work that have been completed in the current phase.
+     * For `BuildPhase::CONVERSION` and `BuildPhase::INSERTION`, this is the number of observations;
+     * for `BuildPhase::NN_DESCENT`, this is the number of iterations;
+     * and for all other phases, this is 1 if the phase is finished and 0 otherwise.
+     */
+    std::size_t completed = 0;
+
+    /**
+     * Total number of units of work in the current phase.
+     */
+    std::size_t total = 0;
+
+    /**
+     * Time elapsed since the start of the current phase, in seconds.
+     */
+    double seconds = 0;
+};
+
+/**
+ * @brief Time spent in each phase of the construction of an HNSW index.
+ *
+ * All times are in seconds.
+ * Phases that were not performed have a time of zero.
+ */
+struct HnswBuildTimings {
+    /**
+     * Time spent in `BuildPhase::CONVERSION`.
+     */
+    double conversion = 0;
+
+    /**
+     * Time spent in `BuildPhase::INSERTION`.
+     */
+    double insertion = 0;
+
+    /**
+     * Time spent in `BuildPhase::NN_DESCENT`.
+     */
+    double nn_descent = 0;
+
+    /**
+     * Time spent in `BuildPhase::LINKING`.
+     */
+    double linking = 0;
+
+    /**
+     * Time spent in `BuildPhase::REFINEMENT`.
+     */
+    double refinement = 0;
+
+    /**
+     * Time spent in `BuildPhase::ENTRY_POINTS`.
+     */
+    double entry_points = 0;
+
+    /**
+     * Time spent in `BuildPhase::FINALIZATION`.
+     */
+    double finalization = 0;
+
+    /**
+     * @return Total time spent building the index.
+     */
+    double total() const {
+        return conversion + insertion + nn_descent + linking + refinement + entry_points + finalization;
+    }
+};
+
+/**
+ * @brief Exception thrown when the construction of an HNSW index is cancelled.
+ *
+ * This is thrown from the constructor of the index when the flag in `HnswOptions::cancel` is set,
+ * in which case all memory allocated for the partially-built index is released.
+ */
+class HnswBuildCancelled : public std::runtime_error {
+public:
+    /**
+     * @cond
+     */
+    HnswBuildCancelled() : std::runtime_error("construction of the HNSW index was cancelled") {}
+    /**
+     * @endcond
+     */
+};
+
+/**
+ * @cond
+ */
+// Tracks the current phase of construction, reporting progress to the
+// callback and checking for cancellation every 'interval' observations.
+class BuildMonitor {
+public:
+    BuildMonitor(const std::function<void(const HnswBuildProgress&)>& callback, std::size_t interval, const std::atomic<bool>* cancel, HnswBuildTimings& timings) :
+        my_callback(callback),
+        my_interval(interval ? interval : 1),
+        my_cancel(cancel),
+        my_timings(timings)
+    {}
+
+private:
+    const std::function<void(const HnswBuildProgress&)>& my_callback;
+    std::size_t my_interval;
+    const std::atomic<bool>* my_cancel;
+    HnswBuildTimings& my_timings;
+
+    bool my_active = false;
+    BuildPhase my_phase = BuildPhase::CONVERSION;
+    std::size_t my_total = 0;
+    std::size_t my_last_reported = 0;
+    std::chrono::steady_clock::time_point my_start;
+
+    double elapsed() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - my_start).count();
+    }
+
+    void check_cancel() const {
+        if (my_cancel && my_cancel->load(std::memory_order_relaxed)) {
+            throw HnswBuildCancelled();
+        }
+    }
+
+    void report(std::size_t completed, double seconds) {
+        my_last_reported = completed;
+        if (my_callback) {
+            HnswBuildProgress progress;
+            progress.phase = my_phase;
+            progress.completed = completed;
+            progress.total = my_total;
+            progress.seconds = seconds;
+            my_callback(progress);
+        }
+    }
+
+    double& timing(BuildPhase phase) {
+        switch (phase) {
+            case BuildPhase::CONVERSION:
+                return my_timings.conversion;
+            case BuildPhase::INSERTION:
+                return my_timings.insertion;
+            case BuildPhase::NN_DESCENT:
+                return my_timings.nn_descent;
+            case BuildPhase::LINKING:
+                return my_timings.linking;
+            case BuildPhase::REFINEMENT:
+                return my_timings.refinement;
+            case BuildPhase::ENTRY_POINTS:
+                return my_timings.entry_points;
+            default:
+                return my_timings.finalization;
+        }
+    }
+
+public:
+    // Finishes the previous phase (if any) and starts a new phase.
+    void begin(BuildPhase phase, std::size_t total) {
+        finish();
+        check_cancel();
+        my_active = true;
+        my_phase = phase;
+        my_total = total;
+        my_start = std::chrono::steady_clock::now();
+#ifdef KNNCOLLE_HNSW_INSTRUMENTATION
+        emit_trace(HnswTraceType::BUILD_PHASE_START, my_phase, 0, 0);
+#endif
+        report(0, 0);
+    }
+
+    void update(std::size_t completed) {
+        // Only observations are counted in intervals, other units are always reported.
+        const bool by_interval = (my_phase == BuildPhase::CONVERSION || my_phase == BuildPhase::INSERTION);
+        if (!by_interval || completed - my_last_reported >= my_interval || completed == my_total) {
+            check_cancel();
+            report(completed, elapsed());
+        }
+    }
+
+    void finish() {
+        if (!my_active) {
+            return;
+        }
+        my_active = false;
+        const double seconds = elapsed();
+        timing(my_phase) += seconds;
+#ifdef KNNCOLLE_HNSW_INSTRUMENTATION
+        emit_trace(HnswTraceType::BUILD_PHASE_END, my_phase, 0, 0);
+#endif
+        if (my_last_reported != my_total) {
+            report(my_total, seconds);
+        }
+    }
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
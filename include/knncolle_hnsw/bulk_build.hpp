@@ -0,0 +1,334 @@
+#ifndef KNNCOLLE_HNSW_BULK_BUILD_HPP
+#define KNNCOLLE_HNSW_BULK_BUILD_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+#include "hnswlib/hnswalg.h"
+#include "sanisizer/sanisizer.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include "wave_build.hpp"
+
+/**
+ * @file bulk_build.hpp
+ * @brief Construction of the HNSW index from an existing nearest neighbor graph.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+template<typename HnswData_>
+void write_level0_links(hnswlib::HierarchicalNSW<HnswData_>& index, hnswlib::tableint i, CandidateQueue<HnswData_>& queue) {
+    auto ll = index.get_linklist0(i);
+    index.setListCount(ll, queue.size());
+    auto data = reinterpret_cast<hnswlib::tableint*>(ll + 1);
+    std::size_t position = queue.size();
+    while (!queue.empty()) { // filling in order of increasing distance.
+        --position;
+        data[position] = queue.top().second;
+        queue.pop();
+    }
+}
+
+// Prunes the candidates in 'queue' down to 'max' neighbors. This uses the
+// relative neighborhood rule of hnswlib's heuristic, relaxed by 'alpha' as
+// in Vamana (Subramanya et al., 2019): a candidate is discarded if it is more
+// than 'alpha' times closer to an already-selected neighbor than to the query.
+// For alpha = 1, this is identical to getNeighborsByHeuristic2().
+template<typename HnswData_>
+void prune_candidates(hnswlib::HierarchicalNSW<HnswData_>& index, CandidateQueue<HnswData_>& queue, std::size_t max, double alpha) {
+    if (alpha == 1) {
+        index.getNeighborsByHeuristic2(queue, max);
+        return;
+    }
+    if (queue.size() < max) {
+        return;
+    }
+
+    std::vector<std::pair<HnswData_, hnswlib::tableint> > ordered;
+    ordered.reserve(queue.size());
+    while (!queue.empty()) {
+        ordered.push_back(queue.top());
+        queue.pop();
+    }
+
+    std::vector<std::pair<HnswData_, hnswlib::tableint> > chosen;
+    chosen.reserve(max);
+    for (auto it = ordered.rbegin(); it != ordered.rend() && chosen.size() < max; ++it) {
+        const auto candidate = index.getDataByInternalId(it->second);
+        bool good = true;
+        for (const auto& other : chosen) {
+            const auto curdist = index.fstdistfunc_(index.getDataByInternalId(other.second), candidate, index.dist_func_param_);
+            if (alpha * curdist < it->first) {
+                good = false;
+                break;
+            }
+        }
+        if (good) {
+            chosen.push_back(*it);
+        }
+    }
+
+    for (const auto& c : chosen) {
+        queue.push(c);
+    }
+}
+
+// Sets the base layer from the selected neighbors of each observation. Reverse
+// links are added to ensure that the graph is navigable, and each list is
+// pruned again if this pushes us past the maximum number of links. As only the
+// observation data is read, the result does not depend on the number of threads.
+template<typename Index_, typename HnswData_>
+void link_base_layer(
+    hnswlib::HierarchicalNSW<HnswData_>& index,
+    Index_ num_obs,
+    const std::vector<std::vector<hnswlib::tableint> >& selected,
+    double alpha,
+    int num_threads)
+{
+    std::vector<std::size_t> rev_ptrs(sanisizer::sum<std::size_t>(num_obs, 1));
+    for (const auto& current : selected) {
+        for (auto j : current) {
+            ++rev_ptrs[j + 1];
+        }
+    }
+    for (Index_ i = 0; i < num_obs; ++i) {
+        rev_ptrs[i + 1] += rev_ptrs[i];
+    }
+    std::vector<hnswlib::tableint> reverse(rev_ptrs.back());
+    {
+        std::vector<std::size_t> fill(rev_ptrs.begin(), rev_ptrs.end() - 1);
+        for (Index_ i = 0; i < num_obs; ++i) {
+            for (auto j : selected[i]) {
+                reverse[fill[j]++] = i;
+            }
+        }
+    }
+
+    knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+        std::vector<hnswlib::tableint> combined;
+        CandidateQueue<HnswData_> queue;
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            combined = selected[i];
+            combined.insert(combined.end(), reverse.begin() + rev_ptrs[i], reverse.begin() + rev_ptrs[i + 1]);
+            std::sort(combined.begin(), combined.end());
+            combined.erase(std::unique(combined.begin(), combined.end()), combined.end());
+
+            const auto query = index.getDataByInternalId(i);
+            for (auto j : combined) {
+                queue.emplace(index.fstdistfunc_(query, index.getDataByInternalId(j), index.dist_func_param_), j);
+            }
+            if (queue.size() > index.maxM0_) {
+                prune_candidates(index, queue, index.maxM0_, alpha);
+            }
+            write_level0_links(index, i, queue);
+        }
+    });
+}
+
+// Refines the base layer of a fully constructed index, in the manner of
+// Vamana's second pass. Each observation's candidates are its current links
+// and the results of a search for itself in the base layer; these are pruned
+// with 'alpha' and then linked as described for link_base_layer().
+template<typename Index_, typename HnswData_>
+void refine_base_layer(hnswlib::HierarchicalNSW<HnswData_>& index, Index_ num_obs, double alpha, int num_threads) {
+    std::vector<std::vector<hnswlib::tableint> > selected(num_obs);
+    knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+        std::vector<hnswlib::tableint> combined;
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            const auto query = index.getDataByInternalId(i);
+            auto found = index.searchBaseLayer(i, query, 0);
+            combined.clear();
+            while (!found.empty()) {
+                combined.push_back(found.top().second);
+                found.pop();
+            }
+
+            auto ll = index.get_linklist0(i);
+            auto size = index.getListCount(ll);
+            auto links = reinterpret_cast<const hnswlib::tableint*>(ll + 1);
+            combined.insert(combined.end(), links, links + size);
+            std::sort(combined.begin(), combined.end());
+            combined.erase(std::unique(combined.begin(), combined.end()), combined.end());
+
+            CandidateQueue<HnswData_> queue;
+            for (auto j : combined) {
+                if (j != static_cast<hnswlib::tableint>(i)) {
+                    queue.emplace(index.fstdistfunc_(query, index.getDataByInternalId(j), index.dist_func_param_), j);
+                }
+            }
+            prune_candidates(index, queue, index.maxM0_, alpha);
+
+            auto& current = selected[i];
+            while (!queue.empty()) {
+                current.push_back(queue.top().second);
+                queue.pop();
+            }
+        }
+    });
+
+    link_base_layer(index, num_obs, selected, alpha, num_threads);
+}
+
+// Adds all observations to an empty index without connecting them, returning
+// the level of each observation in the hierarchy. The upper-layer link lists
+// are allocated from a single arena in 'storage'.
+template<typename Index_, typename HnswData_, class Next_>
+std::vector<int> allocate_nodes(IndexStorage<HnswData_>& storage, Index_ num_obs, std::size_t num_dim, Next_ next) {
+    auto& index = storage.index;
+    auto levels = draw_levels(index, num_obs);
+    LinkArenaCursor<HnswData_> arena(storage, levels);
+    auto buffer = sanisizer::create<std::vector<HnswData_> >(num_dim);
+    for (Index_ i = 0; i < num_obs; ++i) {
+        next(buffer.data());
+        allocate_node(index, i, buffer.data(), levels[i], arena.next(levels[i]));
+    }
+    return levels;
+}
+
+// Same as allocate_nodes(), but 'fill(i, ptr)' writes the data for the 'i'-th
+// observation directly into the level 0 block. This is done in parallel
+// after all nodes are allocated, avoiding a serial copy through a buffer.
+template<typename Index_, typename HnswData_, class Fill_>
+std::vector<int> allocate_nodes_in_place(IndexStorage<HnswData_>& storage, Index_ num_obs, Fill_ fill, int num_threads) {
+    auto& index = storage.index;
+    auto levels = draw_levels(index, num_obs);
+    LinkArenaCursor<HnswData_> arena(storage, levels);
+    for (Index_ i = 0; i < num_obs; ++i) {
+        allocate_node(index, i, static_cast<const HnswData_*>(NULL), levels[i], arena.next(levels[i]));
+    }
+    knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            fill(i, reinterpret_cast<HnswData_*>(index.getDataByInternalId(i)));
+        }
+    });
+    return levels;
+}
+
+// Connects the nodes created by allocate_nodes() using their nearest neighbors.
+// The base layer is constructed directly from the neighbor lists, after
+// pruning each list with prune_candidates() and passing the results to
+// link_base_layer(). Only the sparse upper layers are constructed by insertion.
+template<typename Index_, typename HnswData_, typename Distance_>
+void connect_from_neighbors(
+    hnswlib::HierarchicalNSW<HnswData_>& index,
+    const std::vector<int>& levels,
+    const knncolle::NeighborList<Index_, Distance_>& neighbors,
+    double alpha,
+    int num_threads)
+{
+    const Index_ num_obs = levels.size();
+    if (num_obs == 0) {
+        return;
+    }
+
+    // Pruning each observation's neighbors.
+    std::vector<std::vector<hnswlib::tableint> > selected(num_obs);
+    knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+        CandidateQueue<HnswData_> queue;
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            const auto query = index.getDataByInternalId(i);
+            for (const auto& nn : neighbors[i]) {
+                if (nn.first == i) {
+                    continue;
+                }
+                if (static_cast<std::size_t>(nn.first) >= static_cast<std::size_t>(num_obs)) {
+                    throw std::runtime_error("out-of-range index in the neighbor list");
+                }
+                queue.emplace(index.fstdistfunc_(query, index.getDataByInternalId(nn.first), index.dist_func_param_), nn.first);
+            }
+            prune_candidates(index, queue, index.maxM0_, alpha);
+            auto& current = selected[i];
+            while (!queue.empty()) {
+                current.push_back(queue.top().second);
+                queue.pop();
+            }
+        }
+    });
+
+    link_base_layer(index, num_obs, selected, alpha, num_threads);
+
+    // Building the upper layers by insertion, which only involves a small
+    // subset of observations.
+    bool has_entry = false;
+    for (Index_ i = 0; i < num_obs; ++i) {
+        const int curlevel = levels[i];
+        if (curlevel == 0) {
+            continue;
+        }
+
+        if (!has_entry) {
+            index.enterpoint_node_ = i;
+            index.maxlevel_ = curlevel;
+            has_entry = true;
+            continue;
+        }
+
+        const auto query = index.getDataByInternalId(i);
+        auto currObj = index.enterpoint_node_;
+        auto curdist = index.fstdistfunc_(query, index.getDataByInternalId(currObj), index.dist_func_param_);
+        for (int level = index.maxlevel_; level > curlevel; --level) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                auto data = index.get_linklist(currObj, level);
+                auto size = index.getListCount(data);
+                auto datal = reinterpret_cast<const hnswlib::tableint*>(data + 1);
+                for (I<decltype(size)> c = 0; c < size; ++c) {
+                    auto d = index.fstdistfunc_(query, index.getDataByInternalId(datal[c]), index.dist_func_param_);
+                    if (d < curdist) {
+                        curdist = d;
+                        currObj = datal[c];
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        for (int level = std::min(curlevel, index.maxlevel_); level >= 1; --level) {
+            auto candidates = index.searchBaseLayer(currObj, query, level);
+            currObj = index.mutuallyConnectNewElement(query, i, candidates, level, false);
+        }
+
+        if (curlevel > index.maxlevel_) {
+            index.enterpoint_node_ = i;
+            index.maxlevel_ = curlevel;
+        }
+    }
+
+    if (!has_entry) {
+        index.enterpoint_node_ = 0;
+        index.maxlevel_ = 0;
+    }
+}
+// Fills an empty index from the observations and their nearest neighbors.
+// 'allocate()' should add all observations to the index with allocate_nodes()
+// or allocate_nodes_in_place(), returning the levels.
+template<typename Index_, typename HnswData_, typename Distance_, class Allocate_>
+void insert_from_neighbors(
+    hnswlib::HierarchicalNSW<HnswData_>& index,
+    Index_ num_obs,
+    Allocate_ allocate,
+    const knncolle::NeighborList<Index_, Distance_>& neighbors,
+    double alpha,
+    int num_threads)
+{
+    if (static_cast<std::size_t>(num_obs) != neighbors.size()) {
+        throw std::runtime_error("length of the neighbor list should be equal to the number of observations");
+    }
+    auto levels = allocate();
+    connect_from_neighbors(index, levels, neighbors, alpha, num_threads);
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
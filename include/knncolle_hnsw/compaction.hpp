@@ -0,0 +1,290 @@
+#ifndef KNNCOLLE_HNSW_COMPACTION_HPP
+#define KNNCOLLE_HNSW_COMPACTION_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+
+#include "hnswlib/hnswalg.h"
+#include "sanisizer/sanisizer.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include "utils.hpp"
+#include "index_io.hpp"
+#include "bulk_build.hpp"
+
+/**
+ * @file compaction.hpp
+ * @brief Removal of deleted nodes from an HNSW index.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+// Removes all nodes that were marked as deleted, in two steps. First, the
+// links of each surviving node that point to deleted nodes are repaired, by
+// pruning a candidate set consisting of its surviving neighbors and the
+// surviving neighbors of its deleted neighbors (as in FreshDiskANN). This is
+// done in parallel for all surviving nodes as it only reads the old graph.
+// Survivors that lose all of their incoming links are then re-attached.
+// Second, the level 0 block and the link lists are rebuilt without the
+// deleted nodes. Survivors are renumbered in order of their labels, and each
+// survivor's label is replaced by its new internal ID; the old labels are
+// returned, ordered by the new labels.
+template<typename HnswData_>
+std::vector<hnswlib::labeltype> compact_deleted(IndexStorage<HnswData_>& storage, double alpha, int num_threads) {
+    auto& index = storage.index;
+    const hnswlib::tableint count = index.cur_element_count;
+
+    std::vector<std::pair<hnswlib::labeltype, hnswlib::tableint> > survivors;
+    survivors.reserve(count);
+    for (hnswlib::tableint i = 0; i < count; ++i) {
+        if (!index.isMarkedDeleted(i)) {
+            survivors.emplace_back(index.getExternalLabel(i), i);
+        }
+    }
+    std::sort(survivors.begin(), survivors.end());
+
+    const hnswlib::tableint num_survivors = survivors.size();
+    std::vector<hnswlib::labeltype> old_labels;
+    old_labels.reserve(num_survivors);
+    for (const auto& s : survivors) {
+        old_labels.push_back(s.first);
+    }
+    if (num_survivors == count) {
+        return old_labels;
+    }
+
+    constexpr hnswlib::tableint removed = std::numeric_limits<hnswlib::tableint>::max();
+    std::vector<hnswlib::tableint> remapping(count, removed);
+    for (hnswlib::tableint s = 0; s < num_survivors; ++s) {
+        remapping[survivors[s].second] = s;
+    }
+
+    auto get_links = [&](hnswlib::tableint i, int level) -> hnswlib::linklistsizeint* {
+        return (level == 0 ? index.get_linklist0(i) : index.get_linklist(i, level));
+    };
+
+    // Repairing links to deleted nodes. For each deleted neighbor, we walk
+    // through other deleted nodes to find surviving candidates, as the
+    // immediate neighbors of a deleted node may also have been deleted.
+    const std::size_t max_walk = index.maxM0_;
+    std::vector<std::vector<std::vector<hnswlib::tableint> > > new_links(num_survivors);
+    knncolle::parallelize(num_threads, num_survivors, [&](int, hnswlib::tableint start, hnswlib::tableint length) -> void {
+        std::vector<hnswlib::tableint> combined, walk;
+        CandidateQueue<HnswData_> queue;
+
+        for (hnswlib::tableint s = start, end = start + length; s < end; ++s) {
+            const auto i = survivors[s].second;
+            const int curlevel = index.element_levels_[i];
+            const auto query = index.getDataByInternalId(i);
+            auto& current = new_links[s];
+            current.resize(curlevel + 1);
+
+            for (int level = 0; level <= curlevel; ++level) {
+                auto links = get_links(i, level);
+                auto size = index.getListCount(links);
+                auto neighbors = reinterpret_cast<const hnswlib::tableint*>(links + 1);
+
+                combined.clear();
+                walk.clear();
+                for (I<decltype(size)> n = 0; n < size; ++n) {
+                    const auto x = neighbors[n];
+                    (remapping[x] != removed ? combined : walk).push_back(x);
+                }
+                if (walk.empty()) {
+                    current[level] = combined;
+                    continue;
+                }
+
+                for (std::size_t w = 0; w < walk.size() && w < max_walk; ++w) {
+                    auto dlinks = get_links(walk[w], level);
+                    auto dsize = index.getListCount(dlinks);
+                    auto dneighbors = reinterpret_cast<const hnswlib::tableint*>(dlinks + 1);
+                    for (I<decltype(dsize)> d = 0; d < dsize; ++d) {
+                        const auto candidate = dneighbors[d];
+                        if (candidate == i) {
+                            continue;
+                        }
+                        if (remapping[candidate] != removed) {
+                            combined.push_back(candidate);
+                        } else if (std::find(walk.begin(), walk.end(), candidate) == walk.end()) {
+                            walk.push_back(candidate);
+                        }
+                    }
+                }
+
+                std::sort(combined.begin(), combined.end());
+                combined.erase(std::unique(combined.begin(), combined.end()), combined.end());
+                for (auto c : combined) {
+                    queue.emplace(index.fstdistfunc_(query, index.getDataByInternalId(c), index.dist_func_param_), c);
+                }
+                prune_candidates(index, queue, (level == 0 ? index.maxM0_ : index.maxM_), alpha);
+
+                auto& replacement = current[level];
+                replacement.resize(queue.size());
+                for (auto r = replacement.rbegin(); r != replacement.rend(); ++r) { // filling in order of increasing distance.
+                    *r = queue.top().second;
+                    queue.pop();
+                }
+            }
+        }
+    });
+
+    // Any survivor that only had incoming links from deleted nodes is now
+    // unreachable, so we attach it to the first of its own neighbors that can
+    // take it. If a neighbor's list is full, its last link is replaced, as
+    // long as this does not leave the target of that link unreachable.
+    for (int level = 0; level <= index.maxlevel_; ++level) {
+        const std::size_t max_links = (level == 0 ? index.maxM0_ : index.maxM_);
+        std::vector<hnswlib::tableint> indegree(num_survivors);
+        for (const auto& current : new_links) {
+            if (static_cast<std::size_t>(level) < current.size()) {
+                for (auto x : current[level]) {
+                    ++indegree[remapping[x]];
+                }
+            }
+        }
+
+        for (hnswlib::tableint s = 0; s < num_survivors; ++s) {
+            const auto i = survivors[s].second;
+            if (indegree[s] || static_cast<std::size_t>(level) >= new_links[s].size() || i == index.enterpoint_node_) {
+                continue;
+            }
+            for (auto x : new_links[s][level]) {
+                auto& target = new_links[remapping[x]][level];
+                if (target.size() < max_links) {
+                    target.push_back(i);
+                } else {
+                    auto& furthest = indegree[remapping[target.back()]];
+                    if (furthest <= 1) {
+                        continue;
+                    }
+                    --furthest;
+                    target.back() = i;
+                }
+                ++indegree[s];
+                break;
+            }
+        }
+    }
+
+    // Allocating new memory before touching the index, for exception safety.
+    const std::size_t level0_size = sanisizer::product<std::size_t>(std::max(num_survivors, static_cast<hnswlib::tableint>(1)), index.size_data_per_element_);
+    const auto old_level0 = index.data_level0_memory_;
+    const bool old_borrowed = storage.level0_borrowed;
+    const std::size_t old_mapped = storage.level0_mapped;
+    storage.level0_borrowed = false;
+    storage.level0_mapped = 0;
+    char* new_level0;
+    try {
+        new_level0 = allocate_level0(storage, level0_size, storage.placement);
+    } catch (...) {
+        storage.level0_borrowed = old_borrowed;
+        storage.level0_mapped = old_mapped;
+        throw;
+    }
+
+    std::size_t arena_size = 0;
+    for (const auto& s : survivors) {
+        const auto level = index.element_levels_[s.second];
+        if (level > 0) {
+            arena_size += sanisizer::product<std::size_t>(index.size_links_per_element_, level);
+        }
+    }
+    std::unique_ptr<char[]> new_arena(arena_size ? new char[arena_size] : NULL);
+    std::vector<char*> new_link_lists(num_survivors);
+    std::vector<int> new_levels(num_survivors);
+
+    auto fill_links = [&](hnswlib::linklistsizeint* dest, hnswlib::tableint s, int level) -> void {
+        const auto& current = new_links[s][level];
+        index.setListCount(dest, current.size());
+        auto output = reinterpret_cast<hnswlib::tableint*>(dest + 1);
+        for (auto x : current) {
+            *output = remapping[x];
+            ++output;
+        }
+    };
+
+    std::size_t position = 0;
+    for (hnswlib::tableint s = 0; s < num_survivors; ++s) {
+        const auto i = survivors[s].second;
+        char* dest = new_level0 + sanisizer::product_unsafe<std::size_t>(s, index.size_data_per_element_);
+        std::memcpy(dest, old_level0 + sanisizer::product_unsafe<std::size_t>(i, index.size_data_per_element_), index.size_data_per_element_);
+        fill_links(reinterpret_cast<hnswlib::linklistsizeint*>(dest + index.offsetLevel0_), s, 0);
+        const hnswlib::labeltype new_label = s;
+        std::memcpy(dest + index.label_offset_, &new_label, sizeof(hnswlib::labeltype));
+
+        const int level = index.element_levels_[i];
+        new_levels[s] = level;
+        if (level > 0) {
+            char* upper = new_arena.get() + position;
+            new_link_lists[s] = upper;
+            for (int l = 1; l <= level; ++l) {
+                fill_links(reinterpret_cast<hnswlib::linklistsizeint*>(upper + (l - 1) * index.size_links_per_element_), s, l);
+            }
+            position += index.size_links_per_element_ * level;
+        }
+    }
+
+    // Choosing a new entry point if the old one was deleted.
+    hnswlib::tableint new_entry = removed;
+    int new_maxlevel = -1;
+    if (num_survivors) {
+        if (remapping[index.enterpoint_node_] != removed) {
+            new_entry = remapping[index.enterpoint_node_];
+            new_maxlevel = index.maxlevel_;
+        } else {
+            new_entry = std::max_element(new_levels.begin(), new_levels.end()) - new_levels.begin();
+            new_maxlevel = new_levels[new_entry];
+        }
+    }
+
+    // Releasing the old memory and switching to the new structures.
+    if (!storage.link_lists_external) {
+        for (hnswlib::tableint i = 0; i < count; ++i) {
+            if (index.element_levels_[i] > 0) {
+                std::free(index.linkLists_[i]);
+            }
+        }
+    }
+    if (old_mapped) {
+        unmap_level0(old_level0, old_mapped);
+    } else if (!old_borrowed) {
+        std::free(old_level0);
+    }
+
+    index.data_level0_memory_ = new_level0;
+    for (hnswlib::tableint s = 0; s < num_survivors; ++s) {
+        index.linkLists_[s] = new_link_lists[s];
+        index.element_levels_[s] = new_levels[s];
+    }
+    storage.link_arena = std::move(new_arena);
+    storage.link_lists_external = true;
+
+    index.label_lookup_.clear();
+    for (hnswlib::tableint s = 0; s < num_survivors; ++s) {
+        index.label_lookup_[s] = s;
+    }
+    index.cur_element_count = num_survivors;
+    index.max_elements_ = num_survivors;
+    index.num_deleted_ = 0;
+    index.deleted_elements.clear();
+    index.enterpoint_node_ = new_entry;
+    index.maxlevel_ = new_maxlevel;
+
+    return old_labels;
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
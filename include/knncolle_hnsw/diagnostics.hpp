@@ -0,0 +1,222 @@
+#ifndef KNNCOLLE_HNSW_DIAGNOSTICS_HPP
+#define KNNCOLLE_HNSW_DIAGNOSTICS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <cstddef>
+
+#include "hnswlib/hnswalg.h"
+#include "sanisizer/sanisizer.hpp"
+
+#include "utils.hpp"
+
+/**
+ * @file diagnostics.hpp
+ * @brief Diagnostics for the quality and memory usage of an HNSW index.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @brief Options for `HnswPrebuilt::diagnose()`.
+ */
+struct HnswDiagnosticsOptions {
+    /**
+     * Number of observations to use for estimating the recall against a brute-force search.
+     * Observations are chosen at evenly spaced indices.
+     * If zero, the recall is not computed.
+     * Each sampled observation requires a pass over the entire dataset, so this should be kept small for large indices.
+     */
+    std::size_t num_recall_samples = 0;
+
+    /**
+     * Number of nearest neighbors to use for computing the recall.
+     * This should be positive if `HnswDiagnosticsOptions::num_recall_samples` is positive, otherwise it is ignored.
+     */
+    int num_neighbors = 10;
+
+    /**
+     * Number of threads to use for computing the recall.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @brief Diagnostics for a single layer of the HNSW graph.
+ */
+struct HnswLayerDiagnostics {
+    /**
+     * Number of nodes in this layer.
+     */
+    std::size_t num_nodes = 0;
+
+    /**
+     * Histogram of the number of links for each node in this layer.
+     * The `i`-th entry contains the number of nodes with `i` links.
+     * The length is equal to the maximum number of links plus 1.
+     */
+    std::vector<std::size_t> degree_histogram;
+
+    /**
+     * Number of nodes in this layer that cannot be reached from the entry point by following links in this layer.
+     * Such nodes will never be reported in a search that only traverses this layer.
+     */
+    std::size_t num_unreachable = 0;
+};
+
+/**
+ * @brief Memory usage of an HNSW index, in bytes.
+ */
+struct HnswMemoryUsage {
+    /**
+     * Size of the level 0 block, containing the base-layer links, the observation data and the labels.
+     */
+    std::size_t level0 = 0;
+
+    /**
+     * Total size of the link lists for the upper layers.
+     */
+    std::size_t link_lists = 0;
+
+    /**
+     * Size of the per-node bookkeeping, i.e., the pointers to the link lists, the levels and the locks.
+     */
+    std::size_t node_bookkeeping = 0;
+
+    /**
+     * Size of the map from labels to internal identifiers.
+     * This is an estimate as the exact size depends on the standard library's implementation of `std::unordered_map`.
+     */
+    std::size_t label_map = 0;
+
+    /**
+     * Size of a single visited list in **hnswlib**'s shared pool.
+     * The pool contains one visited list for each search that is running concurrently, so this should be multiplied by the number of threads.
+     * The pool is only used during index construction and by `HnswPrebuilt::search_interleaved()`.
+     */
+    std::size_t visited_list = 0;
+
+    /**
+     * Size of the visited set owned by each searcher, for a search with the index's `HnswOptions::ef_search`.
+     * This depends on the `VisitedSetType` used by the index, and should be multiplied by the number of searchers that exist at any given time.
+     * For `VisitedSetType::EPOCH`, this is equal to `HnswMemoryUsage::visited_list`;
+     * for `VisitedSetType::HASH`, this is the initial size of the hash set, which may grow if a search visits more nodes than expected.
+     * Not included in `total()`.
+     */
+    std::size_t visited_per_searcher = 0;
+
+    /**
+     * @return Total memory usage, assuming that a single visited list is present.
+     */
+    std::size_t total() const {
+        return level0 + link_lists + node_bookkeeping + label_map + visited_list;
+    }
+};
+
+/**
+ * @brief Diagnostics for an HNSW index.
+ */
+struct HnswDiagnostics {
+    /**
+     * Diagnostics for each layer, starting from the base layer.
+     */
+    std::vector<HnswLayerDiagnostics> layers;
+
+    /**
+     * Level of the entry point, i.e., the highest layer of the graph.
+     * This is set to -1 if the index is empty.
+     */
+    int entry_point_level = -1;
+
+    /**
+     * Memory usage of the index.
+     */
+    HnswMemoryUsage memory;
+
+    /**
+     * Proportion of the true nearest neighbors (from a brute-force search) that are reported by a search of the index, averaged across the sampled observations.
+     * A reported neighbor is considered to be correct if its distance is no greater than that of the true `k`-th nearest neighbor, to account for ties.
+     * This is set to NaN if `HnswDiagnosticsOptions::num_recall_samples` is zero.
+     */
+    double recall = std::numeric_limits<double>::quiet_NaN();
+};
+
+/**
+ * @cond
+ */
+template<typename HnswData_>
+void diagnose_graph(const hnswlib::HierarchicalNSW<HnswData_>& index, HnswDiagnostics& output) {
+    const std::size_t count = index.cur_element_count;
+
+    auto& mem = output.memory;
+    mem.level0 = sanisizer::product<std::size_t>(index.max_elements_, index.size_data_per_element_);
+    mem.node_bookkeeping = sanisizer::product<std::size_t>(index.max_elements_, sizeof(void*) + sizeof(int) + sizeof(std::mutex));
+    mem.label_map = index.label_lookup_.bucket_count() * sizeof(void*) +
+        index.label_lookup_.size() * (sizeof(std::pair<const hnswlib::labeltype, hnswlib::tableint>) + 2 * sizeof(void*));
+    mem.visited_list = sanisizer::product<std::size_t>(index.max_elements_, sizeof(hnswlib::vl_type));
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto level = index.element_levels_[i];
+        if (level > 0) {
+            mem.link_lists += index.size_links_per_element_ * level;
+        }
+    }
+
+    if (count == 0) {
+        return;
+    }
+    output.entry_point_level = index.maxlevel_;
+    output.layers.resize(index.maxlevel_ + 1);
+
+    std::vector<char> reached(count);
+    std::vector<hnswlib::tableint> stack;
+    for (int level = 0; level <= index.maxlevel_; ++level) {
+        auto& layer = output.layers[level];
+        auto get_links = [&](hnswlib::tableint i) -> hnswlib::linklistsizeint* {
+            return (level == 0 ? index.get_linklist0(i) : index.get_linklist(i, level));
+        };
+
+        layer.degree_histogram.resize((level == 0 ? index.maxM0_ : index.maxM_) + 1);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (index.element_levels_[i] >= level) {
+                ++layer.num_nodes;
+                auto size = index.getListCount(get_links(i));
+                if (size >= layer.degree_histogram.size()) {
+                    layer.degree_histogram.resize(size + 1);
+                }
+                ++layer.degree_histogram[size];
+            }
+        }
+
+        // Depth-first traversal from the entry point, which is present in all layers.
+        std::fill(reached.begin(), reached.end(), 0);
+        reached[index.enterpoint_node_] = 1;
+        stack.clear();
+        stack.push_back(index.enterpoint_node_);
+        std::size_t num_reached = 1;
+        while (!stack.empty()) {
+            const auto current = stack.back();
+            stack.pop_back();
+            auto links = get_links(current);
+            auto size = index.getListCount(links);
+            auto neighbors = reinterpret_cast<const hnswlib::tableint*>(links + 1);
+            for (I<decltype(size)> n = 0; n < size; ++n) {
+                const auto next = neighbors[n];
+                if (!reached[next]) {
+                    reached[next] = 1;
+                    ++num_reached;
+                    stack.push_back(next);
+                }
+            }
+        }
+        layer.num_unreachable = layer.num_nodes - num_reached;
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <functional>
 #include <cstddef>
+#include <cmath>
+#include <string>
 #include <type_traits>
 
 /**
@@ -44,8 +46,75 @@ struct DistanceConfig {
      * This must be provided if `normalize_method = DistanceNormalizeMethod::CUSTOM`, otherwise it is ignored.
      */
     std::function<Distance_(Distance_)> custom_normalize;
+
+    /**
+     * Normalization function that is applied to all distances for a single query at once.
+     * The first argument is the number of distances, and the second argument is a pointer to an array of distances to be normalized in place.
+     * If provided, this is used instead of `custom_normalize` during searches, avoiding a call through `std::function` for every distance.
+     * Users can create this from an inlineable functor via `block_normalize()`.
+     * Only used if `normalize_method = DistanceNormalizeMethod::CUSTOM`, in which case at least one of `custom_normalize` or `custom_normalize_block` should be provided.
+     */
+    std::function<void(std::size_t, Distance_*)> custom_normalize_block;
 };
 
+/**
+ * Create a block normalization function for `DistanceConfig::custom_normalize_block`.
+ * The loop over distances is compiled along with `normalize`, allowing the latter to be inlined (and possibly vectorized) by the compiler.
+ *
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam Normalize_ Functor that accepts a `Distance_` and returns the normalized distance.
+ *
+ * @param normalize Functor to normalize a single distance.
+ * @return Function to normalize an array of distances in place.
+ */
+template<typename Distance_, class Normalize_>
+std::function<void(std::size_t, Distance_*)> block_normalize(Normalize_ normalize) {
+    return [normalize](std::size_t n, Distance_* distances) -> void {
+        for (std::size_t i = 0; i < n; ++i) {
+            distances[i] = normalize(distances[i]);
+        }
+    };
+}
+
+/**
+ * @cond
+ */
+// Normalizes a contiguous block of 'num' distances in place, e.g., all
+// results for a single query or for a batch of queries. Note that compilers
+// will only vectorize the loop for SQRT if errno handling is disabled, e.g.,
+// with -fno-math-errno, as std::sqrt() must otherwise set errno for negative
+// inputs. A block function for CUSTOM is called once for the entire block.
+template<typename Distance_>
+void normalize_distance_block(
+    DistanceNormalizeMethod method,
+    const std::function<Distance_(Distance_)>& custom_normalize,
+    const std::function<void(std::size_t, Distance_*)>& custom_normalize_block,
+    std::size_t num,
+    Distance_* ptr)
+{
+    switch(method) {
+        case DistanceNormalizeMethod::SQRT:
+            for (std::size_t i = 0; i < num; ++i) {
+                ptr[i] = std::sqrt(ptr[i]);
+            }
+            break;
+        case DistanceNormalizeMethod::CUSTOM:
+            if (custom_normalize_block) {
+                custom_normalize_block(num, ptr);
+            } else {
+                for (std::size_t i = 0; i < num; ++i) {
+                    ptr[i] = custom_normalize(ptr[i]);
+                }
+            }
+            break;
+        case DistanceNormalizeMethod::NONE:
+            break;
+    }
+}
+/**
+ * @endcond
+ */
+
 /**
  * @brief Manhattan distance. 
  *
@@ -221,6 +290,28 @@ const char* get_distance_name(const hnswlib::SpaceInterface<HnswData_>* distance
     }
 }
 
+/**
+ * @cond
+ */
+// Inverse of get_distance_name(), returning NULL for unknown names.
+template<typename HnswData_>
+hnswlib::SpaceInterface<HnswData_>* create_known_distance(const std::string& method, std::size_t dim) {
+    if constexpr(std::is_same<HnswData_, float>::value) {
+        if (method == "l2") {
+            return static_cast<hnswlib::SpaceInterface<HnswData_>*>(new hnswlib::L2Space(dim));
+        }
+    }
+    if (method == "squared_euclidean") {
+        return static_cast<hnswlib::SpaceInterface<HnswData_>*>(new SquaredEuclideanDistance<HnswData_>(dim));
+    } else if (method == "manhattan") {
+        return static_cast<hnswlib::SpaceInterface<HnswData_>*>(new ManhattanDistance<HnswData_>(dim));
+    }
+    return NULL;
+}
+/**
+ * @endcond
+ */
+
 }
 
 #endif
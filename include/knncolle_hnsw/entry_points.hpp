@@ -0,0 +1,172 @@
+#ifndef KNNCOLLE_HNSW_ENTRY_POINTS_HPP
+#define KNNCOLLE_HNSW_ENTRY_POINTS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+#include <stdexcept>
+#include <filesystem>
+
+#include "hnswlib/hnswalg.h"
+#include "sanisizer/sanisizer.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include "utils.hpp"
+
+/**
+ * @file entry_points.hpp
+ * @brief Cluster-based entry points into the base layer of an HNSW index.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+// Chooses up to 'num_entries' nodes as entry points into the base layer, by
+// running k-means on the data in the index and picking the node closest to
+// each centroid. Assignments use the index's own distance function so that
+// the entry points are sensible for non-Euclidean metrics, while the
+// centroids are just the means of the assigned nodes. The centroids are
+// initialized from evenly spaced nodes, so the result is deterministic and
+// does not depend on the number of threads.
+template<typename HnswData_>
+std::vector<hnswlib::tableint> choose_entry_points(const hnswlib::HierarchicalNSW<HnswData_>& index, std::size_t num_dim, std::size_t num_entries, int num_iterations, int num_threads) {
+    const hnswlib::tableint count = index.cur_element_count;
+    const std::size_t num_centers = std::min(num_entries, static_cast<std::size_t>(count));
+    std::vector<hnswlib::tableint> output;
+    if (num_centers == 0) {
+        return output;
+    }
+
+    auto get_data = [&](hnswlib::tableint i) -> const HnswData_* {
+        return reinterpret_cast<const HnswData_*>(index.getDataByInternalId(i));
+    };
+    auto distance = [&](const HnswData_* x, const HnswData_* y) -> HnswData_ {
+        return index.fstdistfunc_(x, y, index.dist_func_param_);
+    };
+
+    auto centroids = sanisizer::create<std::vector<HnswData_> >(sanisizer::product<std::size_t>(num_centers, num_dim));
+    for (std::size_t c = 0; c < num_centers; ++c) {
+        const hnswlib::tableint chosen = sanisizer::product_unsafe<std::size_t>(c, count) / num_centers;
+        std::copy_n(get_data(chosen), num_dim, centroids.begin() + sanisizer::product_unsafe<std::size_t>(c, num_dim));
+    }
+
+    auto get_centroid = [&](std::size_t c) -> HnswData_* {
+        return centroids.data() + sanisizer::product_unsafe<std::size_t>(c, num_dim);
+    };
+    auto assign = [&](std::vector<std::size_t>& assignment) -> void {
+        knncolle::parallelize(num_threads, count, [&](int, hnswlib::tableint start, hnswlib::tableint length) -> void {
+            for (hnswlib::tableint i = start, end = start + length; i < end; ++i) {
+                const auto ptr = get_data(i);
+                std::size_t best = 0;
+                auto best_dist = distance(ptr, get_centroid(0));
+                for (std::size_t c = 1; c < num_centers; ++c) {
+                    const auto d = distance(ptr, get_centroid(c));
+                    if (d < best_dist) {
+                        best_dist = d;
+                        best = c;
+                    }
+                }
+                assignment[i] = best;
+            }
+        });
+    };
+
+    std::vector<std::size_t> assignment(count);
+    std::vector<double> sums(centroids.size());
+    std::vector<std::size_t> sizes(num_centers);
+    for (int it = 0; it < num_iterations; ++it) {
+        assign(assignment);
+
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(sizes.begin(), sizes.end(), 0);
+        for (hnswlib::tableint i = 0; i < count; ++i) {
+            const auto c = assignment[i];
+            ++sizes[c];
+            const auto ptr = get_data(i);
+            auto sptr = sums.data() + sanisizer::product_unsafe<std::size_t>(c, num_dim);
+            for (std::size_t d = 0; d < num_dim; ++d) {
+                sptr[d] += ptr[d];
+            }
+        }
+
+        for (std::size_t c = 0; c < num_centers; ++c) {
+            if (sizes[c] == 0) { // leaving empty clusters where they are.
+                continue;
+            }
+            auto cptr = get_centroid(c);
+            auto sptr = sums.data() + sanisizer::product_unsafe<std::size_t>(c, num_dim);
+            for (std::size_t d = 0; d < num_dim; ++d) {
+                cptr[d] = sptr[d] / sizes[c];
+            }
+        }
+    }
+
+    // Picking the closest node to each centroid, among those assigned to it.
+    assign(assignment);
+    constexpr auto unassigned = std::numeric_limits<hnswlib::tableint>::max();
+    std::vector<hnswlib::tableint> closest(num_centers, unassigned);
+    std::vector<HnswData_> closest_dist(num_centers);
+    for (hnswlib::tableint i = 0; i < count; ++i) {
+        const auto c = assignment[i];
+        const auto d = distance(get_data(i), get_centroid(c));
+        if (closest[c] == unassigned || d < closest_dist[c]) {
+            closest[c] = i;
+            closest_dist[c] = d;
+        }
+    }
+
+    for (auto x : closest) {
+        if (x != unassigned) {
+            output.push_back(x);
+        }
+    }
+    return output;
+}
+
+inline void check_entry_points(const std::vector<hnswlib::tableint>& entries, std::size_t count) {
+    for (auto e : entries) {
+        if (e >= count) {
+            throw std::runtime_error("entry points should refer to nodes in the HNSW index");
+        }
+    }
+}
+
+// Indices saved before entry points were introduced (or without any entry
+// points) will not have the file, in which case we use the global entry point.
+inline void load_entry_points(const std::filesystem::path& path, std::vector<hnswlib::tableint>& entries) {
+    entries.clear();
+    if (!std::filesystem::exists(path)) {
+        return;
+    }
+    const auto size = std::filesystem::file_size(path);
+    if (size % sizeof(hnswlib::tableint) != 0) {
+        throw std::runtime_error("size of '" + path.string() + "' should be a multiple of the node identifier size");
+    }
+    sanisizer::resize(entries, size / sizeof(hnswlib::tableint));
+    knncolle::quick_load(path, entries.data(), entries.size());
+}
+
+// Returns the entry point that is closest to 'query', along with its distance.
+template<typename HnswData_>
+std::pair<hnswlib::tableint, HnswData_> closest_entry_point(const hnswlib::HierarchicalNSW<HnswData_>& index, const std::vector<hnswlib::tableint>& entries, const HnswData_* query) {
+    std::pair<hnswlib::tableint, HnswData_> output(entries.front(), index.fstdistfunc_(query, index.getDataByInternalId(entries.front()), index.dist_func_param_));
+    for (I<decltype(entries.size())> e = 1, num = entries.size(); e < num; ++e) {
+        const auto d = index.fstdistfunc_(query, index.getDataByInternalId(entries[e]), index.dist_func_param_);
+        if (d < output.second) {
+            output.first = entries[e];
+            output.second = d;
+        }
+    }
+    return output;
+}
+
+/**
+ * @endcond
+ */
+
+}
+
+#endif
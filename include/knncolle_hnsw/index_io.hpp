@@ -0,0 +1,482 @@
+#ifndef KNNCOLLE_HNSW_INDEX_IO_HPP
+#define KNNCOLLE_HNSW_INDEX_IO_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+#include "hnswlib/hnswalg.h"
+#include "sanisizer/sanisizer.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include "placement.hpp"
+
+/**
+ * @file index_io.hpp
+ * @brief Low-level reading and writing of the **hnswlib** index.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+// Alignment of the level 0 block in serialized buffers, chosen to match a cache line.
+inline constexpr std::size_t serialized_level0_alignment = 64;
+
+// Size of the header fields written by hnswlib::HierarchicalNSW::saveIndex().
+inline constexpr std::size_t index_header_size = sizeof(std::size_t) * 10 + sizeof(int) + sizeof(hnswlib::tableint) + sizeof(double);
+
+template<typename HnswData_, class Write_>
+void write_index(const hnswlib::HierarchicalNSW<HnswData_>& index, Write_& write) {
+    auto write_pod = [&](const auto& x) -> void {
+        write(reinterpret_cast<const char*>(&x), sizeof(x));
+    };
+
+    // Same layout as hnswlib::HierarchicalNSW::saveIndex(), so that the
+    // output is interchangeable with an INDEX file produced by save().
+    write_pod(index.offsetLevel0_);
+    write_pod(index.max_elements_);
+    const std::size_t count = index.cur_element_count;
+    write_pod(count);
+    write_pod(index.size_data_per_element_);
+    write_pod(index.label_offset_);
+    write_pod(index.offsetData_);
+    write_pod(index.maxlevel_);
+    write_pod(index.enterpoint_node_);
+    write_pod(index.maxM_);
+
+    write_pod(index.maxM0_);
+    write_pod(index.M_);
+    write_pod(index.mult_);
+    write_pod(index.ef_construction_);
+
+    write(index.data_level0_memory_, sanisizer::product<std::size_t>(count, index.size_data_per_element_));
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto level = index.element_levels_[i];
+        unsigned int link_list_size = (level > 0 ? index.size_links_per_element_ * level : 0);
+        write_pod(link_list_size);
+        if (link_list_size) {
+            write(index.linkLists_[i], link_list_size);
+        }
+    }
+}
+
+class SerializedReader {
+public:
+    SerializedReader(const char* buffer, std::size_t size) : my_buffer(buffer), my_remaining(size) {}
+
+private:
+    const char* my_buffer;
+    std::size_t my_remaining;
+
+public:
+    static constexpr bool can_borrow = true;
+
+    const char* borrow(std::size_t n) {
+        if (n > my_remaining) {
+            throw std::runtime_error("serialized HNSW index is truncated");
+        }
+        auto output = my_buffer;
+        my_buffer += n;
+        my_remaining -= n;
+        return output;
+    }
+
+    void read(void* dest, std::size_t n) {
+        auto src = borrow(n);
+        std::memcpy(dest, src, n);
+    }
+
+    std::size_t remaining() const {
+        return my_remaining;
+    }
+};
+
+class FileReader {
+public:
+    FileReader(const std::filesystem::path& path, int num_threads, std::size_t chunk_size) :
+        my_path(path),
+        my_stream(path, std::ios::binary),
+        my_num_threads(num_threads),
+        my_chunk_size(std::max(chunk_size, static_cast<std::size_t>(1)))
+    {
+        if (!my_stream) {
+            throw std::runtime_error("failed to open '" + my_path.string() + "'");
+        }
+        my_size = std::filesystem::file_size(my_path);
+    }
+
+private:
+    std::filesystem::path my_path;
+    std::ifstream my_stream;
+    int my_num_threads;
+    std::size_t my_chunk_size;
+    std::size_t my_size;
+    std::size_t my_position = 0;
+
+public:
+    static constexpr bool can_borrow = false;
+
+    void read(void* dest, std::size_t n) {
+        if (n > remaining()) {
+            throw std::runtime_error("HNSW index file '" + my_path.string() + "' is truncated");
+        }
+        auto cdest = static_cast<char*>(dest);
+
+        if (my_num_threads > 1 && n > my_chunk_size) {
+            // Each worker opens its own stream and reads a contiguous run of chunks.
+            const std::size_t num_chunks = n / my_chunk_size + (n % my_chunk_size > 0);
+            knncolle::parallelize(my_num_threads, num_chunks, [&](int, std::size_t start, std::size_t length) -> void {
+                std::ifstream input(my_path, std::ios::binary);
+                const std::size_t first = start * my_chunk_size;
+                const std::size_t last = std::min(n, (start + length) * my_chunk_size);
+                input.seekg(static_cast<std::streamoff>(my_position + first));
+                input.read(cdest + first, last - first);
+                if (!input) {
+                    throw std::runtime_error("failed to read from '" + my_path.string() + "'");
+                }
+            });
+            my_position += n;
+            my_stream.seekg(static_cast<std::streamoff>(my_position));
+
+        } else {
+            my_stream.read(cdest, n);
+            if (!my_stream) {
+                throw std::runtime_error("failed to read from '" + my_path.string() + "'");
+            }
+            my_position += n;
+        }
+    }
+
+    std::size_t remaining() const {
+        return my_size - my_position;
+    }
+};
+
+// Tracks memory in the index that was not allocated by hnswlib itself, and
+// detaches it before hnswlib's destructor tries to free it. This should be
+// declared after the index so that it is destroyed first.
+template<typename HnswData_>
+class IndexStorage {
+public:
+    IndexStorage(hnswlib::HierarchicalNSW<HnswData_>& index) : index(index) {}
+
+    IndexStorage(const IndexStorage&) = delete;
+    IndexStorage& operator=(const IndexStorage&) = delete;
+
+    ~IndexStorage() {
+        detach();
+    }
+
+public:
+    hnswlib::HierarchicalNSW<HnswData_>& index;
+    bool level0_borrowed = false;
+    std::size_t level0_mapped = 0;
+    bool link_lists_external = false;
+    std::unique_ptr<char[]> link_arena;
+    Level0Placement placement; // remembered for reallocations, e.g., in compaction.
+
+public:
+    void detach() {
+        if (level0_borrowed) {
+            index.data_level0_memory_ = NULL;
+            level0_borrowed = false;
+        }
+        if (level0_mapped) {
+            unmap_level0(index.data_level0_memory_, level0_mapped);
+            index.data_level0_memory_ = NULL;
+            level0_mapped = 0;
+        }
+        if (link_lists_external) {
+            // Skips the per-node frees in hnswlib::HierarchicalNSW::clear().
+            index.cur_element_count = 0;
+            link_lists_external = false;
+        }
+    }
+};
+
+// Allocates the level 0 block according to 'placement', falling back to
+// malloc() if no special placement is requested or possible.
+template<typename HnswData_>
+char* allocate_level0(IndexStorage<HnswData_>& storage, std::size_t size, const Level0Placement& placement) {
+    storage.placement = placement;
+    std::size_t mapped_size = 0;
+    auto mapped = map_level0(size, placement, mapped_size);
+    if (mapped) {
+        storage.level0_mapped = mapped_size;
+        return mapped;
+    }
+    auto ptr = static_cast<char*>(std::malloc(size));
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+// Replaces the level 0 block of a freshly constructed (and still empty)
+// index with one that satisfies 'placement'. This avoids a copy as the
+// block has not been filled yet.
+template<typename HnswData_>
+void place_level0(IndexStorage<HnswData_>& storage, const Level0Placement& placement) {
+    storage.placement = placement;
+    auto& index = storage.index;
+    std::size_t mapped_size = 0;
+    auto mapped = map_level0(sanisizer::product<std::size_t>(index.max_elements_, index.size_data_per_element_), placement, mapped_size);
+    if (mapped) {
+        std::free(index.data_level0_memory_);
+        index.data_level0_memory_ = mapped;
+        storage.level0_mapped = mapped_size;
+    }
+}
+
+// Replaces a borrowed level 0 block with a copy, so that it can be modified.
+template<typename HnswData_>
+void own_level0(IndexStorage<HnswData_>& storage) {
+    if (!storage.level0_borrowed) {
+        return;
+    }
+    auto& index = storage.index;
+    const std::size_t size = sanisizer::product<std::size_t>(index.max_elements_, index.size_data_per_element_);
+    if (size == 0) {
+        index.data_level0_memory_ = NULL;
+        storage.level0_borrowed = false;
+        return;
+    }
+    auto copy = allocate_level0(storage, size, storage.placement);
+    std::memcpy(copy, index.data_level0_memory_, size);
+    index.data_level0_memory_ = copy;
+    storage.level0_borrowed = false;
+}
+
+// Reserves a single arena in 'storage' for the upper-layer link lists of all
+// nodes to be added to a freshly constructed index, given their 'levels' in
+// order of insertion. Each node's link lists are then handed out by next(),
+// which avoids hnswlib's per-node malloc() during construction as well as the
+// copy in compact_link_lists() afterwards.
+template<typename HnswData_>
+class LinkArenaCursor {
+public:
+    LinkArenaCursor(IndexStorage<HnswData_>& storage, const std::vector<int>& levels) : my_size(storage.index.size_links_per_element_) {
+        std::size_t total = 0;
+        for (auto level : levels) {
+            if (level > 0) {
+                total += sanisizer::product<std::size_t>(my_size, level);
+            }
+        }
+        storage.link_arena.reset(total ? new char[total] : NULL);
+        storage.link_lists_external = true;
+        my_next = storage.link_arena.get();
+        my_remaining = total;
+    }
+
+private:
+    std::size_t my_size;
+    char* my_next;
+    std::size_t my_remaining;
+
+public:
+    char* next(int level) {
+        if (level <= 0) {
+            return NULL;
+        }
+        const std::size_t size = my_size * level;
+        if (size > my_remaining) {
+            throw std::runtime_error("insufficient space reserved for the link lists");
+        }
+        auto output = my_next;
+        my_next += size;
+        my_remaining -= size;
+        return output;
+    }
+};
+
+// Moves the upper-layer link lists of a freshly built index into a single
+// arena in 'storage', if they were allocated separately by hnswlib's
+// addPoint(). This reduces fragmentation and replaces the per-node frees on
+// destruction with a single release of the arena. Either way, the index is
+// sealed against further insertions, as detach() skips the per-node frees
+// and would leak any link lists allocated by a later addPoint().
+template<typename HnswData_>
+void compact_link_lists(IndexStorage<HnswData_>& storage) {
+    auto& index = storage.index;
+    const std::size_t count = index.cur_element_count;
+    index.max_elements_ = count; // addPoint() throws once the index is full.
+    if (storage.link_lists_external) {
+        return;
+    }
+
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto level = index.element_levels_[i];
+        if (level > 0) {
+            total += sanisizer::product<std::size_t>(index.size_links_per_element_, level);
+        }
+    }
+    if (total == 0) {
+        return;
+    }
+
+    std::unique_ptr<char[]> arena(new char[total]);
+    std::size_t position = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto level = index.element_levels_[i];
+        if (level > 0) {
+            const std::size_t size = index.size_links_per_element_ * level;
+            char* dest = arena.get() + position;
+            std::memcpy(dest, index.linkLists_[i], size);
+            std::free(index.linkLists_[i]);
+            index.linkLists_[i] = dest;
+            position += size;
+        }
+    }
+
+    storage.link_arena = std::move(arena);
+    storage.link_lists_external = true;
+}
+
+// Fills an empty index (i.e., created with the single-argument constructor)
+// from 'source', mirroring hnswlib::HierarchicalNSW::loadIndex(). All link
+// lists are stored in a single arena in 'storage' rather than being allocated
+// per node. If 'borrow' is true and 'source' can lend a suitably aligned
+// buffer, the index directly adopts the level 0 block and the link lists.
+// Either way, the memory is tracked by 'storage'.
+template<typename HnswData_, class Source_>
+void read_index(hnswlib::SpaceInterface<HnswData_>* space, Source_& source, bool borrow, IndexStorage<HnswData_>& storage, const Level0Placement& placement = {}) {
+    auto& index = storage.index;
+    auto read_pod = [&](auto& x) -> void {
+        source.read(&x, sizeof(x));
+    };
+
+    read_pod(index.offsetLevel0_);
+    read_pod(index.max_elements_);
+    std::size_t count;
+    read_pod(count);
+    read_pod(index.size_data_per_element_);
+    read_pod(index.label_offset_);
+    read_pod(index.offsetData_);
+    read_pod(index.maxlevel_);
+    read_pod(index.enterpoint_node_);
+    read_pod(index.maxM_);
+
+    read_pod(index.maxM0_);
+    read_pod(index.M_);
+    read_pod(index.mult_);
+    read_pod(index.ef_construction_);
+
+    index.data_size_ = space->get_data_size();
+    index.fstdistfunc_ = space->get_dist_func();
+    index.dist_func_param_ = space->get_dist_func_param();
+
+    index.size_links_per_element_ = index.maxM_ * sizeof(hnswlib::tableint) + sizeof(hnswlib::linklistsizeint);
+    index.size_links_level0_ = index.maxM0_ * sizeof(hnswlib::tableint) + sizeof(hnswlib::linklistsizeint);
+    if (index.size_data_per_element_ != index.size_links_level0_ + index.data_size_ + sizeof(hnswlib::labeltype)) {
+        throw std::runtime_error("inconsistent element size in the serialized HNSW index");
+    }
+    index.revSize_ = 1.0 / index.mult_;
+    index.ef_ = 10;
+
+    const std::size_t level0_size = sanisizer::product<std::size_t>(count, index.size_data_per_element_);
+    const char* lent = NULL;
+    if constexpr(Source_::can_borrow) {
+        if (borrow) {
+            lent = source.borrow(level0_size);
+            constexpr std::size_t required = std::max(alignof(hnswlib::linklistsizeint), alignof(HnswData_));
+            if (reinterpret_cast<std::uintptr_t>(lent) % required == 0) {
+                index.data_level0_memory_ = const_cast<char*>(lent);
+                index.max_elements_ = count; // no room for further insertions in a borrowed block.
+                storage.level0_borrowed = true;
+            }
+        }
+    }
+
+    if (!storage.level0_borrowed) {
+        index.max_elements_ = std::max(index.max_elements_, count);
+        index.data_level0_memory_ = allocate_level0(storage, sanisizer::product<std::size_t>(index.max_elements_, index.size_data_per_element_), placement);
+        if (lent) { // falling back to a copy if the lent block is misaligned.
+            std::memcpy(index.data_level0_memory_, lent, level0_size);
+        } else {
+            source.read(index.data_level0_memory_, level0_size);
+        }
+    }
+
+    std::vector<std::mutex>(index.max_elements_).swap(index.link_list_locks_);
+    std::vector<std::mutex>(hnswlib::HierarchicalNSW<HnswData_>::MAX_LABEL_OPERATION_LOCKS).swap(index.label_op_locks_);
+    index.visited_list_pool_.reset(new hnswlib::VisitedListPool(1, index.max_elements_));
+
+    index.linkLists_ = static_cast<char**>(std::malloc(sizeof(void*) * index.max_elements_));
+    if (index.linkLists_ == NULL) {
+        throw std::bad_alloc();
+    }
+    index.element_levels_ = std::vector<int>(index.max_elements_);
+    index.cur_element_count = count;
+    storage.link_lists_external = true;
+
+    // The remainder of the source consists of each node's link list size
+    // followed by its link lists. We pull it all into a single arena in
+    // one read and point each node's link lists into it.
+    const std::size_t tail_size = source.remaining();
+    const char* tail = NULL;
+    if constexpr(Source_::can_borrow) {
+        if (storage.level0_borrowed) {
+            tail = source.borrow(tail_size);
+            if (reinterpret_cast<std::uintptr_t>(tail) % alignof(hnswlib::linklistsizeint) != 0) {
+                storage.link_arena.reset(new char[tail_size]);
+                std::memcpy(storage.link_arena.get(), tail, tail_size);
+                tail = storage.link_arena.get();
+            }
+        }
+    }
+    if (tail == NULL) {
+        storage.link_arena.reset(new char[tail_size]);
+        source.read(storage.link_arena.get(), tail_size);
+        tail = storage.link_arena.get();
+    }
+
+    std::size_t position = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        index.label_lookup_[index.getExternalLabel(i)] = i;
+
+        unsigned int link_list_size;
+        if (tail_size - position < sizeof(link_list_size)) {
+            throw std::runtime_error("serialized HNSW index is truncated");
+        }
+        std::memcpy(&link_list_size, tail + position, sizeof(link_list_size));
+        position += sizeof(link_list_size);
+
+        if (link_list_size == 0) {
+            index.linkLists_[i] = NULL;
+        } else {
+            if (tail_size - position < link_list_size) {
+                throw std::runtime_error("serialized HNSW index is truncated");
+            }
+            index.linkLists_[i] = const_cast<char*>(tail + position);
+            index.element_levels_[i] = link_list_size / index.size_links_per_element_;
+            position += link_list_size;
+        }
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+        if (index.isMarkedDeleted(i)) {
+            index.num_deleted_ += 1;
+        }
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
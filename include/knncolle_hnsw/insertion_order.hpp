@@ -0,0 +1,117 @@
+#ifndef KNNCOLLE_HNSW_INSERTION_ORDER_HPP
+#define KNNCOLLE_HNSW_INSERTION_ORDER_HPP
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+#include "sanisizer/sanisizer.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include "utils.hpp"
+
+/**
+ * @file insertion_order.hpp
+ * @brief Order in which observations are inserted into an HNSW index.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * Order in which observations are inserted when building an HNSW index.
+ *
+ * - `INPUT`: observations are inserted in the order in which they are extracted from the input matrix.
+ * - `PROJECTED_CURVE`: observations are projected onto a few random directions, and inserted in the order of their positions on a Z-order (Morton) curve through the projected space.
+ *   Consecutive insertions are then likely to be close to each other, so the parts of the graph that are visited during insertion are more likely to be in cache.
+ *
+ * In all cases, the observations retain their original indices in the index.
+ */
+enum class InsertionOrder : char { INPUT, PROJECTED_CURVE };
+
+/**
+ * @cond
+ */
+// Returns a permutation of [0, num_obs) in which observations that are close
+// in a random low-dimensional projection are also close in the ordering.
+// Each projected coordinate is quantized to 'bits' bits and the bits are
+// interleaved into a single Morton key; ties are broken by the original
+// index so that the order is deterministic.
+template<typename Index_, typename HnswData_>
+std::vector<Index_> order_by_projected_curve(const HnswData_* data, Index_ num_obs, std::size_t num_dim, std::size_t seed, int num_threads) {
+    std::vector<Index_> order(num_obs);
+    std::iota(order.begin(), order.end(), static_cast<Index_>(0));
+    if (num_obs < 2 || num_dim == 0) {
+        return order;
+    }
+
+    constexpr std::size_t max_proj = 3;
+    constexpr int bits = 21; // 3 * 21 = 63 bits, fitting into a 64-bit key.
+    const std::size_t num_proj = std::min(max_proj, num_dim);
+
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<double> norm;
+    auto directions = sanisizer::create<std::vector<double> >(sanisizer::product<std::size_t>(num_proj, num_dim));
+    for (auto& d : directions) {
+        d = norm(rng);
+    }
+
+    auto projected = sanisizer::create<std::vector<double> >(sanisizer::product<std::size_t>(num_proj, num_obs));
+    knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            const auto ptr = data + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+            for (std::size_t p = 0; p < num_proj; ++p) {
+                const auto dir = directions.data() + sanisizer::product_unsafe<std::size_t>(p, num_dim);
+                double val = 0;
+                for (std::size_t d = 0; d < num_dim; ++d) {
+                    val += dir[d] * ptr[d];
+                }
+                projected[sanisizer::product_unsafe<std::size_t>(i, num_proj) + p] = val;
+            }
+        }
+    });
+
+    std::vector<double> lower(num_proj, std::numeric_limits<double>::infinity()), upper(num_proj, -std::numeric_limits<double>::infinity());
+    for (Index_ i = 0; i < num_obs; ++i) {
+        for (std::size_t p = 0; p < num_proj; ++p) {
+            const auto val = projected[sanisizer::product_unsafe<std::size_t>(i, num_proj) + p];
+            lower[p] = std::min(lower[p], val);
+            upper[p] = std::max(upper[p], val);
+        }
+    }
+
+    constexpr std::uint64_t max_cell = (static_cast<std::uint64_t>(1) << bits) - 1;
+    std::vector<std::uint64_t> keys(num_obs);
+    knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            std::uint64_t key = 0;
+            for (std::size_t p = 0; p < num_proj; ++p) {
+                const double range = upper[p] - lower[p];
+                std::uint64_t cell = 0;
+                if (range > 0) {
+                    const double scaled = (projected[sanisizer::product_unsafe<std::size_t>(i, num_proj) + p] - lower[p]) / range;
+                    cell = std::min(static_cast<std::uint64_t>(scaled * max_cell), max_cell);
+                }
+                for (int b = 0; b < bits; ++b) {
+                    key |= ((cell >> b) & 1) << (b * num_proj + p);
+                }
+            }
+            keys[i] = key;
+        }
+    });
+
+    std::sort(order.begin(), order.end(), [&](Index_ left, Index_ right) -> bool {
+        return keys[left] < keys[right] || (keys[left] == keys[right] && left < right);
+    });
+    return order;
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -0,0 +1,405 @@
+#ifndef KNNCOLLE_HNSW_INSTRUMENTATION_HPP
+#define KNNCOLLE_HNSW_INSTRUMENTATION_HPP
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <mutex>
+#include <cmath>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file instrumentation.hpp
+ * @brief Latency histograms and trace events for HNSW searches and builds.
+ *
+ * Instrumentation of `HnswPrebuilt` and its searchers is only compiled if the `KNNCOLLE_HNSW_INSTRUMENTATION` macro is defined before including any **knncolle_hnsw** header.
+ * Otherwise, no latencies are recorded and no trace events are emitted, so there is no runtime cost.
+ * The macro should be defined consistently in all translation units of an application.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+enum class BuildPhase : char; // defined in build_progress.hpp.
+
+// Position of the most significant set bit, i.e., floor(log2(x)) for x > 0.
+inline int highest_bit(std::uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(x);
+#else
+    int bit = 0;
+    while (x >>= 1) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Log-linear histogram of latencies.
+ *
+ * This follows the layout of an HDR histogram, where each power of 2 is split into 32 equally-sized buckets.
+ * Latencies below 32 nanoseconds are recorded exactly, and all other latencies are recorded with a relative error of at most 1/32.
+ * Recording is a single increment without any locking, so each thread should record into its own histogram;
+ * histograms from different threads can then be combined with `merge()`.
+ */
+class LatencyHistogram {
+public:
+    /**
+     * @cond
+     */
+    static constexpr int sub_bucket_bits = 5;
+    static constexpr std::uint64_t sub_bucket_count = static_cast<std::uint64_t>(1) << sub_bucket_bits;
+    static constexpr std::size_t num_buckets = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+    /**
+     * @endcond
+     */
+
+private:
+    std::vector<std::uint64_t> my_counts;
+    std::uint64_t my_total = 0;
+    std::uint64_t my_min = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t my_max = 0;
+    double my_sum = 0;
+
+    static std::size_t bucket(std::uint64_t nanoseconds) {
+        if (nanoseconds < sub_bucket_count) {
+            return nanoseconds;
+        }
+        const int magnitude = highest_bit(nanoseconds);
+        const int shift = magnitude - sub_bucket_bits;
+        const std::uint64_t top = nanoseconds >> shift; // in [sub_bucket_count, 2 * sub_bucket_count).
+        return (shift + 1) * sub_bucket_count + (top - sub_bucket_count);
+    }
+
+    // Largest latency that would be recorded in bucket 'b'.
+    static std::uint64_t highest_equivalent(std::size_t b) {
+        if (b < sub_bucket_count) {
+            return b;
+        }
+        const int shift = static_cast<int>(b / sub_bucket_count) - 1;
+        const std::uint64_t top = sub_bucket_count + b % sub_bucket_count;
+        return ((top + 1) << shift) - 1;
+    }
+
+public:
+    /**
+     * Record a single latency.
+     * @param nanoseconds Latency in nanoseconds.
+     */
+    void record(std::uint64_t nanoseconds) {
+        if (my_counts.empty()) {
+            my_counts.resize(num_buckets);
+        }
+        ++my_counts[bucket(nanoseconds)];
+        ++my_total;
+        my_min = std::min(my_min, nanoseconds);
+        my_max = std::max(my_max, nanoseconds);
+        my_sum += static_cast<double>(nanoseconds);
+    }
+
+    /**
+     * Add the latencies of another histogram to this histogram.
+     * @param other Another histogram, typically from a different thread.
+     */
+    void merge(const LatencyHistogram& other) {
+        if (other.my_total == 0) {
+            return;
+        }
+        if (my_counts.empty()) {
+            my_counts.resize(num_buckets);
+        }
+        for (std::size_t b = 0; b < num_buckets; ++b) {
+            my_counts[b] += other.my_counts[b];
+        }
+        my_total += other.my_total;
+        my_min = std::min(my_min, other.my_min);
+        my_max = std::max(my_max, other.my_max);
+        my_sum += other.my_sum;
+    }
+
+    /**
+     * Remove all recorded latencies.
+     */
+    void clear() {
+        std::fill(my_counts.begin(), my_counts.end(), 0);
+        my_total = 0;
+        my_min = std::numeric_limits<std::uint64_t>::max();
+        my_max = 0;
+        my_sum = 0;
+    }
+
+    /**
+     * @return Number of recorded latencies.
+     */
+    std::uint64_t count() const {
+        return my_total;
+    }
+
+    /**
+     * @return Smallest recorded latency in nanoseconds, or zero if no latencies were recorded.
+     */
+    std::uint64_t min() const {
+        return (my_total ? my_min : 0);
+    }
+
+    /**
+     * @return Largest recorded latency in nanoseconds.
+     */
+    std::uint64_t max() const {
+        return my_max;
+    }
+
+    /**
+     * @return Mean of the recorded latencies in nanoseconds, or zero if no latencies were recorded.
+     */
+    double mean() const {
+        return (my_total ? my_sum / static_cast<double>(my_total) : 0);
+    }
+
+    /**
+     * @param q Quantile, e.g., 0.5 for the median, 0.99 for the 99th percentile, 0.999 for the 99.9th percentile.
+     * This should lie in \f$[0, 1]\f$.
+     * @return Latency in nanoseconds at quantile `q`, or zero if no latencies were recorded.
+     * This is the upper bound of the bucket containing the quantile, capped at the largest recorded latency.
+     */
+    std::uint64_t quantile(double q) const {
+        if (my_total == 0) {
+            return 0;
+        }
+        const double target = std::ceil(std::min(std::max(q, 0.0), 1.0) * static_cast<double>(my_total));
+        const std::uint64_t rank = std::max(static_cast<std::uint64_t>(target), static_cast<std::uint64_t>(1));
+        std::uint64_t cumulative = 0;
+        for (std::size_t b = 0; b < num_buckets; ++b) {
+            cumulative += my_counts[b];
+            if (cumulative >= rank) {
+                return std::min(highest_equivalent(b), my_max);
+            }
+        }
+        return my_max;
+    }
+};
+
+/**
+ * @brief Latency histograms for HNSW searches, split by the number of neighbors and the search parameter.
+ */
+class HnswSearchLatencies {
+public:
+    /**
+     * Pair containing the number of neighbors `k` and the value of `ef` used during the search.
+     */
+    typedef std::pair<std::size_t, std::size_t> Key;
+
+private:
+    std::map<Key, LatencyHistogram> my_histograms;
+    Key my_last_key;
+    LatencyHistogram* my_last = NULL;
+
+public:
+    /**
+     * @cond
+     */
+    HnswSearchLatencies() = default;
+
+    // The cached pointer must not be copied, as it refers to the other object's map.
+    HnswSearchLatencies(const HnswSearchLatencies& other) : my_histograms(other.my_histograms) {}
+
+    HnswSearchLatencies& operator=(const HnswSearchLatencies& other) {
+        my_histograms = other.my_histograms;
+        my_last = NULL;
+        return *this;
+    }
+    /**
+     * @endcond
+     */
+
+    /**
+     * @param k Number of neighbors.
+     * @param ef Value of `ef` used during the search.
+     * @return Histogram for searches with `k` and `ef`, created if it does not already exist.
+     */
+    LatencyHistogram& get(std::size_t k, std::size_t ef) {
+        const Key key(k, ef);
+        if (my_last == NULL || my_last_key != key) {
+            my_last = &(my_histograms[key]);
+            my_last_key = key;
+        }
+        return *my_last;
+    }
+
+    /**
+     * @return Histograms for each combination of `k` and `ef`.
+     */
+    const std::map<Key, LatencyHistogram>& histograms() const {
+        return my_histograms;
+    }
+
+    /**
+     * @return Histogram of all searches, regardless of `k` and `ef`.
+     */
+    LatencyHistogram overall() const {
+        LatencyHistogram output;
+        for (const auto& h : my_histograms) {
+            output.merge(h.second);
+        }
+        return output;
+    }
+
+    /**
+     * Add the latencies of another set of histograms to this set.
+     * @param other Another set of histograms, typically from a different thread.
+     */
+    void merge(const HnswSearchLatencies& other) {
+        for (const auto& h : other.my_histograms) {
+            my_histograms[h.first].merge(h.second);
+        }
+    }
+
+    /**
+     * Remove all histograms.
+     */
+    void clear() {
+        my_histograms.clear();
+        my_last = NULL;
+    }
+};
+
+/**
+ * Type of a trace event.
+ *
+ * - `BUILD_PHASE_START`, `BUILD_PHASE_END`: start and end of a phase of index construction, see `BuildPhase`.
+ * - `SEARCH_START`, `SEARCH_END`: start and end of a single search.
+ */
+enum class HnswTraceType : char { BUILD_PHASE_START, BUILD_PHASE_END, SEARCH_START, SEARCH_END };
+
+/**
+ * @brief Trace event from an HNSW search or build.
+ */
+struct HnswTraceEvent {
+    /**
+     * Type of the event.
+     */
+    HnswTraceType type = HnswTraceType::SEARCH_START;
+
+    /**
+     * Phase of construction.
+     * Only used for `HnswTraceType::BUILD_PHASE_START` and `HnswTraceType::BUILD_PHASE_END`.
+     */
+    BuildPhase phase{};
+
+    /**
+     * Number of neighbors requested by the search.
+     * Only used for `HnswTraceType::SEARCH_START` and `HnswTraceType::SEARCH_END`.
+     */
+    std::size_t k = 0;
+
+    /**
+     * Value of `ef` used by the search.
+     * Only used for `HnswTraceType::SEARCH_START` and `HnswTraceType::SEARCH_END`.
+     */
+    std::size_t ef = 0;
+
+    /**
+     * Time at which the event occurred.
+     */
+    std::chrono::steady_clock::time_point time;
+};
+
+/**
+ * Define a global function to receive trace events from HNSW searches and builds.
+ * This is only used if the `KNNCOLLE_HNSW_INSTRUMENTATION` macro is defined.
+ * The action of setting/unsetting the global function is not thread-safe and should be done in a serial section.
+ *
+ * The global function may be called concurrently from multiple threads, e.g., when searching in parallel, and should be thread-safe.
+ * It is called synchronously so it should return quickly, e.g., by appending the event to a thread-local buffer.
+ *
+ * @return Reference to a global function for receiving trace events.
+ * By default, no global function is defined.
+ */
+inline std::function<void(const HnswTraceEvent&)>& custom_trace_for_hnsw() {
+    static std::function<void(const HnswTraceEvent&)> fun;
+    return fun;
+}
+
+/**
+ * @cond
+ */
+inline void emit_trace(HnswTraceType type, BuildPhase phase, std::size_t k, std::size_t ef) {
+    auto& fun = custom_trace_for_hnsw();
+    if (fun) {
+        HnswTraceEvent event;
+        event.type = type;
+        event.phase = phase;
+        event.k = k;
+        event.ef = ef;
+        event.time = std::chrono::steady_clock::now();
+        fun(event);
+    }
+}
+
+// Times a single search in its scope, recording the latency in the
+// searcher's own histogram and emitting the start and end trace events.
+class SearchProbe {
+public:
+    SearchProbe(HnswSearchLatencies& latencies, std::size_t k, std::size_t ef) :
+        my_histogram(latencies.get(k, ef)), my_k(k), my_ef(ef)
+    {
+        emit_trace(HnswTraceType::SEARCH_START, BuildPhase{}, my_k, my_ef);
+        my_start = std::chrono::steady_clock::now();
+    }
+
+    ~SearchProbe() {
+        const auto elapsed = std::chrono::steady_clock::now() - my_start;
+        my_histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        emit_trace(HnswTraceType::SEARCH_END, BuildPhase{}, my_k, my_ef);
+    }
+
+    SearchProbe(const SearchProbe&) = delete;
+    SearchProbe& operator=(const SearchProbe&) = delete;
+
+private:
+    LatencyHistogram& my_histogram;
+    std::size_t my_k, my_ef;
+    std::chrono::steady_clock::time_point my_start;
+};
+
+// Collects the latencies from each searcher when it is destroyed, so that
+// the hot path only ever touches the searcher's own histograms.
+class LatencyCollector {
+public:
+    void merge(const HnswSearchLatencies& latencies) {
+        std::lock_guard<std::mutex> lck(my_lock);
+        my_latencies.merge(latencies);
+    }
+
+    HnswSearchLatencies get() const {
+        std::lock_guard<std::mutex> lck(my_lock);
+        return my_latencies;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lck(my_lock);
+        my_latencies.clear();
+    }
+
+private:
+    mutable std::mutex my_lock;
+    HnswSearchLatencies my_latencies;
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef KNNCOLLE_HNSW_INTERLEAVED_SEARCH_HPP
+#define KNNCOLLE_HNSW_INTERLEAVED_SEARCH_HPP
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+
+#include "hnswlib/hnswalg.h"
+
+#include "utils.hpp"
+#include "wave_build.hpp"
+#include "entry_points.hpp"
+
+/**
+ * @file interleaved_search.hpp
+ * @brief Interleaved search of multiple queries to hide memory latency.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+inline void prefetch_bytes(const char* ptr, std::size_t size) {
+#if defined(__GNUC__) || defined(__clang__)
+    constexpr std::size_t cache_line = 64;
+    for (std::size_t offset = 0; offset < size; offset += cache_line) {
+        __builtin_prefetch(ptr + offset);
+    }
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
+// State of a single query in an interleaved search. Each query alternates
+// between two steps: SCAN reads the link list of the current node (which was
+// prefetched in the previous step) and prefetches the data of its neighbors,
+// while COMPUTE computes the distances to those neighbors (now hopefully in
+// cache) and prefetches the link list of the next node to visit. Other
+// queries are processed in between, giving time for the prefetches to land.
+template<typename HnswData_>
+struct InterleavedQuery {
+    enum class Step : char { DESCEND_SCAN, DESCEND_COMPUTE, BASE_SCAN, BASE_COMPUTE, DONE };
+
+    std::size_t id = 0;
+    std::vector<HnswData_> query;
+    Step step = Step::DONE;
+
+    int level = 0;
+    hnswlib::tableint current = 0;
+    HnswData_ curdist = 0;
+    std::vector<hnswlib::tableint> pending;
+
+    hnswlib::VisitedList* visited = NULL;
+    HnswData_ lower_bound = 0;
+    CandidateQueue<HnswData_> top_candidates, candidate_set;
+};
+
+// Searches for the nearest neighbors of 'num_queries' queries, keeping up to
+// 'group_size' queries in flight at once. The results are identical to those
+// of hnswlib::HierarchicalNSW::searchKnn() for each query, or those of
+// search_knn_with_visited() if 'entries' is not empty. 'fill_query(q, ptr)'
+// should copy the 'q'-th query into 'ptr', and 'report(q, queue)' is called
+// with the same queue that searchKnn() would return.
+template<typename HnswData_, class FillQuery_, class Report_>
+void search_interleaved(
+    const hnswlib::HierarchicalNSW<HnswData_>& index,
+    const std::vector<hnswlib::tableint>& entries,
+    std::size_t num_dim,
+    std::size_t num_queries,
+    FillQuery_ fill_query,
+    std::size_t k,
+    std::size_t group_size,
+    Report_ report)
+{
+    typedef InterleavedQuery<HnswData_> State;
+    typedef typename State::Step Step;
+    std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> > result;
+
+    if (index.cur_element_count == 0) {
+        for (std::size_t q = 0; q < num_queries; ++q) {
+            report(q, result);
+        }
+        return;
+    }
+
+    const std::size_t ef = std::max(index.ef_, k);
+    const bool bare_bone_search = (index.num_deleted_ == 0);
+    auto get_data = [&](hnswlib::tableint i) -> const HnswData_* {
+        return reinterpret_cast<const HnswData_*>(index.getDataByInternalId(i));
+    };
+    auto distance = [&](const State& state, hnswlib::tableint i) -> HnswData_ {
+        return index.fstdistfunc_(state.query.data(), get_data(i), index.dist_func_param_);
+    };
+    auto get_links = [&](const State& state) -> hnswlib::linklistsizeint* {
+        return (state.level == 0 ? index.get_linklist0(state.current) : index.get_linklist(state.current, state.level));
+    };
+
+    // Checks whether the base layer search should stop; otherwise, pops the
+    // next candidate and prefetches its link list.
+    auto advance_base = [&](State& state) -> bool {
+        if (state.candidate_set.empty()) {
+            return false;
+        }
+        const auto& top = state.candidate_set.top();
+        const HnswData_ candidate_dist = -top.first;
+        const bool stop = (bare_bone_search ?
+            candidate_dist > state.lower_bound :
+            (candidate_dist > state.lower_bound && state.top_candidates.size() == ef));
+        if (stop) {
+            return false;
+        }
+        state.current = top.second;
+        state.candidate_set.pop();
+        prefetch_bytes(reinterpret_cast<const char*>(index.get_linklist0(state.current)), index.size_links_level0_);
+        return true;
+    };
+
+    auto finish = [&](State& state) -> void {
+        index.visited_list_pool_->releaseVisitedList(state.visited);
+        state.visited = NULL;
+        while (state.top_candidates.size() > k) {
+            state.top_candidates.pop();
+        }
+        while (!state.top_candidates.empty()) {
+            const auto& top = state.top_candidates.top();
+            result.emplace(top.first, index.getExternalLabel(top.second));
+            state.top_candidates.pop();
+        }
+        state.candidate_set = CandidateQueue<HnswData_>();
+        report(state.id, result);
+        result = std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> >();
+        state.step = Step::DONE;
+    };
+
+    auto start_base = [&](State& state) -> void {
+        state.visited = index.visited_list_pool_->getFreeVisitedList();
+        auto ep = state.current;
+        if (bare_bone_search || !index.isMarkedDeleted(ep)) {
+            state.lower_bound = state.curdist;
+            state.top_candidates.emplace(state.curdist, ep);
+            state.candidate_set.emplace(-state.curdist, ep);
+        } else {
+            state.lower_bound = std::numeric_limits<HnswData_>::max();
+            state.candidate_set.emplace(-state.lower_bound, ep);
+        }
+        state.visited->mass[ep] = state.visited->curV;
+        state.step = Step::BASE_SCAN;
+        if (!advance_base(state)) {
+            finish(state);
+        }
+    };
+
+    auto start = [&](State& state, std::size_t q) -> void {
+        state.id = q;
+        state.query.resize(num_dim);
+        fill_query(q, state.query.data());
+        if (!entries.empty()) {
+            const auto closest = closest_entry_point(index, entries, state.query.data());
+            state.current = closest.first;
+            state.curdist = closest.second;
+            state.level = 0;
+            start_base(state);
+            return;
+        }
+
+        state.current = index.enterpoint_node_;
+        state.curdist = distance(state, state.current);
+        state.level = index.maxlevel_;
+        if (state.level > 0) {
+            state.step = Step::DESCEND_SCAN;
+            prefetch_bytes(reinterpret_cast<const char*>(get_links(state)), index.size_links_per_element_);
+        } else {
+            start_base(state);
+        }
+    };
+
+    auto scan = [&](State& state, bool base) -> void {
+        auto links = get_links(state);
+        auto size = index.getListCount(links);
+        auto neighbors = reinterpret_cast<const hnswlib::tableint*>(links + 1);
+        state.pending.clear();
+        for (I<decltype(size)> n = 0; n < size; ++n) {
+            const auto candidate = neighbors[n];
+            if (base) {
+                auto& mark = state.visited->mass[candidate];
+                if (mark == state.visited->curV) {
+                    continue;
+                }
+                mark = state.visited->curV;
+            }
+            state.pending.push_back(candidate);
+            prefetch_bytes(reinterpret_cast<const char*>(get_data(candidate)), index.data_size_);
+        }
+    };
+
+    auto step = [&](State& state) -> void {
+        switch (state.step) {
+            case Step::DESCEND_SCAN:
+                scan(state, false);
+                state.step = Step::DESCEND_COMPUTE;
+                break;
+
+            case Step::DESCEND_COMPUTE:
+                {
+                    bool changed = false;
+                    for (auto candidate : state.pending) {
+                        const auto d = distance(state, candidate);
+                        if (d < state.curdist) {
+                            state.curdist = d;
+                            state.current = candidate;
+                            changed = true;
+                        }
+                    }
+                    if (!changed) {
+                        --state.level;
+                    }
+                    if (state.level > 0) {
+                        state.step = Step::DESCEND_SCAN;
+                        prefetch_bytes(reinterpret_cast<const char*>(get_links(state)), index.size_links_per_element_);
+                    } else {
+                        start_base(state);
+                    }
+                }
+                break;
+
+            case Step::BASE_SCAN:
+                scan(state, true);
+                state.step = Step::BASE_COMPUTE;
+                break;
+
+            case Step::BASE_COMPUTE:
+                for (auto candidate : state.pending) {
+                    const auto d = distance(state, candidate);
+                    if (state.top_candidates.size() < ef || state.lower_bound > d) {
+                        state.candidate_set.emplace(-d, candidate);
+                        if (bare_bone_search || !index.isMarkedDeleted(candidate)) {
+                            state.top_candidates.emplace(d, candidate);
+                        }
+                        while (state.top_candidates.size() > ef) {
+                            state.top_candidates.pop();
+                        }
+                        if (!state.top_candidates.empty()) {
+                            state.lower_bound = state.top_candidates.top().first;
+                        }
+                    }
+                }
+                state.step = Step::BASE_SCAN;
+                if (!advance_base(state)) {
+                    finish(state);
+                }
+                break;
+
+            case Step::DONE:
+                break;
+        }
+    };
+
+    // Each slot starts a new query once its current query is finished. Note
+    // that a query may finish as soon as it starts, e.g., for a single node.
+    std::vector<State> states(std::min(std::max(group_size, static_cast<std::size_t>(1)), num_queries));
+    std::size_t next = 0;
+    auto launch = [&](State& state) -> bool {
+        while (next < num_queries) {
+            start(state, next++);
+            if (state.step != Step::DONE) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::size_t num_active = 0;
+    for (auto& state : states) {
+        num_active += launch(state);
+    }
+
+    while (num_active) {
+        for (auto& state : states) {
+            if (state.step == Step::DONE) {
+                continue;
+            }
+            step(state);
+            if (state.step == Step::DONE && !launch(state)) {
+                --num_active;
+            }
+        }
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
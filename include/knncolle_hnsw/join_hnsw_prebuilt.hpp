@@ -0,0 +1,220 @@
+#ifndef KNNCOLLE_HNSW_JOIN_PREBUILT_HPP
+#define KNNCOLLE_HNSW_JOIN_PREBUILT_HPP
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstddef>
+#include <stdexcept>
+
+#include "knncolle/knncolle.hpp"
+#include "sanisizer/sanisizer.hpp"
+#include "hnswlib/hnswalg.h"
+
+#include "Hnsw.hpp"
+
+/**
+ * @file join_hnsw_prebuilt.hpp
+ * @brief Find nearest neighbors in a reference HNSW index for every observation in a query dataset.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @brief Options for `join_hnsw_prebuilt()`.
+ */
+struct HnswJoinOptions {
+    /**
+     * Number of threads to use.
+     * Each thread processes a contiguous block of queries in the order described by `HnswJoinOptions::order_by_locality`.
+     */
+    int num_threads = 1;
+
+    /**
+     * Whether to process the queries in order of their location in the reference graph.
+     * If true, each query is first routed through the upper layers of the reference index to find its entry point into the base layer,
+     * and queries are then sorted by their entry points.
+     * Consecutive searches will then start from the same region of the reference graph, improving cache reuse.
+     * Otherwise, queries are processed in their original order.
+     * Either way, the results are reported in the original order.
+     */
+    bool order_by_locality = true;
+
+    /**
+     * Number of queries that each thread keeps in flight at once.
+     * If greater than 1, each thread interleaves the graph traversals of multiple queries,
+     * prefetching the links and data for one query while computing distances for the others.
+     * This hides some of the memory latency for large indices that do not fit in the cache.
+     * The results are the same regardless of this setting.
+     */
+    std::size_t num_interleaved = 1;
+};
+
+/**
+ * @cond
+ */
+// 'queries' should already be converted to HnswData_, so that each query is
+// not converted separately by the searcher. Each thread collects the raw
+// distances for its block of queries and normalizes them all at once.
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+knncolle::NeighborList<Index_, Distance_> join_hnsw_prebuilt_internal(
+    Index_ num_queries,
+    const std::vector<HnswData_>& queries,
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& reference,
+    int k,
+    const HnswJoinOptions& options)
+{
+    const std::size_t ndim = reference.num_dimensions();
+    auto get_query = [&](Index_ q) -> const HnswData_* {
+        return queries.data() + sanisizer::product_unsafe<std::size_t>(q, ndim);
+    };
+
+    auto order = sanisizer::create<std::vector<Index_> >(num_queries);
+    std::iota(order.begin(), order.end(), static_cast<Index_>(0));
+
+    if (options.order_by_locality) {
+        auto entry = sanisizer::create<std::vector<hnswlib::tableint> >(num_queries);
+        knncolle::parallelize(options.num_threads, num_queries, [&](int, Index_ start, Index_ length) -> void {
+            for (Index_ q = start, end = start + length; q < end; ++q) {
+                entry[q] = reference.descend_upper_layers(get_query(q));
+            }
+        });
+        std::stable_sort(order.begin(), order.end(), [&](Index_ left, Index_ right) -> bool { return entry[left] < entry[right]; });
+    }
+
+    knncolle::NeighborList<Index_, Distance_> output(num_queries);
+    knncolle::parallelize(options.num_threads, num_queries, [&](int, Index_ start, Index_ length) -> void {
+        std::vector<Distance_> block_distances;
+        auto store = [&](Index_ q, const std::vector<Index_>& indices, const std::vector<Distance_>& distances) -> void {
+            auto& current = output[q];
+            current.reserve(indices.size());
+            for (auto i : indices) {
+                current.emplace_back(i, 0);
+            }
+            block_distances.insert(block_distances.end(), distances.begin(), distances.end());
+        };
+
+        if (options.num_interleaved > 1) {
+            reference.search_interleaved_converted(
+                length,
+                [&](std::size_t o) -> const HnswData_* {
+                    return get_query(order[start + o]);
+                },
+                k,
+                options.num_interleaved,
+                [&](std::size_t o, const std::vector<Index_>& indices, const std::vector<Distance_>& distances) -> void {
+                    store(order[start + o], indices, distances);
+                },
+                false
+            );
+        } else {
+            auto searcher = reference.initialize_known();
+            std::vector<Index_> indices;
+            std::vector<Distance_> distances;
+            for (Index_ o = start, end = start + length; o < end; ++o) {
+                const auto q = order[o];
+                searcher->search_converted(get_query(q), k, &indices, &distances, false);
+                store(q, indices, distances);
+            }
+        }
+
+        reference.normalize_distances(block_distances.size(), block_distances.data());
+        auto dIt = block_distances.begin();
+        for (Index_ o = start, end = start + length; o < end; ++o) {
+            for (auto& current : output[order[o]]) {
+                current.second = *dIt;
+                ++dIt;
+            }
+        }
+    });
+
+    return output;
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Find the `k` nearest neighbors in a reference HNSW index for every observation in a query dataset.
+ * This is equivalent to calling `knncolle::Searcher::search()` on each query observation,
+ * but the queries are processed in parallel and in an order that improves locality of access to the reference graph.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ * @tparam Matrix_ Class of the query data matrix.
+ * This should satisfy the `knncolle::Matrix` interface.
+ *
+ * @param query Matrix containing the query dataset, with the same dimensionality as `reference`.
+ * @param reference Reference HNSW index, typically created by `HnswBuilder::build_known_unique()`.
+ * @param k Number of nearest neighbors to find for each query observation.
+ * @param options Further options.
+ *
+ * @return List of nearest neighbors in `reference` for each observation in `query`.
+ * Each inner vector is sorted by increasing distance.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_, class Matrix_>
+knncolle::NeighborList<Index_, Distance_> join_hnsw_prebuilt(
+    const Matrix_& query,
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& reference,
+    int k,
+    const HnswJoinOptions& options)
+{
+    const std::size_t ndim = reference.num_dimensions();
+    if (query.num_dimensions() != ndim) {
+        throw std::runtime_error("query and reference datasets should have the same dimensionality");
+    }
+
+    const Index_ num_queries = query.num_observations();
+    auto queries = sanisizer::create<std::vector<HnswData_> >(sanisizer::product<typename std::vector<HnswData_>::size_type>(ndim, num_queries));
+    auto work = query.new_known_extractor();
+    for (Index_ q = 0; q < num_queries; ++q) {
+        convert_block(work->next(), ndim, queries.data() + sanisizer::product_unsafe<std::size_t>(q, ndim));
+    }
+
+    return join_hnsw_prebuilt_internal(num_queries, queries, reference, k, options);
+}
+
+/**
+ * Overload of `join_hnsw_prebuilt()` where the query dataset is taken from the observations stored in another HNSW index.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ *
+ * @param query HNSW index containing the query dataset, with the same dimensionality as `reference`.
+ * @param reference Reference HNSW index, typically created by `HnswBuilder::build_known_unique()`.
+ * @param k Number of nearest neighbors to find for each query observation.
+ * @param options Further options.
+ *
+ * @return List of nearest neighbors in `reference` for each observation in `query`.
+ * Each inner vector is sorted by increasing distance.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+knncolle::NeighborList<Index_, Distance_> join_hnsw_prebuilt(
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& query,
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& reference,
+    int k,
+    const HnswJoinOptions& options)
+{
+    const std::size_t ndim = reference.num_dimensions();
+    if (query.num_dimensions() != ndim) {
+        throw std::runtime_error("query and reference datasets should have the same dimensionality");
+    }
+
+    const Index_ num_queries = query.num_observations();
+    auto queries = sanisizer::create<std::vector<HnswData_> >(sanisizer::product<typename std::vector<HnswData_>::size_type>(ndim, num_queries));
+    knncolle::parallelize(options.num_threads, num_queries, [&](int, Index_ start, Index_ length) -> void {
+        for (Index_ q = start, end = start + length; q < end; ++q) {
+            query.fetch_converted_observation(q, queries.data() + sanisizer::product_unsafe<std::size_t>(q, ndim));
+        }
+    });
+
+    return join_hnsw_prebuilt_internal(num_queries, queries, reference, k, options);
+}
+
+}
+
+#endif
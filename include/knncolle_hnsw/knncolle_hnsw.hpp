@@ -2,7 +2,15 @@
 #define KNNCOLLE_HNSW_HPP
 
 #include "Hnsw.hpp"
+#include "SparseMatrix.hpp"
 #include "load_hnsw_prebuilt.hpp"
+#include "serialize_hnsw_prebuilt.hpp"
+#include "ShardedHnsw.hpp"
+#include "TieredHnsw.hpp"
+#include "MultiMetricHnsw.hpp"
+#include "neighbor_graphs.hpp"
+#include "join_hnsw_prebuilt.hpp"
+#include "HnswSearchPool.hpp"
 #include "distances.hpp"
 #include "utils.hpp"
 
@@ -74,6 +74,30 @@ auto load_hnsw_prebuilt(const std::filesystem::path& dir) {
     return new HnswPrebuilt<Index_, Data_, Distance_, HnswData_>(dir);
 }
 
+/**
+ * Overload of `load_hnsw_prebuilt()` with options for loading large indices.
+ * The base layer of the HNSW graph is read in parallel chunks,
+ * while the link lists for the upper layers are stored in a single allocation rather than one allocation per observation.
+ * 
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ * This should be the same as the type reported by `HnswPrebuiltTypes::data`.
+ *
+ * @param dir Path to a directory in which a prebuilt HNSW index was saved.
+ * An HNSW index is typically saved by calling the `knncolle::Prebuilt::save()` method of the HNSW subclass instance.
+ * @param options Options for loading.
+ * @param[out] statistics Pointer to an object in which to store statistics about loading, e.g., the read throughput.
+ * If `NULL`, no statistics are reported.
+ *
+ * @return Pointer to a `knncolle::Prebuilt` HNSW index.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_ = float>
+auto load_hnsw_prebuilt(const std::filesystem::path& dir, const HnswLoadOptions& options, HnswLoadStatistics* statistics = NULL) {
+    return new HnswPrebuilt<Index_, Data_, Distance_, HnswData_>(dir, options, statistics);
+}
+
 }
 
 #endif
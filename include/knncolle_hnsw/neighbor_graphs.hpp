@@ -0,0 +1,348 @@
+#ifndef KNNCOLLE_HNSW_NEIGHBOR_GRAPHS_HPP
+#define KNNCOLLE_HNSW_NEIGHBOR_GRAPHS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+#include <stdexcept>
+
+#include "knncolle/knncolle.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "Hnsw.hpp"
+
+/**
+ * @file neighbor_graphs.hpp
+ * @brief Build mutual nearest neighbor pairs and shared nearest neighbor graphs.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @brief Graph in compressed sparse row format.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Weight_ Numeric type for the edge weights.
+ */
+template<typename Index_, typename Weight_>
+struct CompressedGraph {
+    /**
+     * Pointers to the start of each row in `CompressedGraph::indices` and `CompressedGraph::weights`.
+     * This has length equal to the number of rows plus 1,
+     * where the edges of row `r` are stored in the half-open interval `[pointers[r], pointers[r + 1])`.
+     */
+    std::vector<std::size_t> pointers;
+
+    /**
+     * Column indices for each edge, sorted in increasing order within each row.
+     */
+    std::vector<Index_> indices;
+
+    /**
+     * Weight of each edge.
+     */
+    std::vector<Weight_> weights;
+};
+
+/**
+ * @cond
+ */
+// Searches every observation in 'source' against 'target', storing the
+// sorted indices of the neighbors in a dense array of length 'k' per row.
+// Deleted observations in 'source' have no neighbors.
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+std::vector<Index_> sorted_cross_neighbors(
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& source,
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& target,
+    Index_ k,
+    std::vector<Index_>& counts,
+    int num_threads)
+{
+    const Index_ nobs = source.num_observations();
+    auto output = sanisizer::create<std::vector<Index_> >(sanisizer::product<typename std::vector<Index_>::size_type>(nobs, k));
+    sanisizer::resize(counts, nobs);
+
+    const bool has_deleted = (source.num_deleted() > 0);
+    knncolle::parallelize(num_threads, nobs, [&](int, Index_ start, Index_ length) -> void {
+        auto searcher = target.initialize_known();
+        auto buffer = sanisizer::create<std::vector<Data_> >(source.num_dimensions());
+        std::vector<Index_> indices;
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            if (has_deleted && source.is_deleted(i)) {
+                counts[i] = 0;
+                continue;
+            }
+            source.fetch_observation(i, buffer.data());
+            searcher->search(buffer.data(), k, &indices, NULL);
+            std::sort(indices.begin(), indices.end());
+            std::copy(indices.begin(), indices.end(), output.begin() + sanisizer::product_unsafe<std::size_t>(i, k));
+            counts[i] = indices.size();
+        }
+    });
+
+    return output;
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Identify mutual nearest neighbors (MNNs) between two datasets, typically different batches of cells.
+ * Observation `i` in the `left` dataset and observation `j` in the `right` dataset are MNNs
+ * if `j` is one of the `k` nearest neighbors of `i` in `right`, and `i` is one of the `k` nearest neighbors of `j` in `left`.
+ * The neighbor lists are obtained by using the observations stored in each index as queries for the other index.
+ * Observations that were deleted from either index (via `mark_deleted()`) are not involved in any MNN pairs.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ *
+ * @param left HNSW index for the first dataset, typically created by `HnswBuilder::build_known_unique()`.
+ * @param right HNSW index for the second dataset.
+ * This should have the same dimensionality and distance metric as `left`.
+ * @param k Number of nearest neighbors to consider in each direction.
+ * @param num_threads Number of threads to use.
+ *
+ * @return Graph where each row corresponds to an observation in `left` and each column index refers to an observation in `right`.
+ * Each edge represents an MNN pair and has a weight of 1.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+CompressedGraph<Index_, char> find_mutual_nearest_neighbors(
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& left,
+    const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& right,
+    Index_ k,
+    int num_threads = 1)
+{
+    if (left.num_dimensions() != right.num_dimensions()) {
+        throw std::runtime_error("both indices should have the same dimensionality");
+    }
+
+    std::vector<Index_> left_counts, right_counts;
+    const auto left_to_right = sorted_cross_neighbors(left, right, k, left_counts, num_threads);
+    const auto right_to_left = sorted_cross_neighbors(right, left, k, right_counts, num_threads);
+
+    const Index_ nleft = left.num_observations();
+    std::vector<std::vector<Index_> > found(nleft);
+    knncolle::parallelize(num_threads, nleft, [&](int, Index_ start, Index_ length) -> void {
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            auto lstart = left_to_right.begin() + sanisizer::product_unsafe<std::size_t>(i, k);
+            for (auto lIt = lstart, lEnd = lstart + left_counts[i]; lIt != lEnd; ++lIt) {
+                const auto j = *lIt;
+                auto rstart = right_to_left.begin() + sanisizer::product_unsafe<std::size_t>(j, k);
+                if (std::binary_search(rstart, rstart + right_counts[j], i)) {
+                    found[i].push_back(j);
+                }
+            }
+        }
+    });
+
+    CompressedGraph<Index_, char> output;
+    output.pointers.reserve(sanisizer::sum<std::size_t>(nleft, 1));
+    output.pointers.push_back(0);
+    for (Index_ i = 0; i < nleft; ++i) {
+        output.indices.insert(output.indices.end(), found[i].begin(), found[i].end());
+        output.pointers.push_back(output.indices.size());
+        std::vector<Index_>().swap(found[i]);
+    }
+    output.weights.resize(output.indices.size(), 1);
+    return output;
+}
+
+/**
+ * Scheme for weighting the edges of the shared nearest neighbor graph in `build_snn_graph()`.
+ * For each observation, we consider the set containing itself and its `k` nearest neighbors, ranked from 0 (itself) to `k` (the furthest neighbor).
+ * An edge is created between two observations if their sets overlap, with weight defined as:
+ *
+ * - `RANKED`: `k + 1 - r/2`, where `r` is the smallest sum of ranks for any shared member of the two sets.
+ *   This follows the approach of Xu and Su (2015).
+ * - `NUMBER`: the number of shared members.
+ * - `JACCARD`: the Jaccard index of the two sets.
+ *
+ * @see
+ * Xu C and Su Z (2015).
+ * Identification of cell types from single-cell transcriptomes using a novel clustering method.
+ * _Bioinformatics_ 31, 1974-80.
+ */
+enum class SnnWeightScheme : char { RANKED, NUMBER, JACCARD };
+
+/**
+ * Build a shared nearest neighbor (SNN) graph from the nearest neighbors of each observation.
+ * Each observation's neighbor set is sorted by index so that the overlap between two sets can be computed by a linear merge.
+ * Candidate pairs are identified via a reverse lookup from each observation to the sets containing it,
+ * so only pairs with at least one shared member are ever compared.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Distance_ Floating-point type for the distances.
+ *
+ * @param neighbors List of nearest neighbors for each observation, typically from `knncolle::find_nearest_neighbors()`.
+ * Each inner vector should be sorted by increasing distance and should not contain the observation itself.
+ * All inner vectors should be of the same length `k`.
+ * @param scheme Weighting scheme for the edges.
+ * @param num_threads Number of threads to use.
+ *
+ * @return Symmetric SNN graph where each row and column corresponds to an observation.
+ * Each edge is reported in the rows for both of its observations.
+ */
+template<typename Index_, typename Distance_>
+CompressedGraph<Index_, double> build_snn_graph(const knncolle::NeighborList<Index_, Distance_>& neighbors, SnnWeightScheme scheme, int num_threads = 1) {
+    const Index_ nobs = neighbors.size();
+
+    // Sorted neighbor sets, including the observation itself, with the rank of each member.
+    std::vector<std::size_t> set_ptrs;
+    set_ptrs.reserve(sanisizer::sum<std::size_t>(nobs, 1));
+    set_ptrs.push_back(0);
+    for (Index_ i = 0; i < nobs; ++i) {
+        set_ptrs.push_back(set_ptrs.back() + neighbors[i].size() + 1);
+    }
+    std::vector<std::pair<Index_, Index_> > sets(set_ptrs.back());
+    knncolle::parallelize(num_threads, nobs, [&](int, Index_ start, Index_ length) -> void {
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            auto sIt = sets.begin() + set_ptrs[i];
+            *sIt = std::make_pair(i, 0);
+            Index_ rank = 1;
+            for (const auto& nn : neighbors[i]) {
+                ++sIt;
+                *sIt = std::make_pair(nn.first, rank);
+                ++rank;
+            }
+            std::sort(sets.begin() + set_ptrs[i], sets.begin() + set_ptrs[i + 1]);
+        }
+    });
+
+    // Reverse lookup from each observation to the sets that contain it.
+    std::vector<std::size_t> rev_ptrs(sanisizer::sum<std::size_t>(nobs, 1));
+    for (const auto& member : sets) {
+        ++rev_ptrs[member.first + 1];
+    }
+    for (Index_ i = 0; i < nobs; ++i) {
+        rev_ptrs[i + 1] += rev_ptrs[i];
+    }
+    std::vector<Index_> reverse(sets.size());
+    {
+        std::vector<std::size_t> fill(rev_ptrs.begin(), rev_ptrs.end() - 1);
+        for (Index_ i = 0; i < nobs; ++i) {
+            for (auto sIt = sets.begin() + set_ptrs[i], sEnd = sets.begin() + set_ptrs[i + 1]; sIt != sEnd; ++sIt) {
+                reverse[fill[sIt->first]++] = i;
+            }
+        }
+    }
+
+    // Computing weights for each pair (i, j) with j > i.
+    std::vector<std::vector<std::pair<Index_, double> > > upper(nobs);
+    knncolle::parallelize(num_threads, nobs, [&](int, Index_ start, Index_ length) -> void {
+        std::vector<Index_> candidates;
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            const auto iStart = sets.begin() + set_ptrs[i], iEnd = sets.begin() + set_ptrs[i + 1];
+
+            candidates.clear();
+            for (auto sIt = iStart; sIt != iEnd; ++sIt) {
+                for (auto rIt = reverse.begin() + rev_ptrs[sIt->first], rEnd = reverse.begin() + rev_ptrs[sIt->first + 1]; rIt != rEnd; ++rIt) {
+                    if (*rIt > i) {
+                        candidates.push_back(*rIt);
+                    }
+                }
+            }
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+            auto& current = upper[i];
+            current.reserve(candidates.size());
+            for (auto j : candidates) {
+                auto left = iStart;
+                auto right = sets.begin() + set_ptrs[j], rEnd = sets.begin() + set_ptrs[j + 1];
+                std::size_t shared = 0;
+                std::size_t min_rank_sum = static_cast<std::size_t>(-1);
+                while (left != iEnd && right != rEnd) {
+                    if (left->first < right->first) {
+                        ++left;
+                    } else if (right->first < left->first) {
+                        ++right;
+                    } else {
+                        ++shared;
+                        min_rank_sum = std::min(min_rank_sum, static_cast<std::size_t>(left->second) + static_cast<std::size_t>(right->second));
+                        ++left;
+                        ++right;
+                    }
+                }
+
+                double weight = 0;
+                switch (scheme) {
+                    case SnnWeightScheme::RANKED:
+                        weight = static_cast<double>(neighbors[i].size() + 1) - static_cast<double>(min_rank_sum) / 2;
+                        break;
+                    case SnnWeightScheme::NUMBER:
+                        weight = shared;
+                        break;
+                    case SnnWeightScheme::JACCARD:
+                        weight = static_cast<double>(shared) / static_cast<double>((iEnd - iStart) + (rEnd - (sets.begin() + set_ptrs[j])) - shared);
+                        break;
+                }
+                current.emplace_back(j, weight);
+            }
+        }
+    });
+
+    // Mirroring the upper triangle to obtain a symmetric graph. As we iterate
+    // over 'i' in increasing order, the lower-triangular entries of each row
+    // are added in sorted order before its upper-triangular entries.
+    CompressedGraph<Index_, double> output;
+    output.pointers.resize(sanisizer::sum<std::size_t>(nobs, 1));
+    for (Index_ i = 0; i < nobs; ++i) {
+        output.pointers[i + 1] += upper[i].size();
+        for (const auto& edge : upper[i]) {
+            ++output.pointers[edge.first + 1];
+        }
+    }
+    for (Index_ i = 0; i < nobs; ++i) {
+        output.pointers[i + 1] += output.pointers[i];
+    }
+
+    output.indices.resize(output.pointers.back());
+    output.weights.resize(output.pointers.back());
+    std::vector<std::size_t> fill(output.pointers.begin(), output.pointers.end() - 1);
+    for (Index_ i = 0; i < nobs; ++i) {
+        for (const auto& edge : upper[i]) {
+            auto& pos = fill[edge.first];
+            output.indices[pos] = i;
+            output.weights[pos] = edge.second;
+            ++pos;
+        }
+    }
+    for (Index_ i = 0; i < nobs; ++i) {
+        auto& pos = fill[i];
+        for (const auto& edge : upper[i]) {
+            output.indices[pos] = edge.first;
+            output.weights[pos] = edge.second;
+            ++pos;
+        }
+        std::vector<std::pair<Index_, double> >().swap(upper[i]);
+    }
+
+    return output;
+}
+
+/**
+ * Overload of `build_snn_graph()` that performs an all-versus-all search on a prebuilt index to obtain the nearest neighbors of each observation.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ *
+ * @param prebuilt A prebuilt index, e.g., created by `HnswBuilder`.
+ * @param k Number of nearest neighbors for each observation.
+ * @param scheme Weighting scheme for the edges.
+ * @param num_threads Number of threads to use.
+ *
+ * @return Symmetric SNN graph, see the other overload for details.
+ */
+template<typename Index_, typename Data_, typename Distance_>
+CompressedGraph<Index_, double> build_snn_graph(const knncolle::Prebuilt<Index_, Data_, Distance_>& prebuilt, int k, SnnWeightScheme scheme, int num_threads = 1) {
+    auto neighbors = knncolle::find_nearest_neighbors(prebuilt, k, num_threads);
+    return build_snn_graph(neighbors, scheme, num_threads);
+}
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef KNNCOLLE_HNSW_NN_DESCENT_HPP
+#define KNNCOLLE_HNSW_NN_DESCENT_HPP
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <mutex>
+#include <cstddef>
+#include <cmath>
+
+#include "hnswlib/hnswalg.h"
+#include "sanisizer/sanisizer.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include "utils.hpp"
+
+/**
+ * @file nn_descent.hpp
+ * @brief Approximate nearest neighbor graph construction with NN-descent.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+template<typename HnswData_>
+struct DescentNeighbor {
+    HnswData_ distance;
+    hnswlib::tableint id;
+    bool fresh; // whether this neighbor has not yet been used as a new candidate in a local join.
+    int round; // iteration in which this neighbor was added, or 0 for the initialization.
+};
+
+template<typename HnswData_>
+bool operator<(const DescentNeighbor<HnswData_>& left, const DescentNeighbor<HnswData_>& right) {
+    // Breaking ties by ID so that the neighbor lists do not depend on the order of updates.
+    if (left.distance == right.distance) {
+        return left.id < right.id;
+    }
+    return left.distance < right.distance;
+}
+
+// Samples 'm' distinct values from [0, n) with Floyd's algorithm.
+template<typename Value_, class Engine_>
+void sample_floyd(Value_ n, Value_ m, Engine_& rng, std::vector<Value_>& chosen) {
+    chosen.clear();
+    for (Value_ j = n - m; j < n; ++j) {
+        const Value_ t = std::uniform_int_distribution<Value_>(0, j)(rng);
+        if (std::find(chosen.begin(), chosen.end(), t) == chosen.end()) {
+            chosen.push_back(t);
+        } else {
+            chosen.push_back(j);
+        }
+    }
+}
+
+// Each observation gets its own generator for each iteration, so that the
+// sampling does not depend on the number of threads.
+inline std::mt19937_64 create_descent_rng(std::size_t seed, int iteration, std::size_t obs, std::size_t phase) {
+    std::seed_seq seq{ seed, static_cast<std::size_t>(iteration), obs, phase };
+    return std::mt19937_64(seq);
+}
+
+// Attempts to add 'candidate' to a neighbor list that is organized as a max-heap.
+template<typename HnswData_>
+void update_descent_heap(std::vector<DescentNeighbor<HnswData_> >& heap, DescentNeighbor<HnswData_> candidate) {
+    if (!(candidate < heap.front())) {
+        return;
+    }
+    for (const auto& current : heap) {
+        if (current.id == candidate.id) {
+            return;
+        }
+    }
+    std::pop_heap(heap.begin(), heap.end());
+    heap.back() = candidate;
+    std::push_heap(heap.begin(), heap.end());
+}
+
+// Builds an approximate k-nearest neighbor graph from the data already stored
+// in the index, using the NN-descent algorithm of Dong et al. (2011). Each
+// iteration performs a local join where the neighbors (and reverse neighbors)
+// of each observation are compared to each other, which is done in parallel
+// across observations. As in the paper, at most 'rho * k' of the new
+// neighbors are sampled for each join, and the reverse neighbor lists are
+// capped at the same size, so that hubs do not dominate the cost of each
+// iteration. As the join only reads the candidate lists from the start of
+// the iteration, and each neighbor list is just the top 'k' of all proposed
+// neighbors, the result does not depend on the number of threads.
+// 'progress(n)' is called with the number of completed iterations after each
+// iteration.
+template<typename Index_, typename HnswData_, class Progress_>
+knncolle::NeighborList<Index_, HnswData_> nn_descent(
+    hnswlib::HierarchicalNSW<HnswData_>& index,
+    Index_ num_obs,
+    int num_neighbors,
+    int max_iterations,
+    double delta,
+    double rho,
+    std::size_t seed,
+    int num_threads,
+    Progress_ progress)
+{
+    knncolle::NeighborList<Index_, HnswData_> output(num_obs);
+    if (num_obs <= 1) {
+        return output;
+    }
+    const std::size_t k = std::min(static_cast<std::size_t>(std::max(num_neighbors, 1)), static_cast<std::size_t>(num_obs - 1));
+    const std::size_t sample_size = std::max(static_cast<std::size_t>(std::ceil(rho * static_cast<double>(k))), static_cast<std::size_t>(1));
+
+    auto distance = [&](hnswlib::tableint x, hnswlib::tableint y) -> HnswData_ {
+        return index.fstdistfunc_(index.getDataByInternalId(x), index.getDataByInternalId(y), index.dist_func_param_);
+    };
+
+    // Initializing each observation with random neighbors, using Floyd's
+    // algorithm to sample without replacement. Each observation gets its own
+    // generator so that the initialization does not depend on the number of threads.
+    std::vector<std::vector<DescentNeighbor<HnswData_> > > heaps(num_obs);
+    knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+        std::vector<hnswlib::tableint> chosen;
+        chosen.reserve(k);
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            std::mt19937_64 rng(seed + static_cast<std::size_t>(i));
+            sample_floyd<hnswlib::tableint>(num_obs - 1, k, rng, chosen);
+
+            auto& current = heaps[i];
+            current.reserve(k);
+            for (auto c : chosen) {
+                const hnswlib::tableint id = c + (c >= static_cast<hnswlib::tableint>(i)); // skipping over 'i' itself.
+                current.push_back(DescentNeighbor<HnswData_>{ distance(i, id), id, true, 0 });
+            }
+            std::make_heap(current.begin(), current.end());
+        }
+    });
+
+    std::vector<std::vector<hnswlib::tableint> > new_cands(num_obs), old_cands(num_obs);
+    std::vector<std::size_t> new_ptrs(sanisizer::sum<std::size_t>(num_obs, 1)), old_ptrs(new_ptrs.size());
+    std::vector<hnswlib::tableint> new_reverse, old_reverse;
+    std::vector<std::mutex> locks(std::min(static_cast<std::size_t>(num_obs), static_cast<std::size_t>(65536)));
+
+    auto build_reverse = [&](const std::vector<std::vector<hnswlib::tableint> >& cands, std::vector<std::size_t>& ptrs, std::vector<hnswlib::tableint>& reverse) -> void {
+        std::fill(ptrs.begin(), ptrs.end(), 0);
+        for (const auto& current : cands) {
+            for (auto j : current) {
+                ++ptrs[j + 1];
+            }
+        }
+        for (Index_ i = 0; i < num_obs; ++i) {
+            ptrs[i + 1] += ptrs[i];
+        }
+        reverse.resize(ptrs.back());
+        std::vector<std::size_t> fill(ptrs.begin(), ptrs.end() - 1);
+        for (Index_ i = 0; i < num_obs; ++i) {
+            for (auto j : cands[i]) {
+                reverse[fill[j]++] = i;
+            }
+        }
+    };
+
+    // Sampling 'sample_size' entries of 'values' in place, if there are more than that.
+    auto subsample = [&](std::vector<hnswlib::tableint>& values, std::mt19937_64& rng, std::vector<hnswlib::tableint>& chosen, std::vector<hnswlib::tableint>& buffer) -> void {
+        sample_floyd<hnswlib::tableint>(values.size(), sample_size, rng, chosen);
+        buffer.clear();
+        for (auto c : chosen) {
+            buffer.push_back(values[c]);
+        }
+        values.swap(buffer);
+    };
+
+    for (int iter = 0; iter < max_iterations; ++iter) {
+        // Splitting each observation's neighbors into new and old candidates.
+        // Only the sampled new candidates are marked as used; the others
+        // remain fresh for the next iteration. The new candidates are sorted
+        // before sampling as the heap layout depends on the update order.
+        knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+            std::vector<hnswlib::tableint> chosen, buffer;
+            for (Index_ i = start, end = start + length; i < end; ++i) {
+                auto& curnew = new_cands[i];
+                auto& curold = old_cands[i];
+                curnew.clear();
+                curold.clear();
+                for (const auto& nn : heaps[i]) {
+                    if (nn.fresh) {
+                        curnew.push_back(nn.id);
+                    } else {
+                        curold.push_back(nn.id);
+                    }
+                }
+
+                if (curnew.size() > sample_size) {
+                    std::sort(curnew.begin(), curnew.end());
+                    auto rng = create_descent_rng(seed, iter, i, 0);
+                    subsample(curnew, rng, chosen, buffer);
+                    std::sort(curnew.begin(), curnew.end());
+                    for (auto& nn : heaps[i]) {
+                        if (nn.fresh && std::binary_search(curnew.begin(), curnew.end(), nn.id)) {
+                            nn.fresh = false;
+                        }
+                    }
+                } else {
+                    for (auto& nn : heaps[i]) {
+                        nn.fresh = false;
+                    }
+                }
+            }
+        });
+        build_reverse(new_cands, new_ptrs, new_reverse);
+        build_reverse(old_cands, old_ptrs, old_reverse);
+
+        auto propose = [&](hnswlib::tableint x, hnswlib::tableint y) -> void {
+            const auto d = distance(x, y);
+            {
+                std::lock_guard<std::mutex> lck(locks[x % locks.size()]);
+                update_descent_heap(heaps[x], DescentNeighbor<HnswData_>{ d, y, true, iter + 1 });
+            }
+            {
+                std::lock_guard<std::mutex> lck(locks[y % locks.size()]);
+                update_descent_heap(heaps[y], DescentNeighbor<HnswData_>{ d, x, true, iter + 1 });
+            }
+        };
+
+        // Local join between the neighbors of each observation, after capping
+        // the reverse neighbors at 'sample_size'. The reverse lists are
+        // filled in order of observation, so the sampling is reproducible.
+        knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+            std::vector<hnswlib::tableint> all_new, all_old, reverse, chosen, buffer;
+            for (Index_ i = start, end = start + length; i < end; ++i) {
+                const bool cap_new = (new_ptrs[i + 1] - new_ptrs[i] > sample_size);
+                const bool cap_old = (old_ptrs[i + 1] - old_ptrs[i] > sample_size);
+                std::mt19937_64 rng;
+                if (cap_new || cap_old) {
+                    rng = create_descent_rng(seed, iter, i, 1);
+                }
+
+                all_new = new_cands[i];
+                if (cap_new) {
+                    reverse.assign(new_reverse.begin() + new_ptrs[i], new_reverse.begin() + new_ptrs[i + 1]);
+                    subsample(reverse, rng, chosen, buffer);
+                    all_new.insert(all_new.end(), reverse.begin(), reverse.end());
+                } else {
+                    all_new.insert(all_new.end(), new_reverse.begin() + new_ptrs[i], new_reverse.begin() + new_ptrs[i + 1]);
+                }
+                std::sort(all_new.begin(), all_new.end());
+                all_new.erase(std::unique(all_new.begin(), all_new.end()), all_new.end());
+
+                all_old = old_cands[i];
+                if (cap_old) {
+                    reverse.assign(old_reverse.begin() + old_ptrs[i], old_reverse.begin() + old_ptrs[i + 1]);
+                    subsample(reverse, rng, chosen, buffer);
+                    all_old.insert(all_old.end(), reverse.begin(), reverse.end());
+                } else {
+                    all_old.insert(all_old.end(), old_reverse.begin() + old_ptrs[i], old_reverse.begin() + old_ptrs[i + 1]);
+                }
+                std::sort(all_old.begin(), all_old.end());
+                all_old.erase(std::unique(all_old.begin(), all_old.end()), all_old.end());
+
+                for (I<decltype(all_new.size())> a = 0, num_new = all_new.size(); a < num_new; ++a) {
+                    for (I<decltype(num_new)> b = a + 1; b < num_new; ++b) {
+                        propose(all_new[a], all_new[b]);
+                    }
+                    for (auto o : all_old) {
+                        if (o != all_new[a]) {
+                            propose(all_new[a], o);
+                        }
+                    }
+                }
+            }
+        });
+
+        progress(iter + 1);
+
+        // Stopping if only a small fraction of the neighbors changed.
+        std::size_t num_updated = 0;
+        for (const auto& current : heaps) {
+            for (const auto& nn : current) {
+                num_updated += (nn.round == iter + 1);
+            }
+        }
+        if (static_cast<double>(num_updated) <= delta * static_cast<double>(k) * static_cast<double>(num_obs)) {
+            break;
+        }
+    }
+
+    knncolle::parallelize(num_threads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+        for (Index_ i = start, end = start + length; i < end; ++i) {
+            auto& current = heaps[i];
+            std::sort(current.begin(), current.end());
+            auto& out = output[i];
+            out.reserve(current.size());
+            for (const auto& nn : current) {
+                out.emplace_back(nn.id, nn.distance);
+            }
+            current.clear();
+            current.shrink_to_fit();
+        }
+    });
+
+    return output;
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef KNNCOLLE_HNSW_PLACEMENT_HPP
+#define KNNCOLLE_HNSW_PLACEMENT_HPP
+
+#include <cstddef>
+#include <climits>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @file placement.hpp
+ * @brief Placement of the HNSW index in memory.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+struct Level0Placement {
+    bool huge_pages = false;
+    bool numa_interleave = false;
+};
+
+#ifdef __linux__
+inline void interleave_across_numa_nodes(void* ptr, std::size_t len) {
+#ifdef SYS_mbind
+    constexpr std::size_t bits_per_word = sizeof(unsigned long) * CHAR_BIT;
+    std::vector<unsigned long> mask;
+    std::size_t num_nodes = 0;
+
+    std::error_code ec;
+    std::filesystem::directory_iterator it("/sys/devices/system/node", ec);
+    if (ec) {
+        return;
+    }
+    for (const auto& entry : it) {
+        const auto name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0 || name.find_first_not_of("0123456789", 4) != std::string::npos) {
+            continue;
+        }
+        const std::size_t node = std::stoul(name.substr(4));
+        if (node / bits_per_word >= mask.size()) {
+            mask.resize(node / bits_per_word + 1);
+        }
+        mask[node / bits_per_word] |= (1ul << (node % bits_per_word));
+        ++num_nodes;
+    }
+
+    if (num_nodes > 1) {
+        constexpr int mpol_interleave = 3; // from linux/mempolicy.h, which we don't want to depend on.
+        // Failure is not fatal as we just get the default placement policy.
+        syscall(SYS_mbind, ptr, len, mpol_interleave, mask.data(), mask.size() * bits_per_word + 1, 0);
+    }
+#else
+    (void)ptr;
+    (void)len;
+#endif
+}
+#endif
+
+// Returns a mapping of at least 'size' bytes that satisfies the requested
+// placement, setting 'mapped_size' to the length of the mapping. NULL is
+// returned if no special placement is requested, or it is not supported on
+// this platform, or the mapping fails; the caller should then fall back to
+// the usual allocation with malloc().
+inline char* map_level0(std::size_t size, const Level0Placement& placement, std::size_t& mapped_size) {
+    if ((!placement.huge_pages && !placement.numa_interleave) || size == 0) {
+        return NULL;
+    }
+
+#ifdef __linux__
+    void* ptr = MAP_FAILED;
+    std::size_t len = size;
+
+#ifdef MAP_HUGETLB
+    if (placement.huge_pages) {
+        // Explicit huge pages only work if the system has reserved some, so
+        // we need to be prepared to fall back to transparent huge pages.
+        constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+        const std::size_t huge_len = (size / huge_page_size + (size % huge_page_size > 0)) * huge_page_size;
+        ptr = mmap(NULL, huge_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            len = huge_len;
+        }
+    }
+#endif
+
+    if (ptr == MAP_FAILED) {
+        ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (placement.huge_pages) {
+            madvise(ptr, len, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    // This must be done before the pages are touched for the first time.
+    if (placement.numa_interleave) {
+        interleave_across_numa_nodes(ptr, len);
+    }
+
+    mapped_size = len;
+    return static_cast<char*>(ptr);
+
+#else
+    (void)mapped_size;
+    return NULL;
+#endif
+}
+
+inline void unmap_level0(char* ptr, std::size_t mapped_size) {
+#ifdef __linux__
+    munmap(ptr, mapped_size);
+#else
+    (void)ptr;
+    (void)mapped_size;
+#endif
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef KNNCOLLE_HNSW_RESULT_CACHE_HPP
+#define KNNCOLLE_HNSW_RESULT_CACHE_HPP
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+#include <cstddef>
+
+/**
+ * @file result_cache.hpp
+ * @brief Cache of search results for observations in an HNSW index.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @brief Statistics for the result cache of an HNSW index.
+ */
+struct HnswResultCacheStatistics {
+    /**
+     * Number of searches that were served from the cache.
+     */
+    std::size_t hits = 0;
+
+    /**
+     * Number of searches that were not served from the cache, either because the observation was not cached or because it was cached with a smaller number of neighbors.
+     */
+    std::size_t misses = 0;
+
+    /**
+     * Number of observations currently in the cache.
+     */
+    std::size_t num_entries = 0;
+
+    /**
+     * Approximate number of bytes used by the cached results.
+     */
+    std::size_t bytes = 0;
+};
+
+/**
+ * @cond
+ */
+// Thread-safe LRU cache of search results, keyed by the observation index.
+// Each entry holds the neighbors for the largest 'k' requested so far, so any
+// request with a smaller 'k' can be served by truncation. Distances are stored
+// after normalization so that hits can be copied directly to the output.
+template<typename Index_, typename Distance_>
+class ResultCache {
+public:
+    ResultCache(std::size_t max_bytes) : my_max_bytes(max_bytes) {}
+
+private:
+    struct Entry {
+        Index_ observation;
+        Index_ k; // may be larger than the number of neighbors, if fewer were available.
+        std::vector<Index_> indices;
+        std::vector<Distance_> distances;
+    };
+
+    std::size_t my_max_bytes;
+    std::size_t my_bytes = 0;
+    std::size_t my_hits = 0, my_misses = 0;
+
+    std::mutex my_lock;
+    std::list<Entry> my_entries; // from most to least recently used.
+    std::unordered_map<Index_, typename std::list<Entry>::iterator> my_lookup;
+
+    static std::size_t entry_bytes(std::size_t num) {
+        // Including a rough estimate of the overhead of the list and map nodes.
+        return num * (sizeof(Index_) + sizeof(Distance_)) + sizeof(Entry) + 4 * sizeof(void*);
+    }
+
+    void erase(typename std::list<Entry>::iterator it) {
+        my_bytes -= entry_bytes(it->indices.size());
+        my_lookup.erase(it->observation);
+        my_entries.erase(it);
+    }
+
+public:
+    bool lookup(Index_ i, Index_ k, std::vector<Index_>* output_indices, std::vector<Distance_>* output_distances) {
+        std::lock_guard<std::mutex> lck(my_lock);
+        auto found = my_lookup.find(i);
+        if (found == my_lookup.end() || found->second->k < k) {
+            ++my_misses;
+            return false;
+        }
+
+        auto it = found->second;
+        const auto num = std::min(it->indices.size(), static_cast<std::size_t>(k));
+        if (output_indices) {
+            output_indices->assign(it->indices.begin(), it->indices.begin() + num);
+        }
+        if (output_distances) {
+            output_distances->assign(it->distances.begin(), it->distances.begin() + num);
+        }
+        my_entries.splice(my_entries.begin(), my_entries, it);
+        ++my_hits;
+        return true;
+    }
+
+    void store(Index_ i, Index_ k, const std::vector<Index_>& indices, const std::vector<Distance_>& distances) {
+        const auto needed = entry_bytes(indices.size());
+        if (needed > my_max_bytes) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lck(my_lock);
+        auto found = my_lookup.find(i);
+        if (found != my_lookup.end()) {
+            if (found->second->k >= k) { // another thread already stored a larger result.
+                return;
+            }
+            erase(found->second);
+        }
+
+        while (my_bytes + needed > my_max_bytes) {
+            erase(std::prev(my_entries.end()));
+        }
+        my_entries.push_front(Entry{ i, k, indices, distances });
+        my_lookup[i] = my_entries.begin();
+        my_bytes += needed;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lck(my_lock);
+        my_entries.clear();
+        my_lookup.clear();
+        my_bytes = 0;
+    }
+
+    HnswResultCacheStatistics statistics() {
+        std::lock_guard<std::mutex> lck(my_lock);
+        HnswResultCacheStatistics output;
+        output.hits = my_hits;
+        output.misses = my_misses;
+        output.num_entries = my_entries.size();
+        output.bytes = my_bytes;
+        return output;
+    }
+};
+/**
+ * @endcond
+ */
+
+}
+
+#endif
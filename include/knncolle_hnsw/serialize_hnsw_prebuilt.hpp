@@ -0,0 +1,117 @@
+#ifndef KNNCOLLE_HNSW_SERIALIZE_PREBUILT_HPP
+#define KNNCOLLE_HNSW_SERIALIZE_PREBUILT_HPP
+
+#include "Hnsw.hpp"
+#include "load_hnsw_prebuilt.hpp"
+#include "index_io.hpp"
+
+#include <cstddef>
+#include <vector>
+
+#include "knncolle/knncolle.hpp"
+
+/**
+ * @file serialize_hnsw_prebuilt.hpp
+ * @brief Serialize a prebuilt HNSW index to and from memory.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * Serialize a prebuilt HNSW index into a stream of bytes, without touching the filesystem.
+ * This is the in-memory counterpart to `knncolle::Prebuilt::save()` and contains the same information.
+ * The serialized bytes can be used to recreate the index with `deserialize_hnsw_prebuilt()`,
+ * e.g., after passing them to another process via a pipe or shared memory.
+ *
+ * Only indices with distances known to `get_distance_name()` and without custom normalization can be serialized,
+ * as the custom saving functions in `custom_save_for_hnsw_distance()` and `custom_save_for_hnsw_normalize()` operate on directories.
+ * As with `knncolle::Prebuilt::save()`, the output is not guaranteed to be portable between machines or different versions of **knncolle_hnsw**.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ * @tparam Write_ Function that accepts a `const char*` pointer and a `std::size_t` number of bytes.
+ *
+ * @param prebuilt A prebuilt HNSW index, typically created by `HnswBuilder::build_known_unique()` or `load_hnsw_prebuilt()`.
+ * @param write Sink function that is called repeatedly with consecutive chunks of the serialized bytes.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_, class Write_>
+void serialize_hnsw_prebuilt(const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& prebuilt, Write_ write) {
+    prebuilt.serialize(std::move(write));
+}
+
+/**
+ * Overload of `serialize_hnsw_prebuilt()` that writes to a caller-provided buffer.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ *
+ * @param prebuilt A prebuilt HNSW index, typically created by `HnswBuilder::build_known_unique()` or `load_hnsw_prebuilt()`.
+ * @param[out] buffer Pointer to a buffer of length equal to `serialized_hnsw_prebuilt_size()`.
+ * For zero-copy deserialization, this should be aligned to a 64-byte boundary, e.g., the start of a shared memory segment.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+void serialize_hnsw_prebuilt(const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& prebuilt, char* buffer) {
+    prebuilt.serialize(buffer);
+}
+
+/**
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ *
+ * @param prebuilt A prebuilt HNSW index, typically created by `HnswBuilder::build_known_unique()` or `load_hnsw_prebuilt()`.
+ * @return Number of bytes required to serialize `prebuilt` with `serialize_hnsw_prebuilt()`.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_>
+std::size_t serialized_hnsw_prebuilt_size(const HnswPrebuilt<Index_, Data_, Distance_, HnswData_>& prebuilt) {
+    return prebuilt.serialized_size();
+}
+
+/**
+ * @param buffer Pointer to a buffer containing the output of `serialize_hnsw_prebuilt()`.
+ * @param size Length of the buffer.
+ *
+ * @return Template types of the serialized HNSW index.
+ * This is typically used to choose template parameters for `deserialize_hnsw_prebuilt()`.
+ */
+inline HnswPrebuiltTypes deserialize_hnsw_prebuilt_types(const char* buffer, std::size_t size) {
+    SerializedReader reader(buffer, size);
+    HnswPrebuiltTypes config;
+    config.data = read_serialized_preamble(reader);
+    return config;
+}
+
+/**
+ * Recreate a prebuilt HNSW index from the output of `serialize_hnsw_prebuilt()`.
+ * This is the in-memory counterpart to `load_hnsw_prebuilt()`.
+ *
+ * In zero-copy mode, the level 0 block of the HNSW graph (containing the base-layer links, observation data and labels) is used directly from `buffer`.
+ * This avoids a copy of the largest component of the index, which is most useful when `buffer` refers to shared memory.
+ * The caller is then responsible for ensuring that `buffer` is not modified or released for the lifetime of the returned index.
+ * Zero-copy mode requires `buffer` to be suitably aligned (see `serialize_hnsw_prebuilt()`), otherwise the level 0 block is silently copied.
+ *
+ * @tparam Index_ Integer type for the observation indices.
+ * @tparam Data_ Numeric type for the input and query data.
+ * @tparam Distance_ Floating-point type for the distances.
+ * @tparam HnswData_ Floating-point type for data in the HNSW index.
+ * This should be the same as the type reported by `deserialize_hnsw_prebuilt_types()`.
+ *
+ * @param buffer Pointer to a buffer containing the output of `serialize_hnsw_prebuilt()`.
+ * @param size Length of the buffer.
+ * @param zero_copy Whether to adopt the level 0 block in `buffer` without copying.
+ *
+ * @return Pointer to a `knncolle::Prebuilt` HNSW index.
+ */
+template<typename Index_, typename Data_, typename Distance_, typename HnswData_ = float>
+auto deserialize_hnsw_prebuilt(const char* buffer, std::size_t size, bool zero_copy = false) {
+    return new HnswPrebuilt<Index_, Data_, Distance_, HnswData_>(buffer, size, zero_copy);
+}
+
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include "hnswlib/hnswalg.h"
 
 #include <functional>
+#include <cstddef>
 #include <string>
 #include <type_traits>
 #include <filesystem>
@@ -15,6 +16,17 @@ namespace knncolle_hnsw {
  */
 template<typename Input_>
 using I = std::remove_cv_t<std::remove_reference_t<Input_> >;
+
+// Converts a contiguous block of 'n' values, e.g., from Data_ to HnswData_.
+// This is a plain indexed loop with an explicit cast, which compilers can
+// vectorize into packed conversions; callers should pass whole rows or
+// batches of rows rather than converting one value at a time.
+template<typename Input_, typename Output_>
+void convert_block(const Input_* input, std::size_t n, Output_* output) {
+    for (std::size_t i = 0; i < n; ++i) {
+        output[i] = static_cast<Output_>(input[i]);
+    }
+}
 /**
  * @endcond
  */
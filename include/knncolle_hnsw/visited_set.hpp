@@ -0,0 +1,354 @@
+#ifndef KNNCOLLE_HNSW_VISITED_SET_HPP
+#define KNNCOLLE_HNSW_VISITED_SET_HPP
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+#include "hnswlib/hnswalg.h"
+#include "sanisizer/sanisizer.hpp"
+
+#include "utils.hpp"
+#include "wave_build.hpp"
+
+/**
+ * @file visited_set.hpp
+ * @brief Per-searcher sets of visited nodes.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * Type of set used by each `knncolle::Searcher` to track the nodes that were visited during a search.
+ * Each searcher owns its own set, so searches in different threads do not contend for **hnswlib**'s shared pool of visited lists.
+ *
+ * - `EPOCH`: an array with one entry per node, where each entry is stamped with the identity of the last search that visited it.
+ *   This is the fastest option but each searcher uses memory proportional to the number of observations.
+ * - `HASH`: an open-addressing hash set containing only the visited nodes.
+ *   This uses memory proportional to the number of visited nodes, which is much smaller than the number of observations for searches with small `ef`.
+ * - `AUTO`: uses `HASH` if the number of nodes that might be visited in a search is small compared to the number of observations, otherwise `EPOCH`.
+ */
+enum class VisitedSetType : char { AUTO, EPOCH, HASH };
+
+/**
+ * @cond
+ */
+class EpochVisitedSet {
+public:
+    void reset(std::size_t num_nodes) {
+        if (my_marks.size() < num_nodes) {
+            sanisizer::resize(my_marks, num_nodes); // new entries are zero, so they are never equal to the current tag.
+        }
+        ++my_tag;
+        if (my_tag == 0) {
+            std::fill(my_marks.begin(), my_marks.end(), 0);
+            ++my_tag;
+        }
+    }
+
+    bool insert(hnswlib::tableint i) {
+        auto& mark = my_marks[i];
+        if (mark == my_tag) {
+            return false;
+        }
+        mark = my_tag;
+        return true;
+    }
+
+    std::size_t bytes() const {
+        return my_marks.size() * sizeof(hnswlib::vl_type);
+    }
+
+private:
+    std::vector<hnswlib::vl_type> my_marks;
+    hnswlib::vl_type my_tag = 0;
+};
+
+// Open-addressing hash set with linear probing. Slots are also stamped with
+// a tag so that the set can be reset without clearing the keys. The capacity
+// is always a power of two and the load factor is kept at or below 0.5.
+class HashVisitedSet {
+public:
+    static std::size_t expected_capacity(std::size_t expected) {
+        std::size_t capacity = 16;
+        while (capacity / 2 < expected) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    void reset(std::size_t expected) {
+        const auto capacity = expected_capacity(expected);
+        if (capacity > my_keys.size()) {
+            allocate(capacity);
+        }
+        ++my_tag;
+        if (my_tag == 0) {
+            std::fill(my_stamps.begin(), my_stamps.end(), 0);
+            ++my_tag;
+        }
+        my_size = 0;
+    }
+
+    bool insert(hnswlib::tableint i) {
+        if (2 * (my_size + 1) > my_keys.size()) {
+            grow();
+        }
+        if (!insert_raw(i)) {
+            return false;
+        }
+        ++my_size;
+        return true;
+    }
+
+    std::size_t bytes() const {
+        return my_keys.size() * (sizeof(hnswlib::tableint) + sizeof(hnswlib::vl_type));
+    }
+
+private:
+    std::vector<hnswlib::tableint> my_keys;
+    std::vector<hnswlib::vl_type> my_stamps;
+    hnswlib::vl_type my_tag = 0;
+    std::size_t my_size = 0;
+    int my_shift = 64;
+
+    void allocate(std::size_t capacity) {
+        my_keys.clear();
+        my_stamps.clear();
+        sanisizer::resize(my_keys, capacity);
+        sanisizer::resize(my_stamps, capacity);
+        my_tag = 1;
+        my_shift = 64;
+        for (std::size_t c = capacity; c > 1; c /= 2) {
+            --my_shift;
+        }
+    }
+
+    // Fibonacci hashing, taking the upper bits of the product.
+    std::size_t slot(hnswlib::tableint i) const {
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(i) * 0x9E3779B97F4A7C15ull) >> my_shift);
+    }
+
+    bool insert_raw(hnswlib::tableint i) {
+        const std::size_t mask = my_keys.size() - 1;
+        auto pos = slot(i);
+        while (my_stamps[pos] == my_tag) {
+            if (my_keys[pos] == i) {
+                return false;
+            }
+            pos = (pos + 1) & mask;
+        }
+        my_stamps[pos] = my_tag;
+        my_keys[pos] = i;
+        return true;
+    }
+
+    void grow() {
+        std::vector<hnswlib::tableint> existing;
+        existing.reserve(my_size);
+        for (I<decltype(my_keys.size())> s = 0, end = my_keys.size(); s < end; ++s) {
+            if (my_stamps[s] == my_tag) {
+                existing.push_back(my_keys[s]);
+            }
+        }
+        allocate(my_keys.size() * 2);
+        for (auto e : existing) {
+            insert_raw(e);
+        }
+    }
+};
+
+// Upper bound on the number of nodes visited by a base layer search, assuming
+// that about 'ef' nodes are expanded, each with up to 'max_links' neighbors.
+// This is only used to choose between the two types of visited sets, so it
+// doesn't have to be exact.
+inline std::size_t expected_visits(std::size_t max_links, std::size_t ef) {
+    return sanisizer::product_unsafe<std::size_t>(ef, max_links + 1);
+}
+
+// The hash set costs about 6 bytes per slot at a load factor of at most 0.5,
+// so it needs to be much smaller than the epoch array (2 bytes per node) to be
+// worth the slower lookups.
+inline bool use_hash_visited_set(VisitedSetType type, std::size_t visits, std::size_t num_nodes) {
+    if (type == VisitedSetType::AUTO) {
+        return visits < num_nodes / 32;
+    }
+    return type == VisitedSetType::HASH;
+}
+
+// Read-only view of an hnswlib::HierarchicalNSW graph, for use in
+// search_knn_with_visited(). Other graph representations can be searched by
+// providing the same methods.
+template<typename HnswData_>
+class HnswlibGraphView {
+public:
+    HnswlibGraphView(const hnswlib::HierarchicalNSW<HnswData_>& index) : my_index(index) {}
+
+private:
+    const hnswlib::HierarchicalNSW<HnswData_>& my_index;
+
+public:
+    std::size_t size() const {
+        return my_index.cur_element_count;
+    }
+
+    hnswlib::tableint entry_point() const {
+        return my_index.enterpoint_node_;
+    }
+
+    int max_level() const {
+        return my_index.maxlevel_;
+    }
+
+    std::size_t ef() const {
+        return my_index.ef_;
+    }
+
+    bool has_deleted() const {
+        return my_index.num_deleted_ != 0;
+    }
+
+    bool is_deleted(hnswlib::tableint i) const {
+        return my_index.isMarkedDeleted(i);
+    }
+
+    const hnswlib::linklistsizeint* links(hnswlib::tableint i, int level) const {
+        return (level == 0 ? my_index.get_linklist0(i) : my_index.get_linklist(i, level));
+    }
+
+    HnswData_ distance(const HnswData_* query, hnswlib::tableint i) const {
+        return my_index.fstdistfunc_(query, my_index.getDataByInternalId(i), my_index.dist_func_param_);
+    }
+
+    hnswlib::labeltype label(hnswlib::tableint i) const {
+        return my_index.getExternalLabel(i);
+    }
+};
+
+// Same as hnswlib::HierarchicalNSW::searchKnn() (or starting the base layer
+// search from the closest of 'entries', if not empty), but using a visited
+// set supplied by the caller instead of one from the index's shared pool.
+// 'visited' should already be reset, and the candidate queues should be
+// empty; they are left empty on return, with 'top_candidates' retaining
+// its allocation for the next search.
+template<typename HnswData_, class Graph_, class Visited_>
+void search_knn_with_visited(
+    const Graph_& graph,
+    const std::vector<hnswlib::tableint>& entries,
+    const HnswData_* query,
+    std::size_t k,
+    Visited_& visited,
+    CandidateQueue<HnswData_>& top_candidates,
+    CandidateQueue<HnswData_>& candidate_set,
+    std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> >& result)
+{
+    result = std::priority_queue<std::pair<HnswData_, hnswlib::labeltype> >();
+    if (graph.size() == 0) {
+        return;
+    }
+
+    auto get_count = [](const hnswlib::linklistsizeint* links) -> std::size_t {
+        return *reinterpret_cast<const unsigned short*>(links); // same as hnswlib::HierarchicalNSW::getListCount().
+    };
+
+    hnswlib::tableint current;
+    HnswData_ curdist;
+    if (!entries.empty()) {
+        // Same as closest_entry_point().
+        current = entries.front();
+        curdist = graph.distance(query, current);
+        for (I<decltype(entries.size())> e = 1, num = entries.size(); e < num; ++e) {
+            const auto d = graph.distance(query, entries[e]);
+            if (d < curdist) {
+                current = entries[e];
+                curdist = d;
+            }
+        }
+    } else {
+        current = graph.entry_point();
+        curdist = graph.distance(query, current);
+        for (int level = graph.max_level(); level > 0; --level) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                auto links = graph.links(current, level);
+                auto size = get_count(links);
+                auto neighbors = reinterpret_cast<const hnswlib::tableint*>(links + 1);
+                for (I<decltype(size)> n = 0; n < size; ++n) {
+                    const auto d = graph.distance(query, neighbors[n]);
+                    if (d < curdist) {
+                        curdist = d;
+                        current = neighbors[n];
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // Mirrors hnswlib::HierarchicalNSW::searchBaseLayerST() without a filter.
+    const std::size_t ef = std::max(graph.ef(), k);
+    const bool bare_bone_search = !graph.has_deleted();
+    HnswData_ lower_bound;
+    if (bare_bone_search || !graph.is_deleted(current)) {
+        lower_bound = curdist;
+        top_candidates.emplace(curdist, current);
+        candidate_set.emplace(-curdist, current);
+    } else {
+        lower_bound = std::numeric_limits<HnswData_>::max();
+        candidate_set.emplace(-lower_bound, current);
+    }
+    visited.insert(current);
+
+    while (!candidate_set.empty()) {
+        const auto top = candidate_set.top();
+        const HnswData_ candidate_dist = -top.first;
+        if (bare_bone_search ? candidate_dist > lower_bound : (candidate_dist > lower_bound && top_candidates.size() == ef)) {
+            break;
+        }
+        candidate_set.pop();
+
+        auto links = graph.links(top.second, 0);
+        auto size = get_count(links);
+        auto neighbors = reinterpret_cast<const hnswlib::tableint*>(links + 1);
+        for (I<decltype(size)> n = 0; n < size; ++n) {
+            const auto candidate = neighbors[n];
+            if (!visited.insert(candidate)) {
+                continue;
+            }
+            const auto d = graph.distance(query, candidate);
+            if (top_candidates.size() < ef || lower_bound > d) {
+                candidate_set.emplace(-d, candidate);
+                if (bare_bone_search || !graph.is_deleted(candidate)) {
+                    top_candidates.emplace(d, candidate);
+                }
+                while (top_candidates.size() > ef) {
+                    top_candidates.pop();
+                }
+                if (!top_candidates.empty()) {
+                    lower_bound = top_candidates.top().first;
+                }
+            }
+        }
+    }
+
+    candidate_set = CandidateQueue<HnswData_>();
+    while (top_candidates.size() > k) {
+        top_candidates.pop();
+    }
+    while (!top_candidates.empty()) {
+        const auto& top = top_candidates.top();
+        result.emplace(top.first, graph.label(top.second));
+        top_candidates.pop();
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
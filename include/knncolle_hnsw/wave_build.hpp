@@ -0,0 +1,214 @@
+#ifndef KNNCOLLE_HNSW_WAVE_BUILD_HPP
+#define KNNCOLLE_HNSW_WAVE_BUILD_HPP
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "hnswlib/hnswalg.h"
+#include "sanisizer/sanisizer.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include "utils.hpp"
+#include "index_io.hpp"
+
+/**
+ * @file wave_build.hpp
+ * @brief Deterministic parallel construction of the HNSW index.
+ */
+
+namespace knncolle_hnsw {
+
+/**
+ * @cond
+ */
+template<typename HnswData_>
+using CandidateQueue = std::priority_queue<
+    std::pair<HnswData_, hnswlib::tableint>,
+    std::vector<std::pair<HnswData_, hnswlib::tableint> >,
+    typename hnswlib::HierarchicalNSW<HnswData_>::CompareByFirst
+>;
+
+// Adds a node to the index without connecting it to anything, mirroring the
+// bookkeeping in hnswlib::HierarchicalNSW::addPoint(). The internal ID is
+// the number of nodes already in the index, which may not be the same as the
+// label if observations are not inserted in order. If 'links' is not NULL,
+// it should point to space for the node's upper-layer link lists from a
+// LinkArenaCursor, otherwise they are allocated separately as in hnswlib.
+template<typename HnswData_>
+void allocate_node(hnswlib::HierarchicalNSW<HnswData_>& index, hnswlib::labeltype label, const HnswData_* data, int level, char* links = NULL) {
+    if (index.cur_element_count >= index.max_elements_) {
+        throw std::runtime_error("number of elements exceeds the specified limit");
+    }
+    const hnswlib::tableint cur_c = index.cur_element_count;
+    index.cur_element_count++;
+    index.label_lookup_[label] = cur_c;
+    index.element_levels_[cur_c] = level;
+
+    std::memset(index.data_level0_memory_ + cur_c * index.size_data_per_element_ + index.offsetLevel0_, 0, index.size_data_per_element_);
+    std::memcpy(index.getExternalLabeLp(cur_c), &label, sizeof(hnswlib::labeltype));
+    if (data) { // otherwise, the caller will fill in the data later.
+        std::memcpy(index.getDataByInternalId(cur_c), data, index.data_size_);
+    }
+
+    if (level) {
+        if (links) {
+            index.linkLists_[cur_c] = links;
+            std::memset(links, 0, index.size_links_per_element_ * level);
+        } else {
+            const std::size_t size = index.size_links_per_element_ * level + 1;
+            index.linkLists_[cur_c] = static_cast<char*>(std::malloc(size));
+            if (index.linkLists_[cur_c] == NULL) {
+                throw std::bad_alloc();
+            }
+            std::memset(index.linkLists_[cur_c], 0, size);
+        }
+    }
+}
+
+// Draws the level of each observation in the hierarchy, in order of insertion.
+template<typename Index_, typename HnswData_>
+std::vector<int> draw_levels(hnswlib::HierarchicalNSW<HnswData_>& index, Index_ num_obs) {
+    auto levels = sanisizer::create<std::vector<int> >(num_obs);
+    for (auto& level : levels) {
+        level = index.getRandomLevel(index.mult_);
+    }
+    return levels;
+}
+
+// Inserts all observations into an empty index in waves of 'wave_size'. For
+// each wave, the candidate neighbors of each new observation are found by
+// searching the graph as it was at the start of the wave, which can be done
+// in parallel as the graph is not modified. Earlier observations in the same
+// wave are added as candidates by brute force. The links are then committed
+// serially in order of insertion. This means that the final graph only
+// depends on 'wave_size' and the seed of the level generator, and not on the
+// number of threads. 'next(ptr)' should fill 'ptr' with the data for the next
+// observation to insert and return its label, while 'progress(n)' is called
+// with the total number of inserted observations after each wave. All levels
+// are drawn up front, so that the upper-layer link lists can be allocated
+// from a single arena in 'storage'; this does not change the levels as the
+// level generator is not used elsewhere during insertion.
+template<typename Index_, typename HnswData_, class Next_, class Progress_>
+void insert_in_waves(IndexStorage<HnswData_>& storage, Index_ num_obs, std::size_t num_dim, Next_ next, std::size_t wave_size, int num_threads, Progress_ progress) {
+    auto& index = storage.index;
+    const auto all_levels = draw_levels(index, num_obs);
+    LinkArenaCursor<HnswData_> arena(storage, all_levels);
+
+    // No point having a wave that is larger than the number of observations.
+    const Index_ full_wave = std::max(std::min(wave_size, static_cast<std::size_t>(num_obs)), static_cast<std::size_t>(1));
+    auto buffer = sanisizer::create<std::vector<HnswData_> >(sanisizer::product<typename std::vector<HnswData_>::size_type>(num_dim, full_wave));
+    std::vector<int> levels;
+    std::vector<hnswlib::labeltype> labels;
+    std::vector<std::vector<CandidateQueue<HnswData_> > > candidates;
+
+    for (Index_ start = 0; start < num_obs; start += full_wave) {
+        const Index_ length = std::min(full_wave, static_cast<Index_>(num_obs - start));
+
+        levels.resize(length);
+        labels.resize(length);
+        candidates.resize(length);
+        for (Index_ w = 0; w < length; ++w) {
+            labels[w] = next(buffer.data() + sanisizer::product_unsafe<std::size_t>(w, num_dim));
+            levels[w] = all_levels[start + w];
+            candidates[w].clear();
+            candidates[w].resize(levels[w] + 1);
+        }
+
+        const bool frozen_empty = (index.cur_element_count == 0);
+        const int frozen_maxlevel = index.maxlevel_;
+        const auto frozen_entry = index.enterpoint_node_;
+
+        knncolle::parallelize(num_threads, length, [&](int, Index_ wstart, Index_ wlength) -> void {
+            for (Index_ w = wstart, wend = wstart + wlength; w < wend; ++w) {
+                const HnswData_* query = buffer.data() + sanisizer::product_unsafe<std::size_t>(w, num_dim);
+                const int curlevel = levels[w];
+                auto& current = candidates[w];
+
+                if (!frozen_empty) {
+                    auto currObj = frozen_entry;
+                    auto curdist = index.fstdistfunc_(query, index.getDataByInternalId(currObj), index.dist_func_param_);
+                    for (int level = frozen_maxlevel; level > curlevel; --level) {
+                        bool changed = true;
+                        while (changed) {
+                            changed = false;
+                            auto data = index.get_linklist(currObj, level);
+                            auto size = index.getListCount(data);
+                            auto datal = reinterpret_cast<const hnswlib::tableint*>(data + 1);
+                            for (I<decltype(size)> i = 0; i < size; ++i) {
+                                auto d = index.fstdistfunc_(query, index.getDataByInternalId(datal[i]), index.dist_func_param_);
+                                if (d < curdist) {
+                                    curdist = d;
+                                    currObj = datal[i];
+                                    changed = true;
+                                }
+                            }
+                        }
+                    }
+
+                    for (int level = std::min(curlevel, frozen_maxlevel); level >= 0; --level) {
+                        current[level] = index.searchBaseLayer(currObj, query, level);
+
+                        // Using the closest candidate as the entry point for the next level, as done by mutuallyConnectNewElement().
+                        auto copy = current[level];
+                        while (copy.size() > 1) {
+                            copy.pop();
+                        }
+                        currObj = copy.top().second;
+                    }
+                }
+
+                for (Index_ prev = 0; prev < w; ++prev) {
+                    const HnswData_* other = buffer.data() + sanisizer::product_unsafe<std::size_t>(prev, num_dim);
+                    const auto d = index.fstdistfunc_(query, other, index.dist_func_param_);
+                    const hnswlib::tableint id = start + prev;
+                    for (int level = 0, last = std::min(curlevel, levels[prev]); level <= last; ++level) {
+                        auto& queue = current[level];
+                        queue.emplace(d, id);
+                        if (queue.size() > index.ef_construction_) {
+                            queue.pop();
+                        }
+                    }
+                }
+            }
+        });
+
+        for (Index_ w = 0; w < length; ++w) {
+            const Index_ i = start + w;
+            const HnswData_* query = buffer.data() + sanisizer::product_unsafe<std::size_t>(w, num_dim);
+            const int curlevel = levels[w];
+            const bool first = (index.cur_element_count == 0);
+            allocate_node(index, labels[w], query, curlevel, arena.next(curlevel));
+
+            if (first) {
+                index.enterpoint_node_ = i;
+                index.maxlevel_ = curlevel;
+                continue;
+            }
+
+            auto& current = candidates[w];
+            for (int level = curlevel; level >= 0; --level) {
+                if (!current[level].empty()) {
+                    index.mutuallyConnectNewElement(query, i, current[level], level, false);
+                }
+            }
+            if (curlevel > index.maxlevel_) {
+                index.enterpoint_node_ = i;
+                index.maxlevel_ = curlevel;
+            }
+        }
+
+        progress(start + length);
+    }
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -5,6 +5,8 @@
 #include <tuple>
 #include <cmath>
 #include <random>
+#include <numeric>
+#include <algorithm>
 
 #include "TestCore.h"
 
@@ -243,6 +245,550 @@ TEST_F(HnswMiscTest, CustomNormalize) {
         auto expected = eudist.raw(ndim, current, ptr);
         EXPECT_LT(std::abs((expected + 1) - dres.back()), 0.0001);
     }
+
+    // Same results with a block normalization function.
+    auto blockconfig = knncolle_hnsw::makeEuclideanDistanceConfig<float>();
+    blockconfig.normalize_method = knncolle_hnsw::DistanceNormalizeMethod::CUSTOM;
+    blockconfig.custom_normalize_block = knncolle_hnsw::block_normalize<double>([](float x) -> float { return x + 1; });
+    knncolle_hnsw::HnswBuilder<int, double, double> bbuilder(std::move(blockconfig)); 
+    auto bbptr = bbuilder.build_unique(mat);
+    auto bbsptr = bbptr->initialize();
+
+    std::vector<int> ires2;
+    std::vector<double> dres2;
+    for (int x = 0; x < nobs; ++x) {
+        bsptr->search(x, 10, &ires, &dres);
+        bbsptr->search(x, 10, &ires2, &dres2);
+        EXPECT_EQ(ires, ires2);
+        EXPECT_EQ(dres, dres2);
+
+        bsptr->search(data.data() + x * ndim, 10, &ires, &dres);
+        bbsptr->search(data.data() + x * ndim, 10, &ires2, &dres2);
+        EXPECT_EQ(ires, ires2);
+        EXPECT_EQ(dres, dres2);
+    }
+}
+
+TEST_F(HnswMiscTest, Placement) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_hnsw::HnswBuilder<int, double, double> ref(knncolle_hnsw::makeEuclideanDistanceConfig());
+    auto rptr = ref.build_unique(mat);
+    auto rsptr = rptr->initialize();
+
+    // Results should be the same regardless of where the index lives.
+    knncolle_hnsw::HnswOptions opt;
+    opt.huge_pages = true;
+    opt.numa_interleave = true;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+    auto bptr = builder.build_known_unique(mat);
+    auto bsptr = bptr->initialize();
+
+    const std::filesystem::path dir = "save-placement-tests";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+    knncolle_hnsw::HnswLoadOptions lopt;
+    lopt.huge_pages = true;
+    lopt.numa_interleave = true;
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > lptr(knncolle_hnsw::load_hnsw_prebuilt<int, double, double>(dir, lopt));
+    auto lsptr = lptr->initialize();
+
+    std::vector<int> ires, ires2, ires3;
+    std::vector<double> dres, dres2, dres3;
+    for (int x = 0; x < nobs; ++x) {
+        rsptr->search(x, 10, &ires, &dres);
+        bsptr->search(x, 10, &ires2, &dres2);
+        EXPECT_EQ(ires, ires2);
+        EXPECT_EQ(dres, dres2);
+        lsptr->search(x, 10, &ires3, &dres3);
+        EXPECT_EQ(ires, ires3);
+        EXPECT_EQ(dres, dres3);
+    }
+}
+
+TEST_F(HnswMiscTest, WaveBuild) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle::EuclideanDistance<double, double> eudist;
+
+    auto build_and_save = [&](const knncolle_hnsw::HnswOptions& opt, const std::string& name) -> std::string {
+        knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+        auto bptr = builder.build_unique(mat);
+        auto bsptr = bptr->initialize();
+
+        // Checking that the search is still accurate.
+        std::vector<int> ires;
+        std::vector<double> dres;
+        int found = 0;
+        for (int x = 0; x < nobs; ++x) {
+            bsptr->search(x, 5, &ires, &dres);
+            sanity_checks(ires, dres, 5, x);
+
+            std::vector<std::pair<double, int> > expected;
+            for (int y = 0; y < nobs; ++y) {
+                if (y != x) {
+                    expected.emplace_back(eudist.raw(ndim, data.data() + x * ndim, data.data() + y * ndim), y);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            for (int j = 0; j < 5; ++j) {
+                found += (std::find(ires.begin(), ires.end(), expected[j].second) != ires.end());
+            }
+        }
+        EXPECT_GT(found, nobs * 5 * 0.95);
+
+        const std::filesystem::path dir = name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        bptr->save(dir);
+        return knncolle::quick_load_as_string(dir / "INDEX");
+    };
+
+    knncolle_hnsw::HnswOptions opt;
+    opt.wave_size = 16;
+    opt.num_threads = 1;
+    auto serial = build_and_save(opt, "save-wave-serial");
+    opt.num_threads = 3;
+    auto parallel = build_and_save(opt, "save-wave-parallel");
+    EXPECT_EQ(serial, parallel);
+
+    // Link lists allocated from the arena during the build survive a round trip.
+    {
+        std::unique_ptr<knncolle::Prebuilt<int, double, double> > lptr(knncolle_hnsw::load_hnsw_prebuilt<int, double, double>("save-wave-serial"));
+        const std::filesystem::path dir = "save-wave-reloaded";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        lptr->save(dir);
+        EXPECT_EQ(knncolle::quick_load_as_string(dir / "INDEX"), serial);
+    }
+
+    // Seed is respected for the usual sequential build.
+    knncolle_hnsw::HnswOptions sopt;
+    sopt.seed = 42;
+    auto seeded = build_and_save(sopt, "save-seeded");
+    auto reseeded = build_and_save(sopt, "save-reseeded");
+    EXPECT_EQ(seeded, reseeded);
+}
+
+TEST_F(HnswMiscTest, BuildFromNeighbors) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle::EuclideanDistance<double, double> eudist;
+
+    // Computing the exact neighbors, including each observation itself.
+    int k = 10;
+    knncolle::NeighborList<int, double> exact(nobs);
+    for (int x = 0; x < nobs; ++x) {
+        std::vector<std::pair<double, int> > all;
+        for (int y = 0; y < nobs; ++y) {
+            all.emplace_back(eudist.raw(ndim, data.data() + x * ndim, data.data() + y * ndim), y);
+        }
+        std::sort(all.begin(), all.end());
+        for (int j = 0; j < k; ++j) {
+            exact[x].emplace_back(all[j].second, all[j].first);
+        }
+    }
+
+    knncolle_hnsw::HnswOptions opt;
+    opt.num_threads = 3;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+    auto bptr = builder.build_known_unique(mat, exact);
+    EXPECT_EQ(bptr->num_observations(), nobs);
+    EXPECT_EQ(bptr->num_dimensions(), ndim);
+
+    auto bsptr = bptr->initialize();
+    std::vector<int> ires;
+    std::vector<double> dres;
+    int found = 0;
+    for (int x = 0; x < nobs; ++x) {
+        bsptr->search(x, 5, &ires, &dres);
+        sanity_checks(ires, dres, 5, x);
+        for (int j = 1; j <= 5; ++j) {
+            found += (std::find(ires.begin(), ires.end(), exact[x][j].first) != ires.end());
+        }
+    }
+    EXPECT_GT(found, nobs * 5 * 0.95);
+
+    // Same results regardless of the number of threads.
+    auto save = [&](const knncolle::Prebuilt<int, double, double>& prebuilt, const std::string& name) -> std::string {
+        const std::filesystem::path dir = name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        prebuilt.save(dir);
+        return knncolle::quick_load_as_string(dir / "INDEX");
+    };
+    auto parallel = save(*bptr, "save-neighbors-parallel");
+    builder.get_options().num_threads = 1;
+    auto serial = save(*(builder.build_known_unique(mat, exact)), "save-neighbors-serial");
+    EXPECT_EQ(serial, parallel);
+
+    // Reloaded index gives the same results.
+    auto reloaded = knncolle_hnsw::HnswPrebuilt<int, double, double, float>("save-neighbors-serial");
+    auto rsptr = reloaded.initialize();
+    std::vector<int> ires2;
+    std::vector<double> dres2;
+    for (int x = 0; x < nobs; x += 10) {
+        bsptr->search(x, 5, &ires, &dres);
+        rsptr->search(x, 5, &ires2, &dres2);
+        EXPECT_EQ(ires, ires2);
+        EXPECT_EQ(dres, dres2);
+    }
+
+    // Checking for errors.
+    auto truncated = exact;
+    truncated.pop_back();
+    EXPECT_ANY_THROW(builder.build_known_unique(mat, truncated));
+    auto invalid = exact;
+    invalid[0].emplace_back(nobs, 0);
+    EXPECT_ANY_THROW(builder.build_known_unique(mat, invalid));
+}
+
+TEST_F(HnswMiscTest, NnDescent) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle::EuclideanDistance<double, double> eudist;
+
+    auto build_and_save = [&](const knncolle_hnsw::HnswOptions& opt, const std::string& name) -> std::string {
+        knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+        auto bptr = builder.build_unique(mat);
+        auto bsptr = bptr->initialize();
+
+        std::vector<int> ires;
+        std::vector<double> dres;
+        int found = 0;
+        for (int x = 0; x < nobs; ++x) {
+            bsptr->search(x, 5, &ires, &dres);
+            sanity_checks(ires, dres, 5, x);
+
+            std::vector<std::pair<double, int> > expected;
+            for (int y = 0; y < nobs; ++y) {
+                if (y != x) {
+                    expected.emplace_back(eudist.raw(ndim, data.data() + x * ndim, data.data() + y * ndim), y);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            for (int j = 0; j < 5; ++j) {
+                found += (std::find(ires.begin(), ires.end(), expected[j].second) != ires.end());
+            }
+        }
+        EXPECT_GT(found, nobs * 5 * 0.95);
+
+        const std::filesystem::path dir = name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        bptr->save(dir);
+        return knncolle::quick_load_as_string(dir / "INDEX");
+    };
+
+    knncolle_hnsw::HnswOptions opt;
+    opt.num_links = 8;
+    opt.nn_descent_iterations = 10;
+    opt.num_threads = 1;
+    auto serial = build_and_save(opt, "save-descent-serial");
+    opt.num_threads = 3;
+    auto parallel = build_and_save(opt, "save-descent-parallel");
+    EXPECT_EQ(serial, parallel);
+
+    // Sampling is also independent of the number of threads.
+    opt.nn_descent_rho = 0.5;
+    opt.num_threads = 1;
+    auto sampled_serial = build_and_save(opt, "save-descent-sampled-serial");
+    opt.num_threads = 3;
+    auto sampled_parallel = build_and_save(opt, "save-descent-sampled-parallel");
+    EXPECT_EQ(sampled_serial, sampled_parallel);
+    opt.nn_descent_rho = 1;
+
+    // Works with a single iteration, albeit with less accuracy.
+    opt.nn_descent_iterations = 1;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+    auto bptr = builder.build_unique(mat);
+    EXPECT_EQ(bptr->num_observations(), nobs);
+
+    // Edge cases with very few observations.
+    for (int small = 0; small <= 2; ++small) {
+        knncolle::SimpleMatrix<int, double> submat(ndim, small, data.data());
+        auto sptr = builder.build_unique(submat);
+        auto ssptr = sptr->initialize();
+        std::vector<int> ires;
+        std::vector<double> dres;
+        for (int x = 0; x < small; ++x) {
+            ssptr->search(x, 5, &ires, &dres);
+            EXPECT_EQ(ires.size(), small - 1);
+        }
+    }
+}
+
+TEST_F(HnswMiscTest, AlphaRefine) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle::EuclideanDistance<double, double> eudist;
+
+    auto check_and_save = [&](const knncolle_hnsw::HnswOptions& opt, const std::string& name) -> std::string {
+        knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+        auto bptr = builder.build_known_unique(mat);
+        EXPECT_EQ(bptr->alpha(), opt.alpha);
+        auto bsptr = bptr->initialize();
+
+        std::vector<int> ires;
+        std::vector<double> dres;
+        int found = 0;
+        for (int x = 0; x < nobs; ++x) {
+            bsptr->search(x, 5, &ires, &dres);
+            sanity_checks(ires, dres, 5, x);
+
+            std::vector<std::pair<double, int> > expected;
+            for (int y = 0; y < nobs; ++y) {
+                if (y != x) {
+                    expected.emplace_back(eudist.raw(ndim, data.data() + x * ndim, data.data() + y * ndim), y);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            for (int j = 0; j < 5; ++j) {
+                found += (std::find(ires.begin(), ires.end(), expected[j].second) != ires.end());
+            }
+        }
+        EXPECT_GT(found, nobs * 5 * 0.95);
+
+        // Alpha is persisted.
+        const std::filesystem::path dir = name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        bptr->save(dir);
+        knncolle_hnsw::HnswPrebuilt<int, double, double, float> reloaded(dir);
+        EXPECT_EQ(reloaded.alpha(), opt.alpha);
+
+        std::vector<char> buffer(bptr->serialized_size());
+        bptr->serialize(buffer.data());
+        knncolle_hnsw::HnswPrebuilt<int, double, double, float> deserialized(buffer.data(), buffer.size(), false);
+        EXPECT_EQ(deserialized.alpha(), opt.alpha);
+
+        return knncolle::quick_load_as_string(dir / "INDEX");
+    };
+
+    knncolle_hnsw::HnswOptions opt;
+    opt.num_links = 8;
+    opt.refine = true;
+    opt.alpha = 1.2;
+    opt.num_threads = 1;
+    auto serial = check_and_save(opt, "save-alpha-serial");
+    opt.num_threads = 3;
+    auto parallel = check_and_save(opt, "save-alpha-parallel");
+    EXPECT_EQ(serial, parallel);
+
+    // Refinement with the default alpha is different from no refinement.
+    opt.alpha = 1;
+    auto refined = check_and_save(opt, "save-alpha-refined");
+    opt.refine = false;
+    auto unrefined = check_and_save(opt, "save-alpha-unrefined");
+    EXPECT_NE(refined, unrefined);
+
+    // Alpha also applies to the NN-descent build.
+    opt.alpha = 1.5;
+    opt.nn_descent_iterations = 5;
+    check_and_save(opt, "save-alpha-descent");
+
+    // Older indices without an ALPHA file are still loadable.
+    std::filesystem::remove("save-alpha-descent/ALPHA");
+    knncolle_hnsw::HnswPrebuilt<int, double, double, float> legacy(std::filesystem::path("save-alpha-descent"));
+    EXPECT_EQ(legacy.alpha(), 1);
+}
+
+TEST_F(HnswMiscTest, Diagnostics) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig());
+    auto bptr = builder.build_known_unique(mat);
+
+    knncolle_hnsw::HnswDiagnosticsOptions dopt;
+    auto diag = bptr->diagnose(dopt);
+    EXPECT_TRUE(std::isnan(diag.recall));
+    ASSERT_FALSE(diag.layers.empty());
+    EXPECT_EQ(diag.entry_point_level + 1, static_cast<int>(diag.layers.size()));
+
+    EXPECT_EQ(diag.layers[0].num_nodes, nobs);
+    EXPECT_EQ(diag.layers[0].num_unreachable, 0);
+    std::size_t prev_nodes = nobs + 1;
+    for (const auto& layer : diag.layers) {
+        EXPECT_LT(layer.num_nodes, prev_nodes);
+        prev_nodes = layer.num_nodes;
+        EXPECT_EQ(std::accumulate(layer.degree_histogram.begin(), layer.degree_histogram.end(), static_cast<std::size_t>(0)), layer.num_nodes);
+    }
+    EXPECT_GE(diag.layers.back().num_nodes, 1);
+    EXPECT_EQ(diag.layers[0].degree_histogram.size(), 33); // i.e., 2 * num_links + 1.
+
+    EXPECT_EQ(diag.memory.level0 % nobs, 0);
+    EXPECT_GT(diag.memory.level0, nobs * ndim * sizeof(float));
+    EXPECT_GT(diag.memory.visited_list, 0);
+    EXPECT_GT(diag.memory.total(), diag.memory.level0);
+
+    dopt.num_recall_samples = 20;
+    dopt.num_threads = 3;
+    auto with_recall = bptr->diagnose(dopt);
+    EXPECT_GT(with_recall.recall, 0.9);
+    EXPECT_LE(with_recall.recall, 1);
+    dopt.num_threads = 1;
+    EXPECT_EQ(bptr->diagnose(dopt).recall, with_recall.recall);
+
+    // Non-positive numbers of neighbors are rejected.
+    {
+        auto bad = dopt;
+        bad.num_neighbors = 0;
+        std::string msg;
+        try {
+            bptr->diagnose(bad);
+        } catch (std::exception& e) {
+            msg = e.what();
+        }
+        EXPECT_TRUE(msg.find("num_neighbors") != std::string::npos);
+    }
+
+    // Same results after reloading.
+    const std::filesystem::path dir = "save-diagnostics";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+    knncolle_hnsw::HnswPrebuilt<int, double, double, float> reloaded(dir);
+    auto rediag = reloaded.diagnose(dopt);
+    EXPECT_EQ(rediag.entry_point_level, diag.entry_point_level);
+    EXPECT_EQ(rediag.layers[0].degree_histogram, diag.layers[0].degree_histogram);
+    EXPECT_EQ(rediag.memory.link_lists, diag.memory.link_lists);
+    EXPECT_EQ(rediag.recall, with_recall.recall);
+
+    // Handles empty indices.
+    knncolle::SimpleMatrix<int, double> empty(ndim, 0, data.data());
+    auto eptr = builder.build_known_unique(empty);
+    auto ediag = eptr->diagnose(dopt);
+    EXPECT_EQ(ediag.entry_point_level, -1);
+    EXPECT_TRUE(ediag.layers.empty());
+    EXPECT_TRUE(std::isnan(ediag.recall));
+}
+
+TEST_F(HnswMiscTest, DeleteAndCompact) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle::EuclideanDistance<double, double> eudist;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig());
+
+    auto check_recall = [&](const knncolle_hnsw::HnswPrebuilt<int, double, double, float>& prebuilt, const std::vector<int>& remaining) -> void {
+        const int nremaining = remaining.size();
+        ASSERT_EQ(prebuilt.num_observations(), nremaining);
+        auto searcher = prebuilt.initialize();
+        std::vector<int> ires;
+        std::vector<double> dres;
+        int found = 0;
+        for (int x = 0; x < nremaining; ++x) {
+            searcher->search(x, 5, &ires, &dres);
+            sanity_checks(ires, dres, 5, x);
+
+            std::vector<std::pair<double, int> > expected;
+            for (int y = 0; y < nremaining; ++y) {
+                if (y != x) {
+                    expected.emplace_back(eudist.raw(ndim, data.data() + remaining[x] * ndim, data.data() + remaining[y] * ndim), y);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            for (int j = 0; j < 5; ++j) {
+                found += (std::find(ires.begin(), ires.end(), expected[j].second) != ires.end());
+            }
+        }
+        EXPECT_GT(found, nremaining * 5 * 0.95);
+    };
+
+    for (int threads = 1; threads <= 3; threads += 2) {
+        auto bptr = builder.build_known_unique(mat);
+
+        std::vector<int> expected_remaining;
+        for (int i = 0; i < nobs; ++i) {
+            if (i % 3 == 0) {
+                bptr->mark_deleted(i);
+            } else {
+                expected_remaining.push_back(i);
+            }
+        }
+        EXPECT_EQ(bptr->num_deleted(), nobs - expected_remaining.size());
+
+        // Recall is only computed from live observations.
+        {
+            knncolle_hnsw::HnswDiagnosticsOptions dopt;
+            dopt.num_recall_samples = 20;
+            dopt.num_threads = threads;
+            auto diag = bptr->diagnose(dopt);
+            EXPECT_GT(diag.recall, 0.9);
+            EXPECT_LE(diag.recall, 1);
+        }
+
+        // Deleted observations are not reported before compaction.
+        {
+            auto searcher = bptr->initialize();
+            std::vector<int> ires;
+            searcher->search(1, 10, &ires, NULL);
+            for (auto ix : ires) {
+                EXPECT_NE(ix % 3, 0);
+            }
+        }
+
+        auto remaining = bptr->compact(threads);
+        EXPECT_EQ(remaining, expected_remaining);
+        EXPECT_EQ(bptr->num_deleted(), 0);
+
+        // Every remaining node is still reachable in the compacted graph.
+        auto diag = bptr->diagnose(knncolle_hnsw::HnswDiagnosticsOptions());
+        EXPECT_EQ(diag.layers[0].num_nodes, remaining.size());
+        EXPECT_EQ(diag.layers[0].num_unreachable, 0);
+
+        // Fetching the data for the new indices.
+        std::vector<double> buffer(ndim);
+        bptr->fetch_observation(1, buffer.data());
+        for (int d = 0; d < ndim; ++d) {
+            EXPECT_FLOAT_EQ(buffer[d], data[remaining[1] * ndim + d]);
+        }
+
+        check_recall(*bptr, remaining);
+
+        // Round trip works after compaction.
+        const std::filesystem::path dir = "save-compacted";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        bptr->save(dir);
+        knncolle_hnsw::HnswPrebuilt<int, double, double, float> reloaded(dir);
+        check_recall(reloaded, remaining);
+    }
+
+    // Compaction is a no-op without deletions.
+    {
+        auto bptr = builder.build_known_unique(mat);
+        auto remaining = bptr->compact(1);
+        std::vector<int> expected(nobs);
+        std::iota(expected.begin(), expected.end(), 0);
+        EXPECT_EQ(remaining, expected);
+    }
+
+    // Deleting the entry point and nearly everything else.
+    {
+        auto bptr = builder.build_known_unique(mat);
+        for (int i = 0; i < nobs - 10; ++i) {
+            bptr->mark_deleted(i);
+        }
+        auto remaining = bptr->compact(1);
+        EXPECT_EQ(remaining.size(), 10);
+        EXPECT_EQ(bptr->diagnose(knncolle_hnsw::HnswDiagnosticsOptions()).layers[0].num_unreachable, 0);
+
+        for (int i = 0; i < 10; ++i) {
+            bptr->mark_deleted(i);
+        }
+        EXPECT_TRUE(bptr->compact(1).empty());
+        EXPECT_EQ(bptr->num_observations(), 0);
+    }
+
+    // Works on a deserialized index in zero-copy mode.
+    {
+        auto bptr = builder.build_known_unique(mat);
+        std::vector<double> storage((bptr->serialized_size() + sizeof(double) - 1) / sizeof(double));
+        char* buffer = reinterpret_cast<char*>(storage.data());
+        bptr->serialize(buffer);
+        auto original = std::vector<char>(buffer, buffer + bptr->serialized_size());
+
+        knncolle_hnsw::HnswPrebuilt<int, double, double, float> borrowed(buffer, bptr->serialized_size(), true);
+        borrowed.mark_deleted(0);
+        borrowed.mark_deleted(5);
+        auto remaining = borrowed.compact(1);
+        EXPECT_EQ(remaining.size(), nobs - 2);
+        EXPECT_EQ(original, std::vector<char>(buffer, buffer + bptr->serialized_size())); // buffer is untouched.
+    }
 }
 
 TEST(Hnsw, Duplicates) {
@@ -277,4 +823,508 @@ TEST(Hnsw, Duplicates) {
         bsptr->search(x, 10, &ires0, NULL);
         EXPECT_EQ(ires, ires0);
     }
+
+    // Diagnostics treat the tied neighbors as correct.
+    knncolle_hnsw::HnswDiagnosticsOptions dopt;
+    dopt.num_recall_samples = 10;
+    auto diag = builder.build_known_unique(mat)->diagnose(dopt);
+    EXPECT_EQ(diag.layers[0].num_nodes, nobs);
+    EXPECT_EQ(diag.recall, 1);
+}
+
+TEST_F(HnswMiscTest, Interleaved) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig());
+
+    auto compare = [&](const knncolle_hnsw::HnswPrebuilt<int, double, double, float>& prebuilt, int nquery, int k) -> void {
+        auto searcher = prebuilt.initialize();
+        std::vector<int> ires;
+        std::vector<double> dres;
+        for (std::size_t group : { 1, 4, 16 }) {
+            std::vector<char> reported(nquery);
+            prebuilt.search_interleaved(
+                nquery,
+                [&](std::size_t q) -> const double* { return data.data() + q * ndim; },
+                k,
+                group,
+                [&](std::size_t q, const std::vector<int>& indices, const std::vector<double>& distances) -> void {
+                    reported[q] = 1;
+                    searcher->search(data.data() + q * ndim, k, &ires, &dres);
+                    EXPECT_EQ(indices, ires);
+                    EXPECT_EQ(distances, dres);
+                }
+            );
+            EXPECT_EQ(std::count(reported.begin(), reported.end(), 1), nquery);
+        }
+    };
+
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    auto bptr = builder.build_known_unique(mat);
+    compare(*bptr, nobs, 10);
+    compare(*bptr, nobs, nobs + 10);
+
+    // Deleted observations yield the same (possibly shorter) results.
+    for (int i = 0; i < nobs; i += 2) {
+        bptr->mark_deleted(i);
+    }
+    compare(*bptr, nobs, 10);
+
+    // Tiny and empty indices.
+    auto single = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 1, data.data()));
+    compare(*single, 5, 3);
+    auto empty = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 0, data.data()));
+    compare(*empty, 5, 3);
+}
+
+TEST_F(HnswMiscTest, ResultCache) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig());
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto searcher = bptr->initialize();
+
+    std::vector<std::vector<int> > ref_indices(nobs);
+    std::vector<std::vector<double> > ref_distances(nobs);
+    for (int i = 0; i < nobs; ++i) {
+        searcher->search(i, 10, &ref_indices[i], &ref_distances[i]);
+    }
+
+    bptr->set_result_cache(1000000);
+    std::vector<int> ires;
+    std::vector<double> dres;
+    for (int i = 0; i < nobs; ++i) {
+        searcher->search(i, 10, &ires, &dres);
+        EXPECT_EQ(ires, ref_indices[i]);
+        EXPECT_EQ(dres, ref_distances[i]);
+    }
+    auto stats = bptr->result_cache_statistics();
+    EXPECT_EQ(stats.hits, 0);
+    EXPECT_EQ(stats.misses, nobs);
+    EXPECT_EQ(stats.num_entries, nobs);
+
+    // Repeated searches are served from the cache, even if only some outputs are requested.
+    for (int i = 0; i < nobs; ++i) {
+        searcher->search(i, 10, &ires, NULL);
+        EXPECT_EQ(ires, ref_indices[i]);
+        searcher->search(i, 10, NULL, &dres);
+        EXPECT_EQ(dres, ref_distances[i]);
+    }
+    EXPECT_EQ(bptr->result_cache_statistics().hits, 2 * nobs);
+
+    // Smaller 'k' is served by truncation, larger 'k' triggers a new search.
+    searcher->search(0, 3, &ires, &dres);
+    EXPECT_EQ(ires, std::vector<int>(ref_indices[0].begin(), ref_indices[0].begin() + 3));
+    EXPECT_EQ(bptr->result_cache_statistics().hits, 2 * nobs + 1);
+    searcher->search(0, 20, &ires, &dres);
+    EXPECT_EQ(ires.size(), 20);
+    EXPECT_EQ(bptr->result_cache_statistics().misses, nobs + 1);
+    searcher->search(0, 15, &ires, &dres);
+    EXPECT_EQ(bptr->result_cache_statistics().hits, 2 * nobs + 2);
+
+    // Modifications invalidate the cache.
+    bptr->mark_deleted(ref_indices[1][0]);
+    EXPECT_EQ(bptr->result_cache_statistics().num_entries, 0);
+    searcher->search(1, 10, &ires, NULL);
+    EXPECT_EQ(std::find(ires.begin(), ires.end(), ref_indices[1][0]), ires.end());
+
+    // Diagnostics do not touch the cache.
+    searcher->search(2, 10, &ires, NULL);
+    auto before = bptr->result_cache_statistics();
+    knncolle_hnsw::HnswDiagnosticsOptions dopt;
+    dopt.num_recall_samples = nobs;
+    auto diag = bptr->diagnose(dopt);
+    EXPECT_GT(diag.recall, 0.9);
+    auto after = bptr->result_cache_statistics();
+    EXPECT_EQ(after.hits, before.hits);
+    EXPECT_EQ(after.misses, before.misses);
+    EXPECT_EQ(after.num_entries, before.num_entries);
+    EXPECT_EQ(after.bytes, before.bytes);
+
+    // Respects the byte budget.
+    bptr->set_result_cache(2000);
+    for (int i = 0; i < nobs; ++i) {
+        if (i != ref_indices[1][0]) {
+            searcher->search(i, 10, &ires, NULL);
+        }
+    }
+    stats = bptr->result_cache_statistics();
+    EXPECT_LE(stats.bytes, 2000);
+    EXPECT_GT(stats.num_entries, 0);
+    EXPECT_LT(stats.num_entries, nobs);
+
+    bptr->set_result_cache(0);
+    EXPECT_EQ(bptr->result_cache_statistics().num_entries, 0);
+}
+
+TEST_F(HnswMiscTest, EntryPoints) {
+    // Strongly clustered data, to check that the entry points land in the clusters.
+    const int nclusters = 5, nclustered = 400;
+    std::vector<double> clustered(ndim * nclustered);
+    {
+        std::mt19937_64 rng(12345);
+        std::normal_distribution<double> dist;
+        for (int i = 0; i < nclustered; ++i) {
+            auto ptr = clustered.data() + i * ndim;
+            for (int d = 0; d < ndim; ++d) {
+                ptr[d] = dist(rng) + (i % nclusters) * 20;
+            }
+        }
+    }
+    knncolle::SimpleMatrix<int, double> mat(ndim, nclustered, clustered.data());
+    knncolle::EuclideanDistance<double, double> eudist;
+
+    knncolle_hnsw::HnswOptions opt;
+    opt.num_entry_points = 8;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+    auto bptr = builder.build_known_unique(mat);
+    EXPECT_GT(bptr->num_entry_points(), 0);
+    EXPECT_LE(bptr->num_entry_points(), 8);
+
+    auto collect = [&](const knncolle_hnsw::HnswPrebuilt<int, double, double, float>& prebuilt) -> std::vector<std::vector<int> > {
+        auto searcher = prebuilt.initialize();
+        std::vector<std::vector<int> > output(nclustered);
+        for (int x = 0; x < nclustered; ++x) {
+            searcher->search(x, 5, &output[x], NULL);
+        }
+        return output;
+    };
+    auto ref = collect(*bptr);
+
+    int found = 0;
+    for (int x = 0; x < nclustered; ++x) {
+        std::vector<std::pair<double, int> > expected;
+        for (int y = 0; y < nclustered; ++y) {
+            if (y != x) {
+                expected.emplace_back(eudist.raw(ndim, clustered.data() + x * ndim, clustered.data() + y * ndim), y);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        for (int j = 0; j < 5; ++j) {
+            found += (std::find(ref[x].begin(), ref[x].end(), expected[j].second) != ref[x].end());
+        }
+    }
+    EXPECT_GT(found, nclustered * 5 * 0.95);
+
+    // Choice of entry points does not depend on the number of threads.
+    opt.num_threads = 3;
+    knncolle_hnsw::HnswBuilder<int, double, double> pbuilder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+    auto pptr = pbuilder.build_known_unique(mat);
+    EXPECT_EQ(collect(*pptr), ref);
+
+    // Entry points are used by the interleaved search.
+    {
+        auto searcher = bptr->initialize();
+        std::vector<int> ires;
+        std::vector<double> dres;
+        bptr->search_interleaved(
+            nclustered,
+            [&](std::size_t q) -> const double* { return clustered.data() + q * ndim; },
+            5,
+            4,
+            [&](std::size_t q, const std::vector<int>& indices, const std::vector<double>& distances) -> void {
+                searcher->search(clustered.data() + q * ndim, 5, &ires, &dres);
+                EXPECT_EQ(indices, ires);
+                EXPECT_EQ(distances, dres);
+            }
+        );
+    }
+
+    // Entry points are persisted.
+    const std::filesystem::path dir = "save-entry-points";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+    EXPECT_TRUE(std::filesystem::exists(dir / "ENTRY_POINTS"));
+    knncolle_hnsw::HnswPrebuilt<int, double, double, float> reloaded(dir);
+    EXPECT_EQ(reloaded.num_entry_points(), bptr->num_entry_points());
+    EXPECT_EQ(collect(reloaded), ref);
+
+    std::vector<char> buffer(bptr->serialized_size());
+    bptr->serialize(buffer.data());
+    knncolle_hnsw::HnswPrebuilt<int, double, double, float> deserialized(buffer.data(), buffer.size(), false);
+    EXPECT_EQ(deserialized.num_entry_points(), bptr->num_entry_points());
+    EXPECT_EQ(collect(deserialized), ref);
+
+    // Deleted entry points are dropped upon compaction.
+    for (int i = 0; i < nclustered; i += 2) {
+        bptr->mark_deleted(i);
+    }
+    const auto before = bptr->num_entry_points();
+    auto old = bptr->compact(1);
+    EXPECT_LE(bptr->num_entry_points(), before);
+
+    auto searcher = bptr->initialize();
+    std::vector<int> ires;
+    for (int x = 0; x < static_cast<int>(old.size()); ++x) {
+        searcher->search(x, 5, &ires, NULL);
+        EXPECT_EQ(ires.size(), 5);
+    }
+}
+
+TEST_F(HnswMiscTest, VisitedSet) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig());
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    auto bptr = builder.build_known_unique(mat);
+    EXPECT_EQ(bptr->visited_set(), knncolle_hnsw::VisitedSetType::AUTO);
+
+    bool deleted = false;
+    auto collect = [&](int k) -> std::vector<std::vector<int> > {
+        auto searcher = bptr->initialize();
+        std::vector<std::vector<int> > output;
+        std::vector<int> ires;
+        for (int x = 0; x < nobs; ++x) {
+            searcher->search(data.data() + x * ndim, k, &ires, NULL);
+            output.push_back(ires);
+            if (x % 3 != 0 || !deleted) {
+                searcher->search(x, k, &ires, NULL);
+                output.push_back(ires);
+            }
+        }
+        return output;
+    };
+
+    // All types of visited sets give the same results, including when the hash set needs to grow.
+    auto check = [&]() -> void {
+        for (int k : { 5, nobs + 10 }) {
+            bptr->set_visited_set(knncolle_hnsw::VisitedSetType::AUTO);
+            auto ref = collect(k);
+            bptr->set_visited_set(knncolle_hnsw::VisitedSetType::EPOCH);
+            EXPECT_EQ(collect(k), ref);
+            bptr->set_visited_set(knncolle_hnsw::VisitedSetType::HASH);
+            EXPECT_EQ(collect(k), ref);
+        }
+    };
+    check();
+    for (int i = 0; i < nobs; i += 3) {
+        bptr->mark_deleted(i);
+    }
+    deleted = true;
+    check();
+
+    // Hash set grows correctly when it visits more nodes than expected.
+    knncolle_hnsw::HashVisitedSet hashed;
+    for (int it = 0; it < 3; ++it) {
+        hashed.reset(1);
+        for (hnswlib::tableint i = 0; i < 1000; i += 2) {
+            EXPECT_TRUE(hashed.insert(i));
+        }
+        for (hnswlib::tableint i = 0; i < 1000; ++i) {
+            EXPECT_EQ(hashed.insert(i), i % 2 == 1);
+        }
+    }
+
+    // Memory usage is reported by the diagnostics.
+    bptr->set_visited_set(knncolle_hnsw::VisitedSetType::EPOCH);
+    auto diag = bptr->diagnose(knncolle_hnsw::HnswDiagnosticsOptions());
+    EXPECT_EQ(diag.memory.visited_per_searcher, diag.memory.visited_list);
+    bptr->set_visited_set(knncolle_hnsw::VisitedSetType::HASH);
+    diag = bptr->diagnose(knncolle_hnsw::HnswDiagnosticsOptions());
+    EXPECT_GT(diag.memory.visited_per_searcher, 0);
+    EXPECT_NE(diag.memory.visited_per_searcher, diag.memory.visited_list);
+}
+
+TEST_F(HnswMiscTest, InsertionOrder) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle::EuclideanDistance<double, double> eudist;
+
+    // The order is a permutation.
+    auto order = knncolle_hnsw::order_by_projected_curve(data.data(), nobs, ndim, 100, 1);
+    auto sorted = order;
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int> expected_order(nobs);
+    std::iota(expected_order.begin(), expected_order.end(), 0);
+    EXPECT_EQ(sorted, expected_order);
+    EXPECT_NE(order, expected_order);
+    EXPECT_EQ(knncolle_hnsw::order_by_projected_curve(data.data(), nobs, ndim, 100, 3), order);
+
+    auto build_and_save = [&](const knncolle_hnsw::HnswOptions& opt, const std::string& name) -> std::string {
+        knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+        auto bptr = builder.build_known_unique(mat);
+        auto bsptr = bptr->initialize();
+
+        // Observations keep their original indices.
+        std::vector<double> buffer(ndim);
+        for (int x = 0; x < nobs; ++x) {
+            bptr->fetch_observation(x, buffer.data());
+            for (int d = 0; d < ndim; ++d) {
+                EXPECT_FLOAT_EQ(buffer[d], data[x * ndim + d]);
+            }
+        }
+
+        std::vector<int> ires;
+        std::vector<double> dres;
+        int found = 0;
+        for (int x = 0; x < nobs; ++x) {
+            bsptr->search(x, 5, &ires, &dres);
+            sanity_checks(ires, dres, 5, x);
+
+            std::vector<std::pair<double, int> > expected;
+            for (int y = 0; y < nobs; ++y) {
+                if (y != x) {
+                    expected.emplace_back(eudist.raw(ndim, data.data() + x * ndim, data.data() + y * ndim), y);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            for (int j = 0; j < 5; ++j) {
+                found += (std::find(ires.begin(), ires.end(), expected[j].second) != ires.end());
+            }
+        }
+        EXPECT_GT(found, nobs * 5 * 0.95);
+
+        const std::filesystem::path dir = name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        bptr->save(dir);
+
+        // Still works after compaction, which renumbers the nodes by their labels.
+        bptr->mark_deleted(0);
+        auto remaining = bptr->compact(1);
+        EXPECT_EQ(remaining.size(), nobs - 1);
+        bsptr = bptr->initialize();
+        for (int x = 0; x < nobs - 1; ++x) {
+            bsptr->search(x, 5, &ires, &dres);
+            sanity_checks(ires, dres, 5, x);
+        }
+
+        return knncolle::quick_load_as_string(dir / "INDEX");
+    };
+
+    knncolle_hnsw::HnswOptions opt;
+    auto input = build_and_save(opt, "save-order-input");
+    opt.insertion_order = knncolle_hnsw::InsertionOrder::PROJECTED_CURVE;
+    auto curved = build_and_save(opt, "save-order-curve");
+    EXPECT_NE(input, curved);
+
+    // Also works for the wave build, which is still independent of the number of threads.
+    opt.wave_size = 16;
+    opt.num_threads = 1;
+    auto serial = build_and_save(opt, "save-order-wave-serial");
+    opt.num_threads = 3;
+    auto parallel = build_and_save(opt, "save-order-wave-parallel");
+    EXPECT_EQ(serial, parallel);
+
+    // Compaction without deletions leaves the entry points alone, even though internal IDs are not the same as the labels.
+    {
+        knncolle_hnsw::HnswOptions eopt;
+        eopt.insertion_order = knncolle_hnsw::InsertionOrder::PROJECTED_CURVE;
+        eopt.num_entry_points = 5;
+        knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), eopt);
+        auto bptr = builder.build_known_unique(mat);
+        const auto num_entries = bptr->num_entry_points();
+        EXPECT_GT(num_entries, 0);
+        std::vector<char> before(bptr->serialized_size());
+        bptr->serialize(before.data());
+
+        auto remaining = bptr->compact(1);
+        EXPECT_EQ(remaining, expected_order);
+        EXPECT_EQ(bptr->num_entry_points(), num_entries);
+        std::vector<char> after(bptr->serialized_size());
+        bptr->serialize(after.data());
+        EXPECT_EQ(before, after);
+    }
+}
+
+TEST_F(HnswMiscTest, BuildProgress) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+
+    auto build = [&](const knncolle_hnsw::HnswOptions& opt) -> std::string {
+        knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+        auto bptr = builder.build_known_unique(mat);
+        EXPECT_GE(bptr->build_timings().total(), 0);
+
+        const std::filesystem::path dir = "save-progress";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        bptr->save(dir);
+        return knncolle::quick_load_as_string(dir / "INDEX");
+    };
+
+    knncolle_hnsw::HnswOptions opt;
+    auto ref = build(opt);
+
+    // Reporting doesn't change the index.
+    std::vector<knncolle_hnsw::HnswBuildProgress> reports;
+    opt.progress = [&](const knncolle_hnsw::HnswBuildProgress& p) -> void {
+        reports.push_back(p);
+    };
+    opt.progress_interval = 30;
+    EXPECT_EQ(build(opt), ref);
+
+    std::vector<std::size_t> insertions;
+    for (const auto& r : reports) {
+        EXPECT_LE(r.completed, r.total);
+        EXPECT_GE(r.seconds, 0);
+        if (r.phase == knncolle_hnsw::BuildPhase::INSERTION) {
+            insertions.push_back(r.completed);
+        }
+    }
+    EXPECT_EQ(insertions, std::vector<std::size_t>({ 0, 30, 60, 90, 100 }));
+    EXPECT_EQ(reports.back().phase, knncolle_hnsw::BuildPhase::FINALIZATION);
+    EXPECT_EQ(reports.back().completed, 1);
+
+    // Reported after each wave.
+    reports.clear();
+    insertions.clear();
+    opt.wave_size = 40;
+    opt.progress_interval = 1;
+    build(opt);
+    for (const auto& r : reports) {
+        if (r.phase == knncolle_hnsw::BuildPhase::INSERTION) {
+            insertions.push_back(r.completed);
+        }
+    }
+    EXPECT_EQ(insertions, std::vector<std::size_t>({ 0, 40, 80, 100 }));
+
+    // Each phase is timed for the bulk builds.
+    reports.clear();
+    opt.wave_size = 0;
+    opt.nn_descent_iterations = 3;
+    opt.nn_descent_delta = 0;
+    opt.refine = true;
+    opt.num_entry_points = 2;
+    {
+        knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::makeEuclideanDistanceConfig(), opt);
+        auto bptr = builder.build_known_unique(mat);
+        const auto& timings = bptr->build_timings();
+        EXPECT_EQ(timings.insertion, 0);
+        EXPECT_GT(timings.nn_descent, 0);
+        EXPECT_GT(timings.linking, 0);
+        EXPECT_GT(timings.refinement, 0);
+        EXPECT_GT(timings.entry_points, 0);
+    }
+
+    std::vector<knncolle_hnsw::BuildPhase> phases;
+    std::vector<std::size_t> iterations;
+    for (const auto& r : reports) {
+        if (phases.empty() || phases.back() != r.phase) {
+            phases.push_back(r.phase);
+        }
+        if (r.phase == knncolle_hnsw::BuildPhase::NN_DESCENT) {
+            iterations.push_back(r.completed);
+        }
+    }
+    EXPECT_EQ(phases, std::vector<knncolle_hnsw::BuildPhase>({
+        knncolle_hnsw::BuildPhase::CONVERSION,
+        knncolle_hnsw::BuildPhase::NN_DESCENT,
+        knncolle_hnsw::BuildPhase::LINKING,
+        knncolle_hnsw::BuildPhase::REFINEMENT,
+        knncolle_hnsw::BuildPhase::ENTRY_POINTS,
+        knncolle_hnsw::BuildPhase::FINALIZATION
+    }));
+    EXPECT_EQ(iterations, std::vector<std::size_t>({ 0, 1, 2, 3 }));
+
+    // Cancellation from another thread is simulated by setting the flag in the callback.
+    std::atomic<bool> cancel(false);
+    knncolle_hnsw::HnswOptions copt;
+    copt.cancel = &cancel;
+    copt.progress_interval = 10;
+    copt.progress = [&](const knncolle_hnsw::HnswBuildProgress& p) -> void {
+        if (p.phase == knncolle_hnsw::BuildPhase::INSERTION && p.completed >= 20) {
+            cancel = true;
+        }
+    };
+    knncolle_hnsw::HnswBuilder<int, double, double> cbuilder(knncolle_hnsw::makeEuclideanDistanceConfig(), copt);
+    EXPECT_THROW(cbuilder.build_known_unique(mat), knncolle_hnsw::HnswBuildCancelled);
+
+    // Cancelled before starting.
+    copt.progress = nullptr;
+    knncolle_hnsw::HnswBuilder<int, double, double> cbuilder2(knncolle_hnsw::makeEuclideanDistanceConfig(), copt);
+    EXPECT_THROW(cbuilder2.build_known_unique(mat), knncolle_hnsw::HnswBuildCancelled);
 }
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include "knncolle_hnsw/HnswSearchPool.hpp"
+
+#include <vector>
+#include <atomic>
+
+#include "TestCore.h"
+
+class HnswSearchPoolTest : public TestCore, public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        assemble({ 200, 6 });
+    }
+
+    std::vector<double> get_query(int i) const {
+        return std::vector<double>(data.begin() + i * ndim, data.begin() + (i + 1) * ndim);
+    }
+};
+
+TEST_F(HnswSearchPoolTest, Futures) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto searcher = bptr->initialize();
+
+    knncolle_hnsw::HnswSearchPoolOptions opt;
+    opt.num_workers = 3;
+    opt.batch_window = std::chrono::microseconds(100);
+    knncolle_hnsw::HnswSearchPool<int, double, double, float> pool(*bptr, opt);
+
+    int k = 7;
+    std::vector<std::future<knncolle_hnsw::HnswSearchResult<int, double> > > futures;
+    for (int i = 0; i < nobs; ++i) {
+        futures.push_back(pool.submit(get_query(i), k));
+    }
+
+    std::vector<int> ires;
+    std::vector<double> dres;
+    for (int i = 0; i < nobs; ++i) {
+        auto res = futures[i].get();
+        searcher->search(data.data() + i * ndim, k, &ires, &dres);
+        EXPECT_EQ(res.indices, ires);
+        EXPECT_EQ(res.distances, dres);
+    }
+
+    // Invalid queries are caught at submission.
+    EXPECT_ANY_THROW(pool.submit(std::vector<double>(ndim + 1), k));
+}
+
+TEST_F(HnswSearchPoolTest, Callbacks) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto searcher = bptr->initialize();
+
+    int k = 5;
+    std::vector<knncolle_hnsw::HnswSearchResult<int, double> > results(nobs);
+    std::atomic<int> num_errors = 0;
+    {
+        knncolle_hnsw::HnswSearchPoolOptions opt;
+        opt.num_workers = 2;
+        opt.queue_capacity = 4; // forcing the submissions to block.
+        knncolle_hnsw::HnswSearchPool<int, double, double, float> pool(*bptr, opt);
+        for (int i = 0; i < nobs; ++i) {
+            pool.submit(get_query(i), k, [&results, &num_errors, i](knncolle_hnsw::HnswSearchResult<int, double> res, std::exception_ptr err) -> void {
+                num_errors += (err != nullptr);
+                results[i] = std::move(res);
+            });
+        }
+    } // destructor processes all pending requests.
+
+    EXPECT_EQ(num_errors, 0);
+    std::vector<int> ires;
+    std::vector<double> dres;
+    for (int i = 0; i < nobs; ++i) {
+        searcher->search(data.data() + i * ndim, k, &ires, &dres);
+        EXPECT_EQ(results[i].indices, ires);
+        EXPECT_EQ(results[i].distances, dres);
+    }
+}
+
+TEST_F(HnswSearchPoolTest, Interleaved) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto searcher = bptr->initialize();
+
+    knncolle_hnsw::HnswSearchPoolOptions opt;
+    opt.num_workers = 2;
+    opt.num_interleaved = 4;
+    opt.batch_window = std::chrono::microseconds(100);
+    knncolle_hnsw::HnswSearchPool<int, double, double, float> pool(*bptr, opt);
+
+    // Varying 'k' so that some batches contain multiple runs.
+    auto get_k = [](int i) -> int { return 3 + (i / 7) % 3; };
+    std::vector<std::future<knncolle_hnsw::HnswSearchResult<int, double> > > futures;
+    for (int i = 0; i < nobs; ++i) {
+        futures.push_back(pool.submit(get_query(i), get_k(i)));
+    }
+
+    std::vector<int> ires;
+    std::vector<double> dres;
+    for (int i = 0; i < nobs; ++i) {
+        auto res = futures[i].get();
+        searcher->search(data.data() + i * ndim, get_k(i), &ires, &dres);
+        EXPECT_EQ(res.indices, ires);
+        EXPECT_EQ(res.distances, dres);
+    }
+}
+
+TEST_F(HnswSearchPoolTest, Backpressure) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    knncolle_hnsw::HnswSearchPoolOptions opt;
+    opt.queue_capacity = 2;
+    knncolle_hnsw::HnswSearchPool<int, double, double, float> pool(*bptr, opt);
+
+    // Blocking the only worker in a callback so that the queue fills up.
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> started;
+    auto started_future = started.get_future();
+    pool.submit(get_query(0), 5, [&, released](knncolle_hnsw::HnswSearchResult<int, double>, std::exception_ptr) -> void {
+        started.set_value();
+        released.wait();
+    });
+    started_future.wait();
+
+    auto first = pool.try_submit(get_query(1), 5);
+    auto second = pool.try_submit(get_query(2), 5);
+    auto third = pool.try_submit(get_query(3), 5);
+    EXPECT_TRUE(first.has_value());
+    EXPECT_TRUE(second.has_value());
+    EXPECT_FALSE(third.has_value());
+    EXPECT_EQ(pool.num_pending(), 2);
+
+    release.set_value();
+    EXPECT_EQ(first->get().indices.size(), 5);
+    EXPECT_EQ(second->get().indices.size(), 5);
+
+    // Invalid options.
+    opt.num_workers = 0;
+    typedef knncolle_hnsw::HnswSearchPool<int, double, double, float> Pool;
+    EXPECT_ANY_THROW(Pool(*bptr, opt));
+}
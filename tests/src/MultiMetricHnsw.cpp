@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include "knncolle_hnsw/MultiMetricHnsw.hpp"
+
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <string>
+
+#include "TestCore.h"
+
+class MultiMetricHnswTest : public TestCore, public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        assemble({ 250, 6 });
+    }
+
+    static void compare(const knncolle::Searcher<int, double, double>& expected, const knncolle::Searcher<int, double, double>& observed, int k) {
+        auto& esearcher = const_cast<knncolle::Searcher<int, double, double>&>(expected);
+        auto& osearcher = const_cast<knncolle::Searcher<int, double, double>&>(observed);
+        std::vector<int> eres, ores;
+        std::vector<double> edist, odist;
+        for (int i = 0; i < nobs; ++i) {
+            esearcher.search(i, k, &eres, &edist);
+            osearcher.search(i, k, &ores, &odist);
+            EXPECT_EQ(eres, ores);
+            EXPECT_EQ(edist, odist);
+
+            esearcher.search(data.data() + i * ndim, k, &eres, &edist);
+            osearcher.search(data.data() + i * ndim, k, &ores, &odist);
+            EXPECT_EQ(eres, ores);
+            EXPECT_EQ(edist, odist);
+        }
+    }
+
+    static std::vector<knncolle_hnsw::DistanceConfig<double> > configs() {
+        return std::vector<knncolle_hnsw::DistanceConfig<double> >{
+            knncolle_hnsw::configure_euclidean_distance<double>(),
+            knncolle_hnsw::configure_manhattan_distance<double>()
+        };
+    }
+};
+
+TEST_F(MultiMetricHnswTest, Basic) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_hnsw::MultiMetricHnswBuilder<int, double, double> builder(configs());
+    auto bptr = builder.build_known_unique(mat);
+    EXPECT_EQ(bptr->num_observations(), nobs);
+    EXPECT_EQ(bptr->num_dimensions(), ndim);
+    EXPECT_EQ(bptr->num_metrics(), 2);
+
+    std::vector<double> fetched(ndim);
+    bptr->fetch_observation(5, fetched.data());
+    for (int d = 0; d < ndim; ++d) {
+        EXPECT_FLOAT_EQ(fetched[d], data[5 * ndim + d]);
+    }
+
+    // Same results as separate indices for each metric.
+    knncolle_hnsw::HnswBuilder<int, double, double> ebuilder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto eptr = ebuilder.build_unique(mat);
+    compare(*(eptr->initialize()), *(bptr->initialize()), 8);
+    compare(*(eptr->initialize()), *(bptr->initialize(0)), 8);
+
+    knncolle_hnsw::HnswBuilder<int, double, double> mbuilder(knncolle_hnsw::configure_manhattan_distance<double>());
+    auto mptr = mbuilder.build_unique(mat);
+    compare(*(mptr->initialize()), *(bptr->initialize_known(1)), 8);
+
+    EXPECT_ANY_THROW(bptr->initialize(2));
+    auto searcher = bptr->initialize();
+    std::vector<int> ires;
+    EXPECT_ANY_THROW(searcher->search(nobs, 5, &ires, NULL));
+}
+
+TEST_F(MultiMetricHnswTest, Options) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_hnsw::HnswOptions opt;
+    opt.num_links = 8;
+    opt.ef_search = 20;
+    opt.num_entry_points = 5;
+    opt.visited_set = knncolle_hnsw::VisitedSetType::HASH;
+
+    knncolle_hnsw::MultiMetricHnswBuilder<int, double, double> builder(configs(), opt);
+    auto bptr = builder.build_unique(mat);
+    auto mmptr = dynamic_cast<knncolle_hnsw::MultiMetricHnswPrebuilt<int, double, double, float>*>(bptr.get());
+
+    knncolle_hnsw::HnswBuilder<int, double, double> mbuilder(knncolle_hnsw::configure_manhattan_distance<double>(), opt);
+    auto mptr = mbuilder.build_unique(mat);
+    compare(*(mptr->initialize()), *(mmptr->initialize(1)), 5);
+}
+
+TEST_F(MultiMetricHnswTest, SaveLoad) {
+    knncolle::SimpleMatrix<int, double> mat(ndim, nobs, data.data());
+    knncolle_hnsw::HnswOptions opt;
+    opt.num_entry_points = 3;
+    knncolle_hnsw::MultiMetricHnswBuilder<int, double, double> builder(configs(), opt);
+    auto bptr = builder.build_known_unique(mat);
+
+    const std::filesystem::path dir = "save-multi-metric";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "ALGORITHM"), knncolle_hnsw::multi_metric_hnsw_prebuilt_save_name);
+    EXPECT_TRUE(std::filesystem::exists(dir / "VECTORS"));
+    EXPECT_FALSE(std::filesystem::exists(dir / "metric0" / "VECTORS"));
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "metric1" / "DISTANCE"), "manhattan");
+
+    std::unique_ptr<knncolle_hnsw::MultiMetricHnswPrebuilt<int, double, double, float> > reloaded(knncolle_hnsw::load_multi_metric_hnsw_prebuilt<int, double, double>(dir));
+    EXPECT_EQ(reloaded->num_observations(), nobs);
+    EXPECT_EQ(reloaded->num_dimensions(), ndim);
+    EXPECT_EQ(reloaded->num_metrics(), 2);
+    for (std::size_t m = 0; m < 2; ++m) {
+        compare(*(bptr->initialize(m)), *(reloaded->initialize(m)), 6);
+    }
+
+    knncolle::quick_save(dir / "ALGORITHM", "foo", 3);
+    EXPECT_ANY_THROW({
+        reloaded.reset(knncolle_hnsw::load_multi_metric_hnsw_prebuilt<int, double, double>(dir));
+    });
+}
+
+TEST_F(MultiMetricHnswTest, Errors) {
+    typedef knncolle_hnsw::MultiMetricHnswBuilder<int, double, double> Builder;
+    EXPECT_ANY_THROW(Builder(std::vector<knncolle_hnsw::DistanceConfig<double> >{}));
+
+    auto bad = configs();
+    bad[1].create = nullptr;
+    EXPECT_ANY_THROW(Builder(std::move(bad)));
+
+    bad = configs();
+    bad[0].normalize_method = knncolle_hnsw::DistanceNormalizeMethod::CUSTOM;
+    EXPECT_ANY_THROW(Builder(std::move(bad)));
+}
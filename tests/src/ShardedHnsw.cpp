@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include "knncolle_hnsw/ShardedHnsw.hpp"
+#include "knncolle_hnsw/load_hnsw_prebuilt.hpp"
+
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <algorithm>
+#include <string>
+
+#include "TestCore.h"
+
+class ShardedHnswTest : public TestCore, public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        assemble({ 200, 5 });
+    }
+
+    // Exact search by brute force, to check that we get the right distances.
+    static std::vector<std::pair<double, int> > brute_force(const double* query, int self) {
+        knncolle::EuclideanDistance<double, double> eudist;
+        std::vector<std::pair<double, int> > output;
+        for (int y = 0; y < nobs; ++y) {
+            if (y != self) {
+                output.emplace_back(eudist.normalize(eudist.raw(ndim, query, data.data() + y * ndim)), y);
+            }
+        }
+        std::sort(output.begin(), output.end());
+        return output;
+    }
+};
+
+TEST_F(ShardedHnswTest, Random) {
+    knncolle_hnsw::ShardedHnswOptions opt;
+    opt.num_shards = 3;
+    opt.num_threads = 2;
+    knncolle_hnsw::ShardedHnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    EXPECT_EQ(bptr->num_observations(), nobs);
+    EXPECT_EQ(bptr->num_dimensions(), ndim);
+    EXPECT_EQ(bptr->num_shards(), 3);
+    auto searcher = bptr->initialize();
+
+    int k = 10;
+    std::vector<int> ires;
+    std::vector<double> dres;
+    for (int x = 0; x < nobs; ++x) {
+        searcher->search(x, k, &ires, &dres);
+        sanity_checks(ires, dres, k, x);
+
+        // With such a small dataset, every shard's search should be exact.
+        auto expected = brute_force(data.data() + x * ndim, x);
+        for (int j = 0; j < k; ++j) {
+            EXPECT_NEAR(dres[j], expected[j].first, 0.0001);
+        }
+
+        searcher->search(data.data() + x * ndim, k, &ires, &dres);
+        EXPECT_EQ(ires.size(), k);
+        EXPECT_EQ(ires.front(), x);
+        EXPECT_NEAR(dres.front(), 0, 0.0001);
+    }
+
+    // More shards than observations.
+    std::vector<double> small(data.begin(), data.begin() + ndim * 2);
+    opt.num_shards = 10;
+    knncolle_hnsw::ShardedHnswBuilder<int, double, double> sbuilder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    auto sptr = sbuilder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, 2, small.data()));
+    EXPECT_EQ(sptr->num_shards(), 2);
+    auto ssearcher = sptr->initialize();
+    ssearcher->search(0, 5, &ires, &dres);
+    EXPECT_EQ(ires, std::vector<int>{ 1 });
+}
+
+TEST_F(ShardedHnswTest, KMeans) {
+    knncolle_hnsw::ShardedHnswOptions opt;
+    opt.num_shards = 4;
+    opt.partition = knncolle_hnsw::ShardPartition::KMEANS;
+    opt.num_threads = 3;
+    knncolle_hnsw::ShardedHnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto searcher = bptr->initialize();
+
+    // Probing all shards is the same as not having any probe limit.
+    opt.num_probes = bptr->num_shards();
+    knncolle_hnsw::ShardedHnswBuilder<int, double, double> pbuilder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    auto pptr = pbuilder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto psearcher = pptr->initialize();
+
+    // Limiting the probes still gives sensible results.
+    opt.num_probes = 1;
+    knncolle_hnsw::ShardedHnswBuilder<int, double, double> obuilder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    auto optr = obuilder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    auto osearcher = optr->initialize();
+
+    int k = 5;
+    std::vector<int> ires, ires2;
+    std::vector<double> dres, dres2;
+    for (int x = 0; x < nobs; ++x) {
+        searcher->search(x, k, &ires, &dres);
+        sanity_checks(ires, dres, k, x);
+        psearcher->search(x, k, &ires2, &dres2);
+        EXPECT_EQ(ires, ires2);
+        EXPECT_EQ(dres, dres2);
+
+        osearcher->search(x, k, &ires2, &dres2);
+        sanity_checks(ires2, dres2);
+        EXPECT_LE(ires2.size(), k);
+        for (auto i : ires2) {
+            EXPECT_NE(i, x);
+        }
+
+        osearcher->search(data.data() + x * ndim, k, &ires2, &dres2);
+        sanity_checks(ires2, dres2);
+        EXPECT_FALSE(ires2.empty());
+    }
+}
+
+TEST_F(ShardedHnswTest, SaveLoad) {
+    knncolle_hnsw::ShardedHnswOptions opt;
+    opt.num_shards = 3;
+    opt.partition = knncolle_hnsw::ShardPartition::KMEANS;
+    opt.num_probes = 2;
+    knncolle_hnsw::ShardedHnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const std::filesystem::path dir = "save-sharded-tests";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+
+    EXPECT_EQ(knncolle::quick_load_as_string(dir / "ALGORITHM"), knncolle_hnsw::sharded_hnsw_prebuilt_save_name);
+    EXPECT_EQ(knncolle_hnsw::load_hnsw_prebuilt_types(dir).data, knncolle::NumericType::FLOAT);
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_hnsw::load_sharded_hnsw_prebuilt<int, double, double>(dir));
+    EXPECT_EQ(reloaded->num_observations(), nobs);
+    EXPECT_EQ(reloaded->num_dimensions(), ndim);
+
+    auto searcher = bptr->initialize();
+    auto researcher = reloaded->initialize();
+    std::vector<int> ires, ires2;
+    std::vector<double> dres, dres2;
+    for (int x = 0; x < nobs; ++x) {
+        searcher->search(x, 8, &ires, &dres);
+        researcher->search(x, 8, &ires2, &dres2);
+        EXPECT_EQ(ires, ires2);
+        EXPECT_EQ(dres, dres2);
+
+        searcher->search(data.data() + x * ndim, 8, &ires, &dres);
+        researcher->search(data.data() + x * ndim, 8, &ires2, &dres2);
+        EXPECT_EQ(ires, ires2);
+        EXPECT_EQ(dres, dres2);
+    }
+}
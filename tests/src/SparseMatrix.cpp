@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include "knncolle_hnsw/Hnsw.hpp"
+#include "knncolle_hnsw/SparseMatrix.hpp"
+
+#include <vector>
+#include <random>
+#include <string>
+#include <filesystem>
+
+#include "TestCore.h"
+
+class SparseMatrixTest : public TestCore, public ::testing::Test {
+protected:
+    inline static std::vector<double> dense;
+    inline static std::vector<std::size_t> pointers;
+    inline static std::vector<int> indices;
+    inline static std::vector<double> values;
+
+    static void SetUpTestSuite() {
+        assemble({ 150, 20 });
+
+        // Sparsifying the simulated data so that about 70% of entries are zero.
+        dense = data;
+        std::mt19937_64 rng(999);
+        std::uniform_real_distribution<double> unif;
+        pointers.clear();
+        pointers.push_back(0);
+        indices.clear();
+        values.clear();
+        for (int i = 0; i < nobs; ++i) {
+            for (int d = 0; d < ndim; ++d) {
+                auto& val = dense[i * ndim + d];
+                if (unif(rng) < 0.7) {
+                    val = 0;
+                } else {
+                    indices.push_back(d);
+                    values.push_back(val);
+                }
+            }
+            pointers.push_back(indices.size());
+        }
+    }
+
+    typedef knncolle_hnsw::SparseMatrix<int, double> Sparse;
+
+    static std::string save(const knncolle::Prebuilt<int, double, double>& prebuilt, const std::string& name) {
+        const std::filesystem::path dir = name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directory(dir);
+        prebuilt.save(dir);
+        return knncolle::quick_load_as_string(dir / "INDEX");
+    }
+};
+
+TEST_F(SparseMatrixTest, Extraction) {
+    Sparse mat(ndim, nobs, pointers.data(), indices.data(), values.data());
+    EXPECT_EQ(mat.num_observations(), nobs);
+    EXPECT_EQ(mat.num_dimensions(), ndim);
+
+    auto work = mat.new_extractor();
+    std::vector<float> densified(ndim);
+    for (int i = 0; i < nobs; ++i) {
+        auto ptr = work->next();
+        std::vector<double> expected(dense.begin() + i * ndim, dense.begin() + (i + 1) * ndim);
+        EXPECT_EQ(std::vector<double>(ptr, ptr + ndim), expected);
+
+        mat.densify(i, densified.data());
+        EXPECT_EQ(densified, std::vector<float>(expected.begin(), expected.end()));
+    }
+
+    std::vector<int> bad_indices(indices);
+    bad_indices[0] = ndim;
+    std::string msg;
+    try {
+        Sparse bad(ndim, nobs, pointers.data(), bad_indices.data(), values.data());
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("less than the number of dimensions") != std::string::npos);
+}
+
+TEST_F(SparseMatrixTest, Build) {
+    Sparse smat(ndim, nobs, pointers.data(), indices.data(), values.data());
+    knncolle::SimpleMatrix<int, double> dmat(ndim, nobs, dense.data());
+
+    knncolle_hnsw::HnswOptions opt;
+    opt.num_threads = 3;
+    knncolle_hnsw::HnswBuilder<int, double, double, Sparse> sbuilder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    knncolle_hnsw::HnswBuilder<int, double, double> dbuilder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+
+    // Same index as the dense build, for all construction methods.
+    auto sptr = sbuilder.build_known_unique(smat);
+    auto dptr = dbuilder.build_known_unique(dmat);
+    EXPECT_EQ(save(*sptr, "save-sparse-insert"), save(*dptr, "save-dense-insert"));
+
+    sbuilder.get_options().nn_descent_iterations = 5;
+    dbuilder.get_options().nn_descent_iterations = 5;
+    EXPECT_EQ(save(*sbuilder.build_known_unique(smat), "save-sparse-descent"), save(*dbuilder.build_known_unique(dmat), "save-dense-descent"));
+    sbuilder.get_options().nn_descent_iterations = 0;
+    dbuilder.get_options().nn_descent_iterations = 0;
+
+    sbuilder.get_options().insertion_order = knncolle_hnsw::InsertionOrder::PROJECTED_CURVE;
+    dbuilder.get_options().insertion_order = knncolle_hnsw::InsertionOrder::PROJECTED_CURVE;
+    EXPECT_EQ(save(*sbuilder.build_known_unique(smat), "save-sparse-curve"), save(*dbuilder.build_known_unique(dmat), "save-dense-curve"));
+
+    knncolle::NeighborList<int, double> neighbors(nobs);
+    {
+        auto searcher = dptr->initialize();
+        std::vector<int> ires;
+        std::vector<double> dres;
+        for (int i = 0; i < nobs; ++i) {
+            searcher->search(i, 10, &ires, &dres);
+            for (int j = 0; j < 10; ++j) {
+                neighbors[i].emplace_back(ires[j], dres[j]);
+            }
+        }
+    }
+    EXPECT_EQ(save(*sbuilder.build_known_unique(smat, neighbors), "save-sparse-neighbors"), save(*dbuilder.build_known_unique(dmat, neighbors), "save-dense-neighbors"));
+}
+
+TEST_F(SparseMatrixTest, Search) {
+    knncolle::SimpleMatrix<int, double> dmat(ndim, nobs, dense.data());
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto bptr = builder.build_known_unique(dmat);
+
+    auto searcher = bptr->initialize_known();
+    std::vector<int> ires, sires;
+    std::vector<double> dres, sdres;
+    for (int i = 0; i < nobs; ++i) {
+        searcher->search(dense.data() + i * ndim, 8, &ires, &dres);
+        searcher->search_sparse(pointers[i + 1] - pointers[i], indices.data() + pointers[i], values.data() + pointers[i], 8, &sires, &sdres);
+        EXPECT_EQ(ires, sires);
+        EXPECT_EQ(dres, sdres);
+    }
+
+    // Works for an empty query.
+    std::vector<double> zeros(ndim);
+    searcher->search(zeros.data(), 5, &ires, &dres);
+    searcher->search_sparse(0, indices.data(), values.data(), 5, &sires, &sdres);
+    EXPECT_EQ(ires, sires);
+    EXPECT_EQ(dres, sdres);
+
+    // Out-of-range dimension indices are rejected.
+    std::vector<int> bad_indices{ 0, ndim };
+    std::vector<double> bad_values{ 1, 2 };
+    std::string msg;
+    try {
+        searcher->search_sparse(2, bad_indices.data(), bad_values.data(), 5, &sires, &sdres);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("less than the number of dimensions") != std::string::npos);
+}
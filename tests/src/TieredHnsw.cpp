@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include "knncolle_hnsw/TieredHnsw.hpp"
+#include "knncolle_hnsw/load_hnsw_prebuilt.hpp"
+
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <string>
+#include <thread>
+
+#include "TestCore.h"
+
+class TieredHnswTest : public TestCore, public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        assemble({ 300, 7 });
+    }
+
+    // 'deleted' is the interval between deleted observations, which cannot be searched by index.
+    static void compare(const knncolle::Prebuilt<int, double, double>& expected, const knncolle::Prebuilt<int, double, double>& observed, int k, int deleted = 0) {
+        auto esearcher = expected.initialize();
+        auto osearcher = observed.initialize();
+        std::vector<int> eres, ores;
+        std::vector<double> edist, odist;
+        for (int i = 0; i < nobs; ++i) {
+            if (deleted && i % deleted == 0) {
+                EXPECT_ANY_THROW(osearcher->search(i, k, &ores, &odist));
+            } else {
+                esearcher->search(i, k, &eres, &edist);
+                osearcher->search(i, k, &ores, &odist);
+                EXPECT_EQ(eres, ores);
+                EXPECT_EQ(edist, odist);
+            }
+
+            esearcher->search(data.data() + i * ndim, k, &eres, &edist);
+            osearcher->search(data.data() + i * ndim, k, &ores, &odist);
+            EXPECT_EQ(eres, ores);
+            EXPECT_EQ(edist, odist);
+        }
+    }
+};
+
+TEST_F(TieredHnswTest, Basic) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const std::filesystem::path dir = "save-tiered-source";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+
+    const std::filesystem::path tdir = "save-tiered-converted";
+    std::filesystem::remove_all(tdir);
+    std::filesystem::create_directory(tdir);
+    knncolle_hnsw::convert_to_tiered_hnsw(dir, tdir);
+    EXPECT_EQ(knncolle::quick_load_as_string(tdir / "ALGORITHM"), knncolle_hnsw::tiered_hnsw_prebuilt_save_name);
+    EXPECT_FALSE(std::filesystem::exists(tdir / "INDEX"));
+
+    // Same results as the in-memory index with the same 'ef_search'.
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_hnsw::load_hnsw_prebuilt<int, double, double>(dir));
+    auto tiered = std::unique_ptr<knncolle_hnsw::TieredHnswPrebuilt<int, double, double, float> >(knncolle_hnsw::load_tiered_hnsw_prebuilt<int, double, double>(tdir));
+    EXPECT_EQ(tiered->num_observations(), nobs);
+    EXPECT_EQ(tiered->num_dimensions(), ndim);
+    compare(*reloaded, *tiered, 5);
+    compare(*reloaded, *tiered, nobs + 10);
+
+    std::vector<double> buffer(ndim), expected(ndim);
+    tiered->fetch_observation(10, buffer.data());
+    bptr->fetch_observation(10, expected.data());
+    EXPECT_EQ(buffer, expected);
+
+    // The cache absorbs most of the reads.
+    auto stats = tiered->cache_statistics();
+    EXPECT_GT(stats.hits, stats.reads);
+    EXPECT_LE(stats.reads, static_cast<std::size_t>(nobs));
+
+    // Still works without a cache, or with a tiny one that is constantly evicted.
+    for (std::size_t cache : { 0, 5 }) {
+        knncolle_hnsw::TieredHnswOptions opt;
+        opt.cache_size = cache;
+        auto uncached = std::unique_ptr<knncolle_hnsw::TieredHnswPrebuilt<int, double, double, float> >(knncolle_hnsw::load_tiered_hnsw_prebuilt<int, double, double>(tdir, opt));
+        compare(*reloaded, *uncached, 5);
+        if (cache == 0) {
+            EXPECT_EQ(uncached->cache_statistics().hits, 0);
+        }
+    }
+
+    // Same results for each type of visited set.
+    for (auto vtype : { knncolle_hnsw::VisitedSetType::EPOCH, knncolle_hnsw::VisitedSetType::HASH }) {
+        knncolle_hnsw::TieredHnswOptions opt;
+        opt.visited_set = vtype;
+        auto visited = std::unique_ptr<knncolle_hnsw::TieredHnswPrebuilt<int, double, double, float> >(knncolle_hnsw::load_tiered_hnsw_prebuilt<int, double, double>(tdir, opt));
+        compare(*reloaded, *visited, 5);
+    }
+
+    // Round trip through save().
+    const std::filesystem::path sdir = "save-tiered-copy";
+    std::filesystem::remove_all(sdir);
+    std::filesystem::create_directory(sdir);
+    tiered->save(sdir);
+    auto copied = std::unique_ptr<knncolle_hnsw::TieredHnswPrebuilt<int, double, double, float> >(knncolle_hnsw::load_tiered_hnsw_prebuilt<int, double, double>(sdir));
+    compare(*reloaded, *copied, 5);
+}
+
+TEST_F(TieredHnswTest, Parameters) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_manhattan_distance<double>());
+    builder.get_options().num_links = 6;
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    // Also checking that deletions are respected.
+    for (int i = 0; i < nobs; i += 4) {
+        bptr->mark_deleted(i);
+    }
+
+    const std::filesystem::path dir = "save-tiered-source2";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+
+    const std::filesystem::path tdir = "save-tiered-converted2";
+    std::filesystem::remove_all(tdir);
+    std::filesystem::create_directory(tdir);
+    knncolle_hnsw::convert_to_tiered_hnsw(dir, tdir);
+
+    knncolle_hnsw::TieredHnswOptions opt;
+    opt.ef_search = 50;
+    auto tiered = std::unique_ptr<knncolle_hnsw::TieredHnswPrebuilt<int, double, double, float> >(knncolle_hnsw::load_tiered_hnsw_prebuilt<int, double, double>(tdir, opt));
+    EXPECT_EQ(tiered->num_deleted(), bptr->num_deleted());
+
+    // Comparing to the reloaded index, which uses the default 'ef_search'.
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_hnsw::load_hnsw_prebuilt<int, double, double>(dir));
+    auto tiered_default = std::unique_ptr<knncolle_hnsw::TieredHnswPrebuilt<int, double, double, float> >(knncolle_hnsw::load_tiered_hnsw_prebuilt<int, double, double>(tdir));
+    compare(*reloaded, *tiered_default, 8, 4);
+
+    // Multiple threads share the cache.
+    std::vector<std::vector<int> > results(nobs);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 3; ++t) {
+        workers.emplace_back([&, t]() -> void {
+            auto searcher = tiered->initialize();
+            for (int i = t; i < nobs; i += 3) {
+                searcher->search(data.data() + i * ndim, 8, &results[i], NULL);
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    auto searcher = tiered->initialize();
+    std::vector<int> res;
+    for (int i = 0; i < nobs; ++i) {
+        searcher->search(data.data() + i * ndim, 8, &res, NULL);
+        EXPECT_EQ(res, results[i]);
+        for (auto r : res) {
+            EXPECT_NE(r % 4, 0);
+        }
+    }
+}
+
+TEST_F(TieredHnswTest, EntryPoints) {
+    knncolle_hnsw::HnswOptions opt;
+    opt.num_entry_points = 6;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const std::filesystem::path dir = "save-tiered-source3";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    bptr->save(dir);
+
+    const std::filesystem::path tdir = "save-tiered-converted3";
+    std::filesystem::remove_all(tdir);
+    std::filesystem::create_directory(tdir);
+    knncolle_hnsw::convert_to_tiered_hnsw(dir, tdir);
+
+    // Searches start from the same entry points as the in-memory index.
+    auto tiered = std::unique_ptr<knncolle_hnsw::TieredHnswPrebuilt<int, double, double, float> >(knncolle_hnsw::load_tiered_hnsw_prebuilt<int, double, double>(tdir));
+    compare(*bptr, *tiered, 5);
+}
+
+TEST_F(TieredHnswTest, Errors) {
+    const std::filesystem::path dir = "save-tiered-errors";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    knncolle::quick_save(dir / "ALGORITHM", "foo", 3);
+
+    std::string msg;
+    try {
+        knncolle_hnsw::convert_to_tiered_hnsw(dir, dir);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("saved HNSW index") != std::string::npos);
+
+    msg.clear();
+    try {
+        knncolle_hnsw::load_tiered_hnsw_prebuilt<int, double, double>(dir);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("tiered HNSW index") != std::string::npos);
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+// This file is compiled into a separate executable with KNNCOLLE_HNSW_INSTRUMENTATION defined.
+#include "knncolle_hnsw/Hnsw.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <cstdint>
+
+#include "TestCore.h"
+
+TEST(LatencyHistogram, Basic) {
+    knncolle_hnsw::LatencyHistogram hist;
+    EXPECT_EQ(hist.count(), 0);
+    EXPECT_EQ(hist.quantile(0.5), 0);
+    EXPECT_EQ(hist.min(), 0);
+    EXPECT_EQ(hist.mean(), 0);
+
+    // Small values are recorded exactly.
+    for (std::uint64_t i = 1; i <= 20; ++i) {
+        hist.record(i);
+    }
+    EXPECT_EQ(hist.count(), 20);
+    EXPECT_EQ(hist.min(), 1);
+    EXPECT_EQ(hist.max(), 20);
+    EXPECT_EQ(hist.quantile(0.5), 10);
+    EXPECT_EQ(hist.quantile(0), 1);
+    EXPECT_EQ(hist.quantile(1), 20);
+    EXPECT_DOUBLE_EQ(hist.mean(), 10.5);
+
+    // Larger values are recorded within the relative error.
+    knncolle_hnsw::LatencyHistogram big;
+    for (std::uint64_t i = 1; i <= 1000; ++i) {
+        big.record(i * 1000);
+    }
+    for (double q : { 0.5, 0.9, 0.99, 0.999 }) {
+        const double expected = q * 1000 * 1000;
+        const double observed = big.quantile(q);
+        EXPECT_GE(observed, expected);
+        EXPECT_LE(observed, expected * (1 + 1.0 / 32));
+    }
+    EXPECT_EQ(big.quantile(1), 1000000);
+
+    // Merging is the same as recording everything in one histogram.
+    knncolle_hnsw::LatencyHistogram combined;
+    combined.merge(hist);
+    combined.merge(big);
+    knncolle_hnsw::LatencyHistogram expected = hist;
+    for (std::uint64_t i = 1; i <= 1000; ++i) {
+        expected.record(i * 1000);
+    }
+    EXPECT_EQ(combined.count(), expected.count());
+    EXPECT_EQ(combined.min(), 1);
+    for (double q : { 0.1, 0.5, 0.99, 0.999 }) {
+        EXPECT_EQ(combined.quantile(q), expected.quantile(q));
+    }
+
+    combined.clear();
+    EXPECT_EQ(combined.count(), 0);
+    EXPECT_EQ(combined.quantile(0.99), 0);
+
+    // Very large values don't overflow.
+    knncolle_hnsw::LatencyHistogram huge;
+    huge.record(static_cast<std::uint64_t>(-1));
+    EXPECT_EQ(huge.quantile(0.5), static_cast<std::uint64_t>(-1));
+}
+
+class InstrumentationTest : public TestCore, public ::testing::Test {
+protected:
+    void SetUp() {
+        assemble({ 100, 5 });
+    }
+};
+
+TEST_F(InstrumentationTest, SearchLatencies) {
+    knncolle_hnsw::HnswOptions opt;
+    opt.ef_search = 15;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>(), opt);
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    std::vector<int> ires;
+    std::vector<double> dres;
+    {
+        auto searcher = bptr->initialize_known();
+        for (int x = 0; x < nobs; ++x) {
+            searcher->search(x, 5, &ires, &dres);
+            searcher->search(data.data() + x * ndim, 10, &ires, &dres);
+        }
+
+        const auto& lat = searcher->latencies();
+        const auto& hists = lat.histograms();
+        EXPECT_EQ(hists.size(), 2);
+        EXPECT_EQ(hists.at(knncolle_hnsw::HnswSearchLatencies::Key(5, 15)).count(), nobs);
+        EXPECT_EQ(hists.at(knncolle_hnsw::HnswSearchLatencies::Key(10, 15)).count(), nobs);
+        auto overall = lat.overall();
+        EXPECT_EQ(overall.count(), 2 * nobs);
+        EXPECT_LE(overall.quantile(0.5), overall.quantile(0.99));
+        EXPECT_LE(overall.quantile(0.99), overall.quantile(0.999));
+
+        // Not yet reported to the prebuilt index, as the searcher is still alive.
+        EXPECT_EQ(bptr->search_latencies().overall().count(), 0);
+    }
+    EXPECT_EQ(bptr->search_latencies().overall().count(), 2 * nobs);
+
+    // Merging across threads.
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 3; ++t) {
+        workers.emplace_back([&]() -> void {
+            auto searcher = bptr->initialize();
+            std::vector<int> tires;
+            for (int x = 0; x < nobs; ++x) {
+                searcher->search(x, 5, &tires, NULL);
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    auto merged = bptr->search_latencies();
+    EXPECT_EQ(merged.histograms().at(knncolle_hnsw::HnswSearchLatencies::Key(5, 15)).count(), 4 * nobs);
+
+    bptr->clear_search_latencies();
+    EXPECT_EQ(bptr->search_latencies().histograms().size(), 0);
+}
+
+TEST_F(InstrumentationTest, Trace) {
+    std::mutex lock;
+    std::vector<knncolle_hnsw::HnswTraceEvent> events;
+    knncolle_hnsw::custom_trace_for_hnsw() = [&](const knncolle_hnsw::HnswTraceEvent& e) -> void {
+        std::lock_guard<std::mutex> lck(lock);
+        events.push_back(e);
+    };
+
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto bptr = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    std::vector<knncolle_hnsw::HnswTraceEvent> build_events;
+    build_events.swap(events);
+    ASSERT_EQ(build_events.size(), 4);
+    EXPECT_EQ(build_events[0].type, knncolle_hnsw::HnswTraceType::BUILD_PHASE_START);
+    EXPECT_EQ(build_events[0].phase, knncolle_hnsw::BuildPhase::INSERTION);
+    EXPECT_EQ(build_events[1].type, knncolle_hnsw::HnswTraceType::BUILD_PHASE_END);
+    EXPECT_EQ(build_events[1].phase, knncolle_hnsw::BuildPhase::INSERTION);
+    EXPECT_EQ(build_events[3].type, knncolle_hnsw::HnswTraceType::BUILD_PHASE_END);
+    EXPECT_EQ(build_events[3].phase, knncolle_hnsw::BuildPhase::FINALIZATION);
+    EXPECT_LE(build_events[0].time, build_events[3].time);
+
+    auto searcher = bptr->initialize();
+    std::vector<int> ires;
+    searcher->search(0, 7, &ires, NULL);
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[0].type, knncolle_hnsw::HnswTraceType::SEARCH_START);
+    EXPECT_EQ(events[1].type, knncolle_hnsw::HnswTraceType::SEARCH_END);
+    EXPECT_EQ(events[1].k, 7);
+    EXPECT_EQ(events[1].ef, 10);
+    EXPECT_LE(events[0].time, events[1].time);
+
+    knncolle_hnsw::custom_trace_for_hnsw() = nullptr;
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "knncolle_hnsw/join_hnsw_prebuilt.hpp"
+
+#include <vector>
+
+#include "TestCore.h"
+
+class HnswJoinTest : public TestCore, public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        assemble({ 200, 6 });
+    }
+};
+
+TEST_F(HnswJoinTest, Basic) {
+    int nref = 120;
+    int nquery = nobs - nref;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto reference = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nref, data.data()));
+    knncolle::SimpleMatrix<int, double> qmat(ndim, nquery, data.data() + nref * ndim);
+
+    int k = 8;
+    knncolle_hnsw::HnswJoinOptions opt;
+    auto joined = knncolle_hnsw::join_hnsw_prebuilt(qmat, *reference, k, opt);
+    ASSERT_EQ(joined.size(), nquery);
+
+    auto searcher = reference->initialize();
+    std::vector<int> ires;
+    std::vector<double> dres;
+    for (int q = 0; q < nquery; ++q) {
+        searcher->search(data.data() + (nref + q) * ndim, k, &ires, &dres);
+        ASSERT_EQ(joined[q].size(), ires.size());
+        for (int x = 0; x < k; ++x) {
+            EXPECT_EQ(joined[q][x].first, ires[x]);
+            EXPECT_EQ(joined[q][x].second, dres[x]);
+        }
+    }
+
+    // Same results without reordering or with multiple threads.
+    opt.order_by_locality = false;
+    auto unordered = knncolle_hnsw::join_hnsw_prebuilt(qmat, *reference, k, opt);
+    EXPECT_EQ(joined, unordered);
+
+    opt.order_by_locality = true;
+    opt.num_threads = 3;
+    auto parallel = knncolle_hnsw::join_hnsw_prebuilt(qmat, *reference, k, opt);
+    EXPECT_EQ(joined, parallel);
+
+    // Same results with interleaved searches.
+    for (std::size_t interleaved : { 2, 4, 16 }) {
+        opt.num_interleaved = interleaved;
+        auto ileaved = knncolle_hnsw::join_hnsw_prebuilt(qmat, *reference, k, opt);
+        EXPECT_EQ(joined, ileaved);
+    }
+    opt.num_interleaved = 1;
+
+    // Same results when the queries come from another index.
+    auto qindex = builder.build_known_unique(qmat);
+    auto from_index = knncolle_hnsw::join_hnsw_prebuilt(*qindex, *reference, k, opt);
+    ASSERT_EQ(from_index.size(), nquery);
+    for (int q = 0; q < nquery; ++q) {
+        ASSERT_EQ(joined[q].size(), from_index[q].size());
+        for (int x = 0; x < k; ++x) {
+            EXPECT_EQ(joined[q][x].first, from_index[q][x].first);
+            EXPECT_NEAR(joined[q][x].second, from_index[q][x].second, 0.0001); // queries are rounded to float in the index.
+        }
+    }
+}
+
+TEST_F(HnswJoinTest, BatchNormalize) {
+    int nref = 120;
+    int nquery = nobs - nref;
+    auto config = knncolle_hnsw::configure_euclidean_distance<double>();
+    config.normalize_method = knncolle_hnsw::DistanceNormalizeMethod::CUSTOM;
+    int calls = 0;
+    config.custom_normalize_block = [&](std::size_t n, double* distances) -> void {
+        ++calls;
+        for (std::size_t i = 0; i < n; ++i) {
+            distances[i] = distances[i] + 1;
+        }
+    };
+
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(config);
+    auto reference = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nref, data.data()));
+    knncolle::SimpleMatrix<int, double> qmat(ndim, nquery, data.data() + nref * ndim);
+
+    int k = 5;
+    auto searcher = reference->initialize();
+    std::vector<int> ires;
+    std::vector<double> dres;
+    knncolle::NeighborList<int, double> expected(nquery);
+    for (int q = 0; q < nquery; ++q) {
+        searcher->search(data.data() + (nref + q) * ndim, k, &ires, &dres);
+        for (int x = 0; x < k; ++x) {
+            expected[q].emplace_back(ires[x], dres[x]);
+        }
+    }
+
+    // Distances for all queries in a thread's block are normalized at once.
+    for (std::size_t interleaved : { 1, 4 }) {
+        knncolle_hnsw::HnswJoinOptions opt;
+        opt.num_interleaved = interleaved;
+        calls = 0;
+        auto joined = knncolle_hnsw::join_hnsw_prebuilt(qmat, *reference, k, opt);
+        EXPECT_EQ(calls, 1);
+        EXPECT_EQ(joined, expected);
+    }
+}
+
+TEST_F(HnswJoinTest, Errors) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto reference = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    std::string msg;
+    try {
+        knncolle_hnsw::join_hnsw_prebuilt(knncolle::SimpleMatrix<int, double>(ndim - 1, 1, data.data()), *reference, 5, {});
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("dimensionality") != std::string::npos);
+}
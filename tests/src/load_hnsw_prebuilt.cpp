@@ -4,6 +4,7 @@
 #include <vector>
 #include <filesystem>
 #include <string>
+#include <memory>
 
 #include "TestCore.h"
 
@@ -236,3 +237,41 @@ TEST_F(HnswLoadPrebuiltTest, Custom) {
     knncolle_hnsw::custom_load_for_hnsw_distance<float>() = nullptr;
     knncolle_hnsw::custom_load_for_hnsw_normalize<double>() = nullptr;
 }
+
+TEST_F(HnswLoadPrebuiltTest, Parallel) {
+    knncolle_hnsw::HnswBuilder<int, double, double> ab(knncolle_hnsw::makeEuclideanDistanceConfig());
+    auto aptr = ab.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto dir = savedir / "parallel";
+    std::filesystem::create_directory(dir);
+    aptr->save(dir);
+
+    knncolle_hnsw::HnswLoadOptions opt;
+    opt.num_threads = 3;
+    opt.chunk_size = 100; // small chunks to force parallel reads.
+    knncolle_hnsw::HnswLoadStatistics stats;
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_hnsw::load_hnsw_prebuilt<int, double, double>(dir, opt, &stats));
+    EXPECT_EQ(stats.bytes, std::filesystem::file_size(dir / "INDEX"));
+    EXPECT_GE(stats.seconds, 0);
+
+    std::vector<int> output_i, output_i2;
+    std::vector<double> output_d, output_d2;
+    auto searcher = aptr->initialize();
+    auto researcher = reloaded->initialize();
+    for (int x = 0; x < nobs; ++x) {
+        searcher->search(x, 5, &output_i, &output_d);
+        researcher->search(x, 5, &output_i2, &output_d2);
+        EXPECT_EQ(output_i, output_i2);
+        EXPECT_EQ(output_d, output_d2);
+    }
+
+    // Truncated files are detected.
+    std::filesystem::resize_file(dir / "INDEX", stats.bytes - 1);
+    std::string errmsg;
+    try {
+        knncolle_hnsw::load_hnsw_prebuilt<int, double, double>(dir, opt);
+    } catch (std::exception& e) {
+        errmsg = e.what();
+    }
+    EXPECT_TRUE(errmsg.find("truncated") != std::string::npos) << errmsg;
+}
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include "knncolle_hnsw/neighbor_graphs.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <set>
+
+#include "TestCore.h"
+
+class NeighborGraphsTest : public TestCore, public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        assemble({ 150, 4 });
+    }
+};
+
+TEST_F(NeighborGraphsTest, MutualNearestNeighbors) {
+    int nleft = 60;
+    int nright = nobs - nleft;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto left = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nleft, data.data()));
+    auto right = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nright, data.data() + nleft * ndim));
+
+    int k = 7;
+    auto mnn = knncolle_hnsw::find_mutual_nearest_neighbors(*left, *right, k, 3);
+    ASSERT_EQ(mnn.pointers.size(), nleft + 1);
+    EXPECT_EQ(mnn.indices.size(), mnn.pointers.back());
+    EXPECT_EQ(mnn.weights.size(), mnn.pointers.back());
+    EXPECT_FALSE(mnn.indices.empty());
+
+    // Comparing to a reference computed one query at a time.
+    std::vector<std::vector<int> > right_nn(nright);
+    std::vector<double> dres;
+    {
+        auto searcher = left->initialize();
+        for (int j = 0; j < nright; ++j) {
+            searcher->search(data.data() + (nleft + j) * ndim, k, &(right_nn[j]), &dres);
+        }
+    }
+
+    auto searcher = right->initialize();
+    std::vector<int> ires;
+    for (int i = 0; i < nleft; ++i) {
+        searcher->search(data.data() + i * ndim, k, &ires, &dres);
+        std::vector<int> expected;
+        for (auto j : ires) {
+            const auto& rev = right_nn[j];
+            if (std::find(rev.begin(), rev.end(), i) != rev.end()) {
+                expected.push_back(j);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        std::vector<int> observed(mnn.indices.begin() + mnn.pointers[i], mnn.indices.begin() + mnn.pointers[i + 1]);
+        EXPECT_EQ(expected, observed);
+    }
+
+    // Same results with a single thread.
+    auto serial = knncolle_hnsw::find_mutual_nearest_neighbors(*left, *right, k);
+    EXPECT_EQ(serial.pointers, mnn.pointers);
+    EXPECT_EQ(serial.indices, mnn.indices);
+}
+
+TEST_F(NeighborGraphsTest, MutualNearestNeighborsDeleted) {
+    int nleft = 60;
+    int nright = nobs - nleft;
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto left = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nleft, data.data()));
+    auto right = builder.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nright, data.data() + nleft * ndim));
+
+    int k = 7;
+    auto full = knncolle_hnsw::find_mutual_nearest_neighbors(*left, *right, k);
+    ASSERT_FALSE(full.indices.empty());
+    int ldel = std::upper_bound(full.pointers.begin(), full.pointers.end(), 0) - full.pointers.begin() - 1; // first row with an MNN pair.
+    int rdel = full.indices[full.pointers[ldel]];
+    left->mark_deleted(ldel);
+    right->mark_deleted(rdel);
+    EXPECT_TRUE(left->is_deleted(ldel));
+    EXPECT_FALSE(left->is_deleted((ldel + 1) % nleft));
+
+    auto mnn = knncolle_hnsw::find_mutual_nearest_neighbors(*left, *right, k, 3);
+    ASSERT_EQ(mnn.pointers.size(), nleft + 1);
+    EXPECT_EQ(mnn.pointers[ldel], mnn.pointers[ldel + 1]);
+    EXPECT_EQ(std::find(mnn.indices.begin(), mnn.indices.end(), rdel), mnn.indices.end());
+
+    // Comparing to a reference computed one query at a time over the live observations.
+    std::vector<std::vector<int> > right_nn(nright);
+    std::vector<double> dres;
+    {
+        auto searcher = left->initialize();
+        for (int j = 0; j < nright; ++j) {
+            if (j != rdel) {
+                searcher->search(data.data() + (nleft + j) * ndim, k, &(right_nn[j]), &dres);
+            }
+        }
+    }
+
+    auto searcher = right->initialize();
+    std::vector<int> ires;
+    for (int i = 0; i < nleft; ++i) {
+        std::vector<int> expected;
+        if (i != ldel) {
+            searcher->search(data.data() + i * ndim, k, &ires, &dres);
+            for (auto j : ires) {
+                const auto& rev = right_nn[j];
+                if (std::find(rev.begin(), rev.end(), i) != rev.end()) {
+                    expected.push_back(j);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+        }
+        std::vector<int> observed(mnn.indices.begin() + mnn.pointers[i], mnn.indices.begin() + mnn.pointers[i + 1]);
+        EXPECT_EQ(expected, observed);
+    }
+}
+
+TEST_F(NeighborGraphsTest, SharedNearestNeighbors) {
+    knncolle_hnsw::HnswBuilder<int, double, double> builder(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    int k = 5;
+    auto neighbors = knncolle::find_nearest_neighbors(*index, k);
+
+    // Reference computed by brute force over all pairs.
+    auto reference = [&](knncolle_hnsw::SnnWeightScheme scheme) -> std::vector<std::vector<std::pair<int, double> > > {
+        std::vector<std::vector<std::pair<int, int> > > ranked(nobs);
+        for (int i = 0; i < nobs; ++i) {
+            ranked[i].emplace_back(i, 0);
+            for (int r = 0; r < k; ++r) {
+                ranked[i].emplace_back(neighbors[i][r].first, r + 1);
+            }
+        }
+
+        std::vector<std::vector<std::pair<int, double> > > output(nobs);
+        for (int i = 0; i < nobs; ++i) {
+            for (int j = 0; j < nobs; ++j) {
+                if (i == j) {
+                    continue;
+                }
+                int shared = 0, best = 1000000;
+                for (const auto& x : ranked[i]) {
+                    for (const auto& y : ranked[j]) {
+                        if (x.first == y.first) {
+                            ++shared;
+                            best = std::min(best, x.second + y.second);
+                        }
+                    }
+                }
+                if (shared == 0) {
+                    continue;
+                }
+                double weight = 0;
+                if (scheme == knncolle_hnsw::SnnWeightScheme::RANKED) {
+                    weight = k + 1 - best / 2.0;
+                } else if (scheme == knncolle_hnsw::SnnWeightScheme::NUMBER) {
+                    weight = shared;
+                } else {
+                    weight = static_cast<double>(shared) / (2 * (k + 1) - shared);
+                }
+                output[i].emplace_back(j, weight);
+            }
+        }
+        return output;
+    };
+
+    for (auto scheme : { knncolle_hnsw::SnnWeightScheme::RANKED, knncolle_hnsw::SnnWeightScheme::NUMBER, knncolle_hnsw::SnnWeightScheme::JACCARD }) {
+        auto graph = knncolle_hnsw::build_snn_graph(neighbors, scheme, 2);
+        auto expected = reference(scheme);
+        ASSERT_EQ(graph.pointers.size(), nobs + 1);
+        for (int i = 0; i < nobs; ++i) {
+            std::vector<std::pair<int, double> > observed;
+            for (auto p = graph.pointers[i]; p < graph.pointers[i + 1]; ++p) {
+                observed.emplace_back(graph.indices[p], graph.weights[p]);
+            }
+            ASSERT_EQ(observed.size(), expected[i].size());
+            for (std::size_t x = 0; x < observed.size(); ++x) {
+                EXPECT_EQ(observed[x].first, expected[i][x].first);
+                EXPECT_DOUBLE_EQ(observed[x].second, expected[i][x].second);
+            }
+        }
+
+        auto direct = knncolle_hnsw::build_snn_graph(*index, k, scheme);
+        EXPECT_EQ(direct.pointers, graph.pointers);
+        EXPECT_EQ(direct.indices, graph.indices);
+        EXPECT_EQ(direct.weights, graph.weights);
+    }
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include "knncolle_hnsw/serialize_hnsw_prebuilt.hpp"
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+#include "TestCore.h"
+
+class HnswSerializeTest : public TestCore, public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        assemble({ 50, 5 });
+    }
+
+    template<class Prebuilt_, class Other_>
+    static void compare(const Prebuilt_& ref, const Other_& other) {
+        EXPECT_EQ(ref.num_observations(), other.num_observations());
+        EXPECT_EQ(ref.num_dimensions(), other.num_dimensions());
+
+        std::vector<int> output_i, output_i2;
+        std::vector<double> output_d, output_d2;
+        auto searcher = ref.initialize();
+        auto researcher = other.initialize();
+        for (int x = 0; x < nobs; ++x) {
+            searcher->search(x, 5, &output_i, &output_d);
+            researcher->search(x, 5, &output_i2, &output_d2);
+            EXPECT_EQ(output_i, output_i2);
+            EXPECT_EQ(output_d, output_d2);
+        }
+    }
+};
+
+TEST_F(HnswSerializeTest, Basic) {
+    knncolle_hnsw::HnswBuilder<int, double, double> ab(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto aptr = ab.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    std::vector<char> buffer(knncolle_hnsw::serialized_hnsw_prebuilt_size(*aptr));
+    knncolle_hnsw::serialize_hnsw_prebuilt(*aptr, buffer.data());
+
+    // Same results with the sink-based overload.
+    std::vector<char> streamed;
+    knncolle_hnsw::serialize_hnsw_prebuilt(*aptr, [&](const char* ptr, std::size_t n) -> void {
+        streamed.insert(streamed.end(), ptr, ptr + n);
+    });
+    EXPECT_EQ(buffer, streamed);
+
+    auto types = knncolle_hnsw::deserialize_hnsw_prebuilt_types(buffer.data(), buffer.size());
+    EXPECT_EQ(types.data, knncolle::NumericType::FLOAT);
+
+    std::unique_ptr<knncolle::Prebuilt<int, double, double> > reloaded(knncolle_hnsw::deserialize_hnsw_prebuilt<int, double, double>(buffer.data(), buffer.size()));
+    compare(*aptr, *reloaded);
+
+    // The tail of the buffer is the same as the saved INDEX file.
+    const std::filesystem::path dir = "save-serialize-tests";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    aptr->save(dir);
+    auto saved = knncolle::quick_load_as_string(dir / "INDEX");
+    ASSERT_LT(saved.size(), buffer.size());
+    EXPECT_EQ(saved, std::string(buffer.end() - saved.size(), buffer.end()));
+}
+
+TEST_F(HnswSerializeTest, ZeroCopy) {
+    knncolle_hnsw::HnswBuilder<int, double, double> ab(knncolle_hnsw::configure_manhattan_distance<double>());
+    auto aptr = ab.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    const auto size = knncolle_hnsw::serialized_hnsw_prebuilt_size(*aptr);
+    std::vector<char> storage(size + knncolle_hnsw::serialized_level0_alignment);
+    auto offset = reinterpret_cast<std::uintptr_t>(storage.data()) % knncolle_hnsw::serialized_level0_alignment;
+    char* aligned = storage.data() + (offset ? knncolle_hnsw::serialized_level0_alignment - offset : 0);
+    knncolle_hnsw::serialize_hnsw_prebuilt(*aptr, aligned);
+
+    {
+        auto reloaded = std::unique_ptr<knncolle::Prebuilt<int, double, double> >(knncolle_hnsw::deserialize_hnsw_prebuilt<int, double, double>(aligned, size, true));
+        compare(*aptr, *reloaded);
+    }
+
+    // Still works if the buffer is misaligned, in which case a copy is made.
+    std::memmove(aligned + 1, aligned, size);
+    {
+        auto reloaded = std::unique_ptr<knncolle::Prebuilt<int, double, double> >(knncolle_hnsw::deserialize_hnsw_prebuilt<int, double, double>(aligned + 1, size, true));
+        std::fill_n(aligned, size + 1, 0); // the copy should be independent of the buffer.
+        compare(*aptr, *reloaded);
+    }
+}
+
+TEST_F(HnswSerializeTest, Double) {
+    knncolle_hnsw::HnswBuilder<int, double, double, knncolle::Matrix<int, double>, double> ab(knncolle_hnsw::configure_euclidean_distance<double, double>());
+    auto aptr = ab.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+
+    std::vector<char> buffer(knncolle_hnsw::serialized_hnsw_prebuilt_size(*aptr));
+    knncolle_hnsw::serialize_hnsw_prebuilt(*aptr, buffer.data());
+    auto types = knncolle_hnsw::deserialize_hnsw_prebuilt_types(buffer.data(), buffer.size());
+    EXPECT_EQ(types.data, knncolle::NumericType::DOUBLE);
+
+    auto reloaded = std::unique_ptr<knncolle::Prebuilt<int, double, double> >(knncolle_hnsw::deserialize_hnsw_prebuilt<int, double, double, double>(buffer.data(), buffer.size()));
+    compare(*aptr, *reloaded);
+}
+
+TEST_F(HnswSerializeTest, Errors) {
+    knncolle_hnsw::HnswBuilder<int, double, double> ab(knncolle_hnsw::configure_euclidean_distance<double>());
+    auto aptr = ab.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    std::vector<char> buffer(knncolle_hnsw::serialized_hnsw_prebuilt_size(*aptr));
+    knncolle_hnsw::serialize_hnsw_prebuilt(*aptr, buffer.data());
+
+    std::string msg;
+    try {
+        knncolle_hnsw::deserialize_hnsw_prebuilt<int, double, double>(buffer.data(), buffer.size() - 1);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("truncated") != std::string::npos);
+
+    buffer[sizeof(std::size_t)] = '?';
+    msg.clear();
+    try {
+        knncolle_hnsw::deserialize_hnsw_prebuilt_types(buffer.data(), buffer.size());
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("does not contain") != std::string::npos);
+
+    auto config = knncolle_hnsw::configure_euclidean_distance<double>();
+    config.normalize_method = knncolle_hnsw::DistanceNormalizeMethod::CUSTOM;
+    config.custom_normalize = [](double x) -> double { return x; };
+    knncolle_hnsw::HnswBuilder<int, double, double> cb(std::move(config));
+    auto cptr = cb.build_known_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    msg.clear();
+    try {
+        knncolle_hnsw::serialized_hnsw_prebuilt_size(*cptr);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("custom normalization") != std::string::npos);
+}